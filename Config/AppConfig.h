@@ -62,6 +62,29 @@
 	#define NO_VTARGET_DETECT
 //	#define XCK_RESCUE_CLOCK_ENABLE
 //	#define INVERTED_ISP_MISO
+//	#define ISP_USART_SPI
+//	#define ISP_AUTO_SCK
+//	#define ISP_AUTO_SCK_CACHE_ENTRIES 8
+//	#define ENABLE_WRITE_SKIP
+//	#define ISP_ADAPTIVE_WRITE_DELAY
+//	#define ISP_WRITE_TIMING_ENTRIES   4
+//	#define ENABLE_COMMAND_TRACE
+//	#define COMMAND_TRACE_ENTRIES      8
+//	#define COMMAND_TRACE_HISTOGRAMS   12
+
+//	#define ENABLE_BRIDGE_FLOW_CONTROL
+	#define BRIDGE_RTS_PORT            PORTB
+	#define BRIDGE_RTS_DDR             DDRB
+	#define BRIDGE_RTS_MASK            (1 << 5)
+	#define BRIDGE_CTS_PIN             PINB
+	#define BRIDGE_CTS_PORT            PORTB
+	#define BRIDGE_CTS_DDR             DDRB
+	#define BRIDGE_CTS_MASK            (1 << 7)
+
+//	#define USART_TO_USB_BUFFER_SIZE   256
+//	#define USB_TO_USART_BUFFER_SIZE   128
+//	#define BRIDGE_LATENCY_TIMER_US    1000
+//	#define LED_ACTIVITY_PULSE_MS      30
 
 //	#define LIBUSB_DRIVER_COMPAT
 //	#define RESET_TOGGLES_LIBUSB_COMPAT
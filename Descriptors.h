@@ -55,7 +55,28 @@
 		#define CDC_NOTIFICATION_EPSIZE        8
 
 		/** Size in bytes of the CDC data IN and OUT endpoints. */
-		#define CDC_TXRX_EPSIZE                16
+		#define CDC_TXRX_EPSIZE                32
+
+		/** Number of banks of the CDC data IN and OUT endpoints, so that one bank can be filled (or drained) by the
+		 *  firmware while the host is accessing the other.
+		 */
+		#define CDC_TXRX_EPBANKS               2
+
+		/** Total size in bytes of the endpoint DPRAM in the USB AVR's controller, which is shared between the control
+		 *  endpoint and all banks of the configured application endpoints.
+		 */
+		#if (defined(USB_SERIES_2_AVR) || defined(__DOXYGEN__))
+			#define ENDPOINT_DPRAM_SIZE        176
+		#elif defined(USB_SERIES_4_AVR)
+			#define ENDPOINT_DPRAM_SIZE        832
+		#else
+			#define ENDPOINT_DPRAM_SIZE        1024
+		#endif
+
+		#if ((FIXED_CONTROL_ENDPOINT_SIZE + CDC_NOTIFICATION_EPSIZE + \
+		      (2 * CDC_TXRX_EPBANKS * CDC_TXRX_EPSIZE)) > ENDPOINT_DPRAM_SIZE)
+			#error The CDC endpoint sizes and banks exceed the endpoint DPRAM of the selected device.
+		#endif
 		
 	// mkii macros:
 			/** Endpoint address of the AVRISP data OUT endpoint. */
@@ -79,6 +100,18 @@
 		/** Size in bytes of the AVRISP data endpoint. */
 		#define AVRISP_DATA_EPSIZE             64
 
+		/** Number of banks of the AVRISP data endpoint when the IN and OUT directions share a single physical endpoint
+		 *  (Jungo driver compatibility mode), so that the host can transfer one packet while the firmware processes
+		 *  the other. When the directions use separate endpoints (LibUSB driver compatibility mode) there is not enough
+		 *  endpoint DPRAM to double bank both, and a single bank each is used instead.
+		 */
+		#define AVRISP_DATA_EPBANKS            2
+
+		#if ((FIXED_CONTROL_ENDPOINT_SIZE + (AVRISP_DATA_EPBANKS * AVRISP_DATA_EPSIZE)) > ENDPOINT_DPRAM_SIZE) || \
+		    ((FIXED_CONTROL_ENDPOINT_SIZE + (2 * AVRISP_DATA_EPSIZE)) > ENDPOINT_DPRAM_SIZE)
+			#error The AVRISP endpoint sizes and banks exceed the endpoint DPRAM of the selected device.
+		#endif
+
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
 		 *  application code, as the configuration descriptor contains several sub-descriptors which
@@ -0,0 +1,1009 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation harness for the programmer. Replays the command sequence of a complete programming session, as
+ *  sent by avrdude, through the programmer's V2 protocol handler against a simulated target, then checks the target's
+ *  memory and reports the commands issued, the bytes they moved and the simulated time they took.
+ *
+ *  Run with \c --help for the list of options.
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "Sim.h"
+#include "Lib/V2Protocol.h"
+
+/** Maximum number of distinct command types recorded in the session report. */
+#define HOSTSIM_MAX_COMMAND_TYPES    24
+
+/** Assumed time between the programmer sending a response and the host sending its next command, in microseconds,
+ *  covering the host's USB stack and avrdude itself. Each command's response is collected and the next command
+ *  scheduled within whole USB frames, so the default is one 1ms frame.
+ */
+#define HOSTSIM_DEFAULT_LATENCY_US   1000
+
+/** Size of each block of memory read back by the host for verification, in bytes. */
+#define HOSTSIM_READ_BLOCK_SIZE      256
+
+/** Type define for the counters of a single command type in the session report. */
+typedef struct
+{
+	uint16_t   CommandKey; /**< V2 command byte, with the XPROG sub-command in the upper byte for XPROG commands */
+	uint32_t   Count; /**< Number of commands of this type issued */
+	SimStats_t Stats; /**< Simulation counters accumulated over all commands of this type */
+} HostSim_CommandStats_t;
+
+/** Type define for the programming parameters the host uses for an ISP target, as taken from avrdude.conf. */
+typedef struct
+{
+	uint8_t FlashMode; /**< Programming mode of the FLASH page writes, see the PROG_MODE_* masks */
+	uint8_t FlashDelayMS; /**< Write delay of the FLASH pages, for timed write completion */
+	uint8_t EraseDelayMS; /**< Chip erase delay */
+} HostSim_ISPParams_t;
+
+/** Target being programmed, and the settings of the session given on the command line. */
+static const SimTarget_t* Target;
+static const char*        SessionName;
+static uint32_t           ImageSize;
+static uint32_t           RandomState = 1;
+static uint8_t            SCKDuration = 1;
+static uint32_t           HostLatencyUS = HOSTSIM_DEFAULT_LATENCY_US;
+
+/** Image programmed into the target's FLASH, and the buffers of the command being sent and of its response. */
+static uint8_t            Image[SIM_MAX_TRANSFER_SIZE];
+static uint8_t            Command[SIM_MAX_TRANSFER_SIZE];
+static const uint8_t*     Response;
+static uint32_t           ResponseLength;
+
+/** Counters of each command type issued in the session, and the number of failed checks of the session. */
+static HostSim_CommandStats_t CommandStats[HOSTSIM_MAX_COMMAND_TYPES];
+static uint8_t                TotalCommandTypes;
+static uint32_t               SessionFailures;
+
+#if defined(ENABLE_COMMAND_TRACE)
+/** Memory of the programmer's command trace, which the firmware overlays with the USART bridge buffers. */
+static CommandTrace_Storage_t CommandTraceStorage;
+#endif
+
+
+/** Reports a failed check of the session, which is counted towards the exit status of the harness.
+ *
+ *  \param[in] Format  printf() style format string of the failure message
+ */
+static void HostSim_Fail(const char* const Format, ...) __attribute__((format(printf, 1, 2)));
+static void HostSim_Fail(const char* const Format, ...)
+{
+	va_list Args;
+
+	va_start(Args, Format);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, Format, Args);
+	fprintf(stderr, "\n");
+	va_end(Args);
+
+	SessionFailures++;
+}
+
+/** Retrieves the next value of the harness' pseudo-random number generator, so that each seed gives a repeatable
+ *  image.
+ *
+ *  \return Next pseudo-random value
+ */
+static uint32_t HostSim_Random(void)
+{
+	RandomState ^= (RandomState << 13);
+	RandomState ^= (RandomState >> 17);
+	RandomState ^= (RandomState << 5);
+
+	return RandomState;
+}
+
+/** Retrieves the display name of a command type of the session report.
+ *
+ *  \param[in] CommandKey  Command type, as stored in \ref HostSim_CommandStats_t
+ *
+ *  \return Name of the command type
+ */
+static const char* HostSim_GetCommandName(const uint16_t CommandKey)
+{
+	switch (CommandKey)
+	{
+		case CMD_SIGN_ON:                                   return "SIGN_ON";
+		case CMD_SET_PARAMETER:                             return "SET_PARAMETER";
+		case CMD_GET_PARAMETER:                             return "GET_PARAMETER";
+		case CMD_LOAD_ADDRESS:                              return "LOAD_ADDRESS";
+		case CMD_ENTER_PROGMODE_ISP:                        return "ENTER_PROGMODE_ISP";
+		case CMD_LEAVE_PROGMODE_ISP:                        return "LEAVE_PROGMODE_ISP";
+		case CMD_CHIP_ERASE_ISP:                            return "CHIP_ERASE_ISP";
+		case CMD_PROGRAM_FLASH_ISP:                         return "PROGRAM_FLASH_ISP";
+		case CMD_READ_FLASH_ISP:                            return "READ_FLASH_ISP";
+		case CMD_READ_FUSE_ISP:                             return "READ_FUSE_ISP";
+		case CMD_READ_SIGNATURE_ISP:                        return "READ_SIGNATURE_ISP";
+		case CMD_VERIFY_FLASH_CRC_ISP:                      return "VERIFY_FLASH_CRC_ISP";
+		case CMD_BURST_FLASH_ISP:                           return "BURST_FLASH_ISP";
+		case CMD_READ_FLASH_RLE_ISP:                        return "READ_FLASH_RLE_ISP";
+		case CMD_READ_COMMAND_TRACE:                        return "READ_COMMAND_TRACE";
+		case CMD_XPROG_SETMODE:                             return "XPROG_SETMODE";
+		case (CMD_XPROG | (XPROG_CMD_ENTER_PROGMODE << 8)): return "XPROG_ENTER_PROGMODE";
+		case (CMD_XPROG | (XPROG_CMD_LEAVE_PROGMODE << 8)): return "XPROG_LEAVE_PROGMODE";
+		case (CMD_XPROG | (XPROG_CMD_ERASE << 8)):          return "XPROG_ERASE";
+		case (CMD_XPROG | (XPROG_CMD_WRITE_MEM << 8)):      return "XPROG_WRITE_MEM";
+		case (CMD_XPROG | (XPROG_CMD_READ_MEM << 8)):       return "XPROG_READ_MEM";
+		case (CMD_XPROG | (XPROG_CMD_CRC << 8)):            return "XPROG_CRC";
+		case (CMD_XPROG | (XPROG_CMD_SET_PARAM << 8)):      return "XPROG_SET_PARAM";
+		case (CMD_XPROG | (XPROG_CMD_WRITE_MEM_BURST << 8)): return "XPROG_WRITE_MEM_BURST";
+		default:                                            return "(other)";
+	}
+}
+
+/** Adds the change in the simulation counters over a command to the counters of its command type.
+ *
+ *  \param[in,out] Totals  Counters of the command type
+ *  \param[in]     Before  Simulation counters from before the command was sent
+ */
+static void HostSim_AccumulateStats(SimStats_t* const Totals,
+                                    const SimStats_t* const Before)
+{
+	for (uint8_t Category = 0; Category < SIM_TIME_CATEGORIES; Category++)
+	  Totals->TimeNS[Category] += (SimStats.TimeNS[Category] - Before->TimeNS[Category]);
+
+	Totals->TargetBytesOut   += (SimStats.TargetBytesOut   - Before->TargetBytesOut);
+	Totals->TargetBytesIn    += (SimStats.TargetBytesIn    - Before->TargetBytesIn);
+	Totals->USBPacketsOut    += (SimStats.USBPacketsOut    - Before->USBPacketsOut);
+	Totals->USBBytesOut      += (SimStats.USBBytesOut      - Before->USBBytesOut);
+	Totals->USBPacketsIn     += (SimStats.USBPacketsIn     - Before->USBPacketsIn);
+	Totals->USBBytesIn       += (SimStats.USBBytesIn       - Before->USBBytesIn);
+	Totals->EndpointErrors   += (SimStats.EndpointErrors   - Before->EndpointErrors);
+	Totals->TargetViolations += (SimStats.TargetViolations - Before->TargetViolations);
+}
+
+/** Sends the command in \ref Command to the programmer as the host would, and runs the programmer until it has
+ *  sent its response. The response is left in \ref Response, and its command byte and status are checked.
+ *
+ *  \param[in] Length  Length of the command in bytes
+ */
+static void HostSim_Transfer(const uint32_t Length)
+{
+	uint16_t   CommandKey = Command[0];
+	SimStats_t Before     = SimStats;
+
+	if (Command[0] == CMD_XPROG)
+	  CommandKey |= (Command[1] << 8);
+
+	SimEndpoint_HostSend(Command, Length);
+
+	/* The programmer's main loop picks up the command as soon as its first packet arrives */
+	Endpoint_SelectEndpoint(AVRISP_DATA_OUT_EPADDR);
+	Endpoint_WaitUntilReady();
+
+	if (Endpoint_IsOUTReceived())
+	  V2Protocol_ProcessCommand();
+
+	uint32_t UnreadPackets = SimEndpoint_HostDiscardUnread();
+
+	if (UnreadPackets)
+	  SimEndpoint_Error("%s left %u command packets unread", HostSim_GetCommandName(CommandKey), UnreadPackets);
+
+	ResponseLength = SimEndpoint_HostReceive(&Response);
+
+	/* The host sends its next command once it has received the whole response and processed it */
+	SimClock_AdvanceTo(SimEndpoint_GetINCompleteTime(), SIM_TIME_USB);
+	SimClock_Advance(HostLatencyUS * 1000ULL, SIM_TIME_USB);
+
+	uint8_t StatusIndex = ((Command[0] == CMD_XPROG) ? 2 : 1);
+
+	if ((ResponseLength <= StatusIndex) || (Response[0] != Command[0]))
+	  HostSim_Fail("%s gave a malformed response of %u bytes", HostSim_GetCommandName(CommandKey), ResponseLength);
+	else if (Response[StatusIndex] != STATUS_CMD_OK)
+	  HostSim_Fail("%s failed with status 0x%02X", HostSim_GetCommandName(CommandKey), Response[StatusIndex]);
+
+	if (SimVerbose)
+	{
+		printf("  %-22s %6u bytes out, %6u bytes in, t = %.3f ms\n", HostSim_GetCommandName(CommandKey), Length,
+		       ResponseLength, (SimClock_GetTimeNS() / 1e6));
+	}
+
+	uint8_t TypeIndex;
+
+	for (TypeIndex = 0; TypeIndex < TotalCommandTypes; TypeIndex++)
+	{
+		if (CommandStats[TypeIndex].CommandKey == CommandKey)
+		  break;
+	}
+
+	if (TypeIndex == TotalCommandTypes)
+	{
+		if (TotalCommandTypes == HOSTSIM_MAX_COMMAND_TYPES)
+		  return;
+
+		CommandStats[TotalCommandTypes++].CommandKey = CommandKey;
+	}
+
+	CommandStats[TypeIndex].Count++;
+	HostSim_AccumulateStats(&CommandStats[TypeIndex].Stats, &Before);
+}
+
+/** Writes a 16-bit value into a command buffer in big endian order, as the V2 protocol sends multi-byte values. */
+static void HostSim_PutBE16(uint8_t* const Buffer,
+                            const uint16_t Value)
+{
+	Buffer[0] = (Value >> 8);
+	Buffer[1] = (Value & 0xFF);
+}
+
+/** Writes a 32-bit value into a command buffer in big endian order, as the V2 protocol sends multi-byte values. */
+static void HostSim_PutBE32(uint8_t* const Buffer,
+                            const uint32_t Value)
+{
+	HostSim_PutBE16(&Buffer[0], (Value >> 16));
+	HostSim_PutBE16(&Buffer[2], (Value & 0xFFFF));
+}
+
+/** Computes the CRC-32 (IEEE) of a block of memory, as computed by an XMEGA target's NVM controller.
+ *
+ *  \param[in] Data    Data to compute the CRC of
+ *  \param[in] Length  Length of the data in bytes
+ *
+ *  \return CRC-32 of the data
+ */
+static uint32_t HostSim_CRC32(const uint8_t* const Data,
+                              const uint32_t Length)
+{
+	uint32_t CRC = 0xFFFFFFFF;
+
+	for (uint32_t CurrentByte = 0; CurrentByte < Length; CurrentByte++)
+	{
+		CRC ^= Data[CurrentByte];
+
+		for (uint8_t Bit = 0; Bit < 8; Bit++)
+		  CRC = ((CRC & 1) ? ((CRC >> 1) ^ 0xEDB88320) : (CRC >> 1));
+	}
+
+	return ~CRC;
+}
+
+/** Retrieves the host's programming parameters of the current ISP target, as taken from avrdude.conf.
+ *
+ *  \return Programming parameters of the target
+ */
+static HostSim_ISPParams_t HostSim_GetISPParams(void)
+{
+	/* Paged writes with RDY/BSY polling, committing each page */
+	HostSim_ISPParams_t Params = {.FlashMode = 0xC1, .FlashDelayMS = 6, .EraseDelayMS = 9};
+
+	if (Target == &SimTarget_ATmega2560)
+	  Params.FlashDelayMS = 10;
+
+	return Params;
+}
+
+static void HostSim_SignOn(void)
+{
+	Command[0] = CMD_SIGN_ON;
+	HostSim_Transfer(1);
+}
+
+static void HostSim_SetParameter(const uint8_t ParamID,
+                                 const uint8_t Value)
+{
+	Command[0] = CMD_SET_PARAMETER;
+	Command[1] = ParamID;
+	Command[2] = Value;
+	HostSim_Transfer(3);
+}
+
+static void HostSim_GetParameter(const uint8_t ParamID)
+{
+	Command[0] = CMD_GET_PARAMETER;
+	Command[1] = ParamID;
+	HostSim_Transfer(2);
+}
+
+/** Sends the host's initial handshake with the programmer, as avrdude does on connection. */
+static void HostSim_Connect(void)
+{
+	HostSim_SignOn();
+	HostSim_GetParameter(PARAM_HW_VER);
+	HostSim_GetParameter(PARAM_SW_MAJOR);
+	HostSim_GetParameter(PARAM_SW_MINOR);
+	HostSim_GetParameter(PARAM_VTARGET);
+}
+
+/** Sends a CMD_LOAD_ADDRESS command, flagging FLASH addresses beyond the first 64K words as needing a LOAD EXTENDED
+ *  ADDRESS instruction as avrdude does.
+ *
+ *  \param[in] WordAddress  Address to load, in words for FLASH
+ */
+static void HostSim_LoadAddress(const uint32_t WordAddress)
+{
+	uint32_t Address = WordAddress;
+
+	if (Target->FlashSize > (128 * 1024UL))
+	  Address |= (1UL << 31);
+
+	Command[0] = CMD_LOAD_ADDRESS;
+	HostSim_PutBE32(&Command[1], Address);
+	HostSim_Transfer(5);
+}
+
+/** Enters ISP programming mode and checks the target's signature, as avrdude does on starting a session. */
+static void HostSim_EnterISPSession(void)
+{
+	HostSim_Connect();
+	HostSim_SetParameter(PARAM_SCK_DURATION, SCKDuration);
+
+	const uint8_t EnterCommand[] = {CMD_ENTER_PROGMODE_ISP, 200, 100, 25, 32, 0, 0x53, 3, 0xAC, 0x53, 0x00, 0x00};
+	memcpy(Command, EnterCommand, sizeof(EnterCommand));
+	HostSim_Transfer(sizeof(EnterCommand));
+
+	for (uint8_t SignatureByte = 0; SignatureByte < 3; SignatureByte++)
+	{
+		const uint8_t SignatureCommand[] = {CMD_READ_SIGNATURE_ISP, 4, 0x30, 0x00, SignatureByte, 0x00};
+		memcpy(Command, SignatureCommand, sizeof(SignatureCommand));
+		HostSim_Transfer(sizeof(SignatureCommand));
+
+		if ((ResponseLength != 4) || (Response[2] != Target->Signature[SignatureByte]))
+		  HostSim_Fail("signature byte %u did not match the target", SignatureByte);
+	}
+
+	const uint8_t FuseCommand[] = {CMD_READ_FUSE_ISP, 4, 0x50, 0x00, 0x00, 0x00};
+	memcpy(Command, FuseCommand, sizeof(FuseCommand));
+	HostSim_Transfer(sizeof(FuseCommand));
+
+	const uint8_t EraseCommand[] = {CMD_CHIP_ERASE_ISP, HostSim_GetISPParams().EraseDelayMS, 1, 0xAC, 0x80, 0x00, 0x00};
+	memcpy(Command, EraseCommand, sizeof(EraseCommand));
+	HostSim_Transfer(sizeof(EraseCommand));
+}
+
+/** Leaves ISP programming mode, releasing the target. */
+static void HostSim_LeaveISPSession(void)
+{
+	const uint8_t LeaveCommand[] = {CMD_LEAVE_PROGMODE_ISP, 1, 1};
+	memcpy(Command, LeaveCommand, sizeof(LeaveCommand));
+	HostSim_Transfer(sizeof(LeaveCommand));
+}
+
+/** Reads back the target's FLASH over ISP in blocks with CMD_READ_FLASH_ISP or CMD_READ_FLASH_RLE_ISP, and checks it
+ *  against the image.
+ *
+ *  \param[in] V2Command  Read command to use
+ */
+static void HostSim_ReadBackISPFlash(const uint8_t V2Command)
+{
+	for (uint32_t BlockStart = 0; BlockStart < ImageSize; BlockStart += HOSTSIM_READ_BLOCK_SIZE)
+	{
+		uint16_t BlockBytes = MIN(HOSTSIM_READ_BLOCK_SIZE, (ImageSize - BlockStart));
+
+		/* avrdude loads the address before each block */
+		HostSim_LoadAddress(BlockStart >> 1);
+
+		Command[0] = V2Command;
+		HostSim_PutBE16(&Command[1], BlockBytes);
+		Command[3] = 0x20;
+		HostSim_Transfer(4);
+
+		uint8_t  ReadData[HOSTSIM_READ_BLOCK_SIZE];
+		uint16_t ReadBytes = 0;
+
+		/* Decode the response, expanding the runs of 0xFF of a run length encoded read */
+		for (uint32_t ResponseByte = 2; (ResponseByte + 1) < ResponseLength; ResponseByte++)
+		{
+			uint8_t DataByte  = Response[ResponseByte];
+			uint8_t RunLength = 1;
+
+			if ((V2Command == CMD_READ_FLASH_RLE_ISP) && (DataByte == 0xFF))
+			  RunLength = Response[++ResponseByte];
+
+			while (RunLength-- && (ReadBytes < BlockBytes))
+			  ReadData[ReadBytes++] = DataByte;
+		}
+
+		if ((ReadBytes != BlockBytes) || memcmp(ReadData, &Image[BlockStart], BlockBytes))
+		  HostSim_Fail("read back FLASH block at 0x%05X did not match the image", BlockStart);
+	}
+}
+
+/** Writes the image to the target's FLASH page by page with the standard program memory command.
+ *
+ *  \param[in] Params  ISP parameters of the simulated target
+ */
+static void HostSim_WriteISPFlashPages(const HostSim_ISPParams_t Params)
+{
+	for (uint32_t PageStart = 0; PageStart < ImageSize; PageStart += Target->FlashPageSize)
+	{
+		uint16_t PageBytes = MIN(Target->FlashPageSize, (ImageSize - PageStart));
+
+		HostSim_LoadAddress(PageStart >> 1);
+
+		const uint8_t ProgramHeader[] = {CMD_PROGRAM_FLASH_ISP, (PageBytes >> 8), (PageBytes & 0xFF), Params.FlashMode,
+		                                 Params.FlashDelayMS, 0x40, 0x4C, 0x20, 0xFF, 0xFF};
+		memcpy(Command, ProgramHeader, sizeof(ProgramHeader));
+		memcpy(&Command[sizeof(ProgramHeader)], &Image[PageStart], PageBytes);
+		HostSim_Transfer(sizeof(ProgramHeader) + PageBytes);
+	}
+}
+
+/** Replays an avrdude ISP session: connect, erase, write the image page by page, then read it back to verify. */
+static void HostSim_RunISPSession(void)
+{
+	HostSim_ISPParams_t Params = HostSim_GetISPParams();
+
+	HostSim_EnterISPSession();
+	HostSim_WriteISPFlashPages(Params);
+	HostSim_ReadBackISPFlash(CMD_READ_FLASH_ISP);
+	HostSim_LeaveISPSession();
+}
+
+/** Replays an avrdude ISP session twice over with timed page writes, entering programming mode again for the second
+ *  pass as a new run of avrdude would. With ISP_ADAPTIVE_WRITE_DELAY, the first page of the first pass waits out the
+ *  host's delay while the device's page write time is measured, and later pages only the measured time. The second
+ *  pass must then be the quicker, as the measured time is kept by device signature and applies from its first page.
+ */
+static void HostSim_RunISPTimedSession(void)
+{
+	HostSim_ISPParams_t Params = HostSim_GetISPParams();
+	uint64_t            PassNS[2];
+
+	/* Paged writes with a timed delay, committing each page */
+	Params.FlashMode = 0x91;
+
+	for (uint8_t Pass = 0; Pass < 2; Pass++)
+	{
+		uint64_t StartNS = SimClock_GetTimeNS();
+
+		HostSim_EnterISPSession();
+		HostSim_WriteISPFlashPages(Params);
+		HostSim_ReadBackISPFlash(CMD_READ_FLASH_ISP);
+		HostSim_LeaveISPSession();
+
+		PassNS[Pass] = (SimClock_GetTimeNS() - StartNS);
+		printf("Pass %u: %.3f ms\n", (Pass + 1), (PassNS[Pass] / 1e6));
+	}
+
+	#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+	if (PassNS[1] >= PassNS[0])
+	  HostSim_Fail("timed page writes were not shortened once the device's write time was measured");
+	#endif
+}
+
+/** Replays an ISP session using the vendor specific commands: the image is written with a single burst write, and
+ *  verified by CRC and with a run length encoded read back. Where the firmware buffers program data, leaving the burst
+ *  write unavailable, the image is written page by page instead.
+ */
+static void HostSim_RunISPVendorSession(void)
+{
+	HostSim_ISPParams_t Params = HostSim_GetISPParams();
+
+	HostSim_EnterISPSession();
+	HostSim_LoadAddress(0);
+
+	#if defined(ISP_STREAM_PROGRAM_DATA)
+	const uint8_t BurstHeader[] = {CMD_BURST_FLASH_ISP, (ImageSize >> 24), ((ImageSize >> 16) & 0xFF),
+	                               ((ImageSize >> 8) & 0xFF), (ImageSize & 0xFF), (Target->FlashPageSize >> 8),
+	                               (Target->FlashPageSize & 0xFF), Params.FlashMode, Params.FlashDelayMS,
+	                               0x40, 0x4C, 0x20, 0xFF, 0xFF};
+	memcpy(Command, BurstHeader, sizeof(BurstHeader));
+	memcpy(&Command[sizeof(BurstHeader)], Image, ImageSize);
+	HostSim_Transfer(sizeof(BurstHeader) + ImageSize);
+
+	uint16_t TotalPages = ((ImageSize + Target->FlashPageSize - 1) / Target->FlashPageSize);
+
+	if ((ResponseLength != 4) || ((((uint16_t)Response[2] << 8) | Response[3]) != TotalPages))
+	  HostSim_Fail("burst write did not report all %u pages as written", TotalPages);
+	#else
+	HostSim_WriteISPFlashPages(Params);
+	#endif
+
+	/* Verify by CRC in blocks of the read block size, as many blocks to a command as fit */
+	HostSim_LoadAddress(0);
+
+	uint32_t TotalBlocks = ((ImageSize + HOSTSIM_READ_BLOCK_SIZE - 1) / HOSTSIM_READ_BLOCK_SIZE);
+
+	for (uint32_t FirstBlock = 0; FirstBlock < TotalBlocks; FirstBlock += ISP_MAX_VERIFY_BLOCKS)
+	{
+		uint8_t CommandBlocks = MIN(ISP_MAX_VERIFY_BLOCKS, (TotalBlocks - FirstBlock));
+
+		Command[0] = CMD_VERIFY_FLASH_CRC_ISP;
+		Command[1] = 0x20;
+		HostSim_PutBE16(&Command[2], HOSTSIM_READ_BLOCK_SIZE);
+		Command[4] = CommandBlocks;
+
+		for (uint8_t Block = 0; Block < CommandBlocks; Block++)
+		{
+			uint32_t BlockStart = ((FirstBlock + Block) * HOSTSIM_READ_BLOCK_SIZE);
+			uint16_t CRC        = 0xFFFF;
+
+			/* Bytes past the end of the image are read back as erased */
+			for (uint16_t CurrentByte = 0; CurrentByte < HOSTSIM_READ_BLOCK_SIZE; CurrentByte++)
+			{
+				uint32_t Address = (BlockStart + CurrentByte);
+				CRC = _crc_xmodem_update(CRC, ((Address < ImageSize) ? Image[Address] : 0xFF));
+			}
+
+			HostSim_PutBE16(&Command[5 + (Block * 2)], CRC);
+		}
+
+		HostSim_Transfer(5 + (CommandBlocks * 2));
+	}
+
+	HostSim_ReadBackISPFlash(CMD_READ_FLASH_RLE_ISP);
+	HostSim_LeaveISPSession();
+}
+
+/** Sends an XPROG command of the given length, with the XPROG command byte and sub-command already in place. */
+static void HostSim_XPROGCommand(const uint8_t XPROGCommand,
+                                 const uint32_t Length)
+{
+	Command[0] = CMD_XPROG;
+	Command[1] = XPROGCommand;
+	HostSim_Transfer(Length);
+}
+
+/** Enters XPROG programming mode in the given protocol and checks the target's signature, as avrdude does on starting
+ *  a PDI or TPI session, then erases the chip.
+ *
+ *  \param[in] Protocol  XPROG protocol of the target, an XPROG_PROTOCOL_* value
+ */
+static void HostSim_EnterXPROGSession(const uint8_t Protocol)
+{
+	HostSim_Connect();
+
+	Command[0] = CMD_XPROG_SETMODE;
+	Command[1] = Protocol;
+	HostSim_Transfer(2);
+
+	HostSim_XPROGCommand(XPROG_CMD_ENTER_PROGMODE, 2);
+
+	uint32_t SignatureAddress;
+
+	if (Protocol == XPROG_PROTOCOL_PDI)
+	{
+		Command[2] = XPROG_PARAM_NVMBASE;
+		HostSim_PutBE32(&Command[3], 0x010001C0);
+		HostSim_XPROGCommand(XPROG_CMD_SET_PARAM, 7);
+
+		Command[2] = XPROG_PARAM_EEPPAGESIZE;
+		HostSim_PutBE16(&Command[3], 32);
+		HostSim_XPROGCommand(XPROG_CMD_SET_PARAM, 5);
+
+		SignatureAddress = 0x01000090;
+	}
+	else
+	{
+		Command[2] = XPROG_PARAM_NVMCMD_REG;
+		Command[3] = 0x33;
+		HostSim_XPROGCommand(XPROG_CMD_SET_PARAM, 4);
+
+		Command[2] = XPROG_PARAM_NVMCSR_REG;
+		Command[3] = 0x32;
+		HostSim_XPROGCommand(XPROG_CMD_SET_PARAM, 4);
+
+		SignatureAddress = 0x3FC0;
+	}
+
+	Command[2] = XPROG_MEM_TYPE_APPL;
+	HostSim_PutBE32(&Command[3], SignatureAddress);
+	HostSim_PutBE16(&Command[7], 3);
+	HostSim_XPROGCommand(XPROG_CMD_READ_MEM, 9);
+
+	if ((ResponseLength != 6) || memcmp(&Response[3], Target->Signature, 3))
+	  HostSim_Fail("signature did not match the target");
+
+	Command[2] = XPROG_ERASE_CHIP;
+	HostSim_PutBE32(&Command[3], ((Protocol == XPROG_PROTOCOL_PDI) ? 0 : 0x4000));
+	HostSim_XPROGCommand(XPROG_CMD_ERASE, 7);
+}
+
+/** Retrieves the address of the start of FLASH of the current XPROG target, in the address space used by the
+ *  programmer's XPROG commands.
+ *
+ *  \return Base address of the target's FLASH
+ */
+static uint32_t HostSim_GetXPROGFlashBase(void)
+{
+	return ((Target->Interface == SIM_INTERFACE_PDI) ? 0x0800000 : 0x4000);
+}
+
+/** Reads back the target's FLASH with XPROG READ_MEM commands and checks it against the image. */
+static void HostSim_ReadBackXPROGFlash(void)
+{
+	for (uint32_t BlockStart = 0; BlockStart < ImageSize; BlockStart += HOSTSIM_READ_BLOCK_SIZE)
+	{
+		uint16_t BlockBytes = MIN(HOSTSIM_READ_BLOCK_SIZE, (ImageSize - BlockStart));
+
+		Command[2] = XPROG_MEM_TYPE_APPL;
+		HostSim_PutBE32(&Command[3], (HostSim_GetXPROGFlashBase() + BlockStart));
+		HostSim_PutBE16(&Command[7], BlockBytes);
+		HostSim_XPROGCommand(XPROG_CMD_READ_MEM, 9);
+
+		if ((ResponseLength != (3UL + BlockBytes)) || memcmp(&Response[3], &Image[BlockStart], BlockBytes))
+		  HostSim_Fail("read back FLASH block at 0x%05X did not match the image", BlockStart);
+	}
+}
+
+/** Leaves XPROG programming mode, releasing the target. */
+static void HostSim_LeaveXPROGSession(void)
+{
+	HostSim_XPROGCommand(XPROG_CMD_LEAVE_PROGMODE, 2);
+}
+
+/** Replays an avrdude PDI or TPI session: connect, erase, write the image page by page, then read it back to
+ *  verify.
+ */
+static void HostSim_RunXPROGSession(void)
+{
+	HostSim_EnterXPROGSession((Target->Interface == SIM_INTERFACE_PDI) ? XPROG_PROTOCOL_PDI : XPROG_PROTOCOL_TPI);
+
+	for (uint32_t PageStart = 0; PageStart < ImageSize; PageStart += Target->FlashPageSize)
+	{
+		uint16_t PageBytes = MIN(Target->FlashPageSize, (ImageSize - PageStart));
+
+		Command[2] = XPROG_MEM_TYPE_APPL;
+		Command[3] = (XPROG_PAGEMODE_ERASE | XPROG_PAGEMODE_WRITE);
+		HostSim_PutBE32(&Command[4], (HostSim_GetXPROGFlashBase() + PageStart));
+		HostSim_PutBE16(&Command[8], PageBytes);
+		memcpy(&Command[10], &Image[PageStart], PageBytes);
+		HostSim_XPROGCommand(XPROG_CMD_WRITE_MEM, (10 + PageBytes));
+	}
+
+	HostSim_ReadBackXPROGFlash();
+	HostSim_LeaveXPROGSession();
+}
+
+/** Replays a PDI session using the vendor specific burst write, verified with the target's application section CRC
+ *  rather than by reading the image back.
+ */
+static void HostSim_RunPDIVendorSession(void)
+{
+	HostSim_EnterXPROGSession(XPROG_PROTOCOL_PDI);
+
+	Command[2] = XPROG_MEM_TYPE_APPL;
+	HostSim_PutBE32(&Command[3], HostSim_GetXPROGFlashBase());
+	HostSim_PutBE16(&Command[7], Target->FlashPageSize);
+	HostSim_PutBE32(&Command[9], ImageSize);
+	memcpy(&Command[13], Image, ImageSize);
+	HostSim_XPROGCommand(XPROG_CMD_WRITE_MEM_BURST, (13 + ImageSize));
+
+	/* The CRC covers the whole application section, which is erased beyond the end of the image */
+	static uint8_t ApplicationSection[32 * 1024UL];
+
+	memset(ApplicationSection, 0xFF, sizeof(ApplicationSection));
+	memcpy(ApplicationSection, Image, MIN(ImageSize, sizeof(ApplicationSection)));
+
+	uint32_t ExpectedCRC = (HostSim_CRC32(ApplicationSection, sizeof(ApplicationSection)) & 0xFFFFFF);
+
+	Command[2] = XPROG_CRC_APP;
+	HostSim_XPROGCommand(XPROG_CMD_CRC, 3);
+
+	if ((ResponseLength != 6) ||
+	    ((((uint32_t)Response[3] << 16) | ((uint32_t)Response[5] << 8) | Response[4]) != ExpectedCRC))
+	{
+		HostSim_Fail("application section CRC did not match the image");
+	}
+
+	HostSim_LeaveXPROGSession();
+}
+
+/** Prints the report of the session, listing the counters and simulated time of each command type. */
+static void HostSim_PrintReport(void)
+{
+	SimStats_t Totals = {0};
+	uint32_t   TotalCommands = 0;
+
+	printf("%-22s %6s %9s %9s %9s %9s %10s %10s %10s %10s %10s\n", "Command", "Count", "USB out", "USB in", "Bus out",
+	       "Bus in", "USB ms", "Bus ms", "Poll ms", "Delay ms", "Total ms");
+
+	for (uint8_t TypeIndex = 0; TypeIndex < TotalCommandTypes; TypeIndex++)
+	{
+		HostSim_CommandStats_t* Type = &CommandStats[TypeIndex];
+		SimStats_t*             Stats = &Type->Stats;
+		uint64_t                TotalNS = 0;
+
+		for (uint8_t Category = 0; Category < SIM_TIME_CATEGORIES; Category++)
+		{
+			TotalNS += Stats->TimeNS[Category];
+			Totals.TimeNS[Category] += Stats->TimeNS[Category];
+		}
+
+		Totals.USBBytesOut    += Stats->USBBytesOut;
+		Totals.USBBytesIn     += Stats->USBBytesIn;
+		Totals.TargetBytesOut += Stats->TargetBytesOut;
+		Totals.TargetBytesIn  += Stats->TargetBytesIn;
+		TotalCommands         += Type->Count;
+
+		printf("%-22s %6u %9u %9u %9u %9u %10.3f %10.3f %10.3f %10.3f %10.3f\n", HostSim_GetCommandName(Type->CommandKey),
+		       Type->Count, Stats->USBBytesOut, Stats->USBBytesIn, Stats->TargetBytesOut, Stats->TargetBytesIn,
+		       (Stats->TimeNS[SIM_TIME_USB] / 1e6), (Stats->TimeNS[SIM_TIME_TARGET_BUS] / 1e6),
+		       (Stats->TimeNS[SIM_TIME_POLLING] / 1e6), (Stats->TimeNS[SIM_TIME_FIXED_DELAY] / 1e6), (TotalNS / 1e6));
+	}
+
+	uint64_t SessionNS = 0;
+
+	for (uint8_t Category = 0; Category < SIM_TIME_CATEGORIES; Category++)
+	  SessionNS += Totals.TimeNS[Category];
+
+	printf("%-22s %6u %9u %9u %9u %9u %10.3f %10.3f %10.3f %10.3f %10.3f\n", "Total", TotalCommands, Totals.USBBytesOut,
+	       Totals.USBBytesIn, Totals.TargetBytesOut, Totals.TargetBytesIn, (Totals.TimeNS[SIM_TIME_USB] / 1e6),
+	       (Totals.TimeNS[SIM_TIME_TARGET_BUS] / 1e6), (Totals.TimeNS[SIM_TIME_POLLING] / 1e6),
+	       (Totals.TimeNS[SIM_TIME_FIXED_DELAY] / 1e6), (SessionNS / 1e6));
+
+	printf("Image throughput: %.0f bytes/s over the whole session\n", (ImageSize / (SessionNS / 1e9)));
+	printf("Endpoint errors: %u, target violations: %u, failed checks: %u\n\n", SimStats.EndpointErrors,
+	       SimStats.TargetViolations, SessionFailures);
+}
+
+#if defined(ENABLE_COMMAND_TRACE)
+/** Reads out and clears the programmer's command trace, printing its records and latency histograms, and checks
+ *  that it traced every command of the session.
+ */
+static void HostSim_ReadCommandTrace(void)
+{
+	uint32_t SessionCommands = 0;
+
+	for (uint8_t TypeIndex = 0; TypeIndex < TotalCommandTypes; TypeIndex++)
+	  SessionCommands += CommandStats[TypeIndex].Count;
+
+	Command[0] = CMD_READ_COMMAND_TRACE;
+	Command[1] = 1;
+	HostSim_Transfer(2);
+
+	if (ResponseLength < 9)
+	  return;
+
+	const uint8_t* Trace         = &Response[2];
+	uint32_t       TotalCommands = (((uint32_t)Trace[0] << 24) | ((uint32_t)Trace[1] << 16) | (Trace[2] << 8) | Trace[3]);
+	uint8_t        TotalRecords  = Trace[4];
+
+	Trace += 5;
+
+	if (TotalCommands != SessionCommands)
+	  HostSim_Fail("command trace holds %u commands, but %u were sent", TotalCommands, SessionCommands);
+
+	printf("Command trace, last %u of %u commands:\n", TotalRecords, TotalCommands);
+	printf("  %-22s %6s %12s %12s %8s\n", "Command", "Status", "Start ms", "Duration us", "Polls");
+
+	for (uint8_t Record = 0; Record < TotalRecords; Record++, Trace += 13)
+	{
+		if ((Trace + 13) > &Response[ResponseLength])
+		{
+			HostSim_Fail("command trace response is truncated");
+			return;
+		}
+
+		uint32_t StartUS    = (((uint32_t)Trace[3] << 24) | ((uint32_t)Trace[4] << 16) | (Trace[5] << 8) | Trace[6]);
+		uint32_t DurationUS = (((uint32_t)Trace[7] << 24) | ((uint32_t)Trace[8] << 16) | (Trace[9] << 8) | Trace[10]);
+
+		printf("  %-22s   0x%02X %12.3f %12u %8u\n", HostSim_GetCommandName(Trace[0] | (Trace[1] << 8)), Trace[2],
+		       (StartUS / 1e3), DurationUS, ((Trace[11] << 8) | Trace[12]));
+
+		if (Trace[2] != STATUS_CMD_OK)
+		  HostSim_Fail("command trace recorded status 0x%02X", Trace[2]);
+	}
+
+	uint8_t TotalHistograms = Trace[0];
+	uint8_t TotalBins       = Trace[1];
+
+	Trace += 2;
+
+	printf("Latency histograms, commands per bin of durations under 64us, 256us, 1ms, ... and longer:\n");
+
+	for (uint8_t Histogram = 0; Histogram < TotalHistograms; Histogram++)
+	{
+		if ((Trace + 2 + (TotalBins * 2)) > &Response[ResponseLength])
+		{
+			HostSim_Fail("command trace response is truncated");
+			return;
+		}
+
+		printf("  %-22s", HostSim_GetCommandName(Trace[0] | (Trace[1] << 8)));
+
+		for (uint8_t Bin = 0; Bin < TotalBins; Bin++)
+		  printf(" %6u", ((Trace[2 + (Bin * 2)] << 8) | Trace[3 + (Bin * 2)]));
+
+		printf("\n");
+		Trace += (2 + (TotalBins * 2));
+	}
+
+	printf("\n");
+}
+#endif
+
+/** Prints the command line usage of the harness. */
+static void HostSim_PrintUsage(void)
+{
+	printf("Usage: HostSim [options]\n"
+	       "  --target NAME         Target to program: atmega328p (default), atmega2560, atxmega32a4u, attiny10\n"
+	       "  --session NAME        Session to replay: isp, isp-vendor, isp-timed, pdi, pdi-vendor\n"
+	       "                        or tpi\n"
+	       "                        (default: the avrdude session for the target's interface)\n"
+	       "  --image-size BYTES    Size of the image to program (default: half the target's FLASH)\n"
+	       "  --seed N              Seed of the random image contents (default: 1)\n"
+	       "  --sck N               ISP SCK duration parameter, 0 to 6 (default: 1)\n"
+	       "  --usb-latency-us N    Assumed host turnaround between commands (default: %u)\n"
+	       "  --verbose             Log each command and target access\n", HOSTSIM_DEFAULT_LATENCY_US);
+}
+
+int main(int argc, char** argv)
+{
+	Target = &SimTarget_ATmega328P;
+
+	for (int Arg = 1; Arg < argc; Arg++)
+	{
+		const char* Option = argv[Arg];
+		const char* Value  = ((Arg + 1) < argc) ? argv[Arg + 1] : NULL;
+
+		if (!(strcmp(Option, "--verbose")))
+		{
+			SimVerbose = true;
+			continue;
+		}
+		else if (!(strcmp(Option, "--help")) || !(Value))
+		{
+			HostSim_PrintUsage();
+			return (strcmp(Option, "--help") ? EXIT_FAILURE : EXIT_SUCCESS);
+		}
+
+		Arg++;
+
+		if (!(strcmp(Option, "--target")))
+		{
+			const SimTarget_t* const Targets[] = {&SimTarget_ATmega328P, &SimTarget_ATmega2560, &SimTarget_ATxmega32A4U,
+			                                      &SimTarget_ATtiny10};
+
+			Target = NULL;
+
+			for (uint8_t TargetIndex = 0; TargetIndex < (sizeof(Targets) / sizeof(Targets[0])); TargetIndex++)
+			{
+				if (!(strcasecmp(Value, Targets[TargetIndex]->Name)))
+				  Target = Targets[TargetIndex];
+			}
+
+			if (!(Target))
+			{
+				fprintf(stderr, "Unknown target %s\n", Value);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!(strcmp(Option, "--session")))
+		{
+			SessionName = Value;
+		}
+		else if (!(strcmp(Option, "--image-size")))
+		{
+			ImageSize = strtoul(Value, NULL, 0);
+		}
+		else if (!(strcmp(Option, "--seed")))
+		{
+			RandomState = (strtoul(Value, NULL, 0) | 1);
+		}
+		else if (!(strcmp(Option, "--sck")))
+		{
+			SCKDuration = strtoul(Value, NULL, 0);
+		}
+		else if (!(strcmp(Option, "--usb-latency-us")))
+		{
+			HostLatencyUS = strtoul(Value, NULL, 0);
+		}
+		else
+		{
+			HostSim_PrintUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!(SessionName))
+	{
+		const char* const DefaultSessions[] = {"isp", "pdi", "tpi"};
+		SessionName = DefaultSessions[Target->Interface];
+	}
+
+	if (!(ImageSize))
+	  ImageSize = (Target->FlashSize / 2);
+
+	/* Only the hardware SPI speeds are simulated, the slower software SPI speeds are not */
+	if (SCKDuration > 6)
+	{
+		fprintf(stderr, "SCK duration must be from 0 to 6\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((ImageSize > Target->FlashSize) || (ImageSize > sizeof(Image) - 16) || (ImageSize & 0x01))
+	{
+		fprintf(stderr, "Image size must be even, and no larger than the target's %u bytes of FLASH\n", Target->FlashSize);
+		return EXIT_FAILURE;
+	}
+
+	/* Fill the image with random data, leaving every fourth page blank as in a typical sparse image */
+	memset(Image, 0xFF, ImageSize);
+
+	for (uint32_t CurrentByte = 0; CurrentByte < ImageSize; CurrentByte++)
+	{
+		if (((CurrentByte / Target->FlashPageSize) % 4) != 3)
+		  Image[CurrentByte] = HostSim_Random();
+	}
+
+	SimCore_EraseEEPROM();
+	SimCore_AttachTarget(Target);
+	SimEndpoint_Reset();
+
+	#if defined(ENABLE_COMMAND_TRACE)
+	CommandTrace_Init(&CommandTraceStorage);
+	#endif
+
+	V2Protocol_Init();
+	SimCore_SyncTimer();
+	SimInterrupt_SetGlobalEnable(true);
+
+	printf("Session %s on %s: %u byte image, SCK duration %u, %u us host latency\n", SessionName, Target->Name,
+	       ImageSize, SCKDuration, HostLatencyUS);
+
+	if (!(strcmp(SessionName, "isp")) && (Target->Interface == SIM_INTERFACE_ISP))
+	  HostSim_RunISPSession();
+	else if (!(strcmp(SessionName, "isp-vendor")) && (Target->Interface == SIM_INTERFACE_ISP))
+	  HostSim_RunISPVendorSession();
+	else if (!(strcmp(SessionName, "isp-timed")) && (Target->Interface == SIM_INTERFACE_ISP))
+	  HostSim_RunISPTimedSession();
+	else if (!(strcmp(SessionName, "pdi")) && (Target->Interface == SIM_INTERFACE_PDI))
+	  HostSim_RunXPROGSession();
+	else if (!(strcmp(SessionName, "pdi-vendor")) && (Target->Interface == SIM_INTERFACE_PDI))
+	  HostSim_RunPDIVendorSession();
+	else if (!(strcmp(SessionName, "tpi")) && (Target->Interface == SIM_INTERFACE_TPI))
+	  HostSim_RunXPROGSession();
+	else
+	{
+		fprintf(stderr, "Session %s cannot be run on %s\n", SessionName, Target->Name);
+		return EXIT_FAILURE;
+	}
+
+	/* Check the whole of the target's FLASH, which must be erased beyond the end of the image */
+	const uint8_t* Flash = Target->GetFlash();
+
+	for (uint32_t Address = 0; Address < Target->FlashSize; Address++)
+	{
+		if (Flash[Address] != ((Address < ImageSize) ? Image[Address] : 0xFF))
+		{
+			HostSim_Fail("target FLASH differs from the image at 0x%05X", Address);
+			break;
+		}
+	}
+
+	HostSim_PrintReport();
+
+	#if defined(ENABLE_COMMAND_TRACE)
+	HostSim_ReadCommandTrace();
+	#endif
+
+	return ((SessionFailures || SimStats.EndpointErrors || SimStats.TargetViolations) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,101 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the LUFA common definitions, providing the subset used by the V2 protocol
+ *  sources.
+ */
+
+#ifndef _HOSTSIM_LUFA_COMMON_H_
+#define _HOSTSIM_LUFA_COMMON_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+		#include <stddef.h>
+		#include <string.h>
+
+		#include <avr/io.h>
+		#include <avr/interrupt.h>
+
+	/* Macros: */
+		#define BOARD_GSCHEIDUINO          100
+		#define BOARD_ATEVAL               101
+		#define BOARD_XPLAIN               102
+		#define BOARD_XPLAIN_REV1          103
+		#define BOARD_U2S                  104
+
+		#if !defined(BOARD)
+			#define BOARD                  BOARD_GSCHEIDUINO
+		#endif
+
+		#define ARCH_AVR8                  0
+		#define ARCH                       ARCH_AVR8
+
+		#define MIN(x, y)                  (((x) < (y)) ? (x) : (y))
+		#define MAX(x, y)                  (((x) > (y)) ? (x) : (y))
+
+		#define ATTR_WARN_UNUSED_RESULT    __attribute__ ((warn_unused_result))
+		#define ATTR_NON_NULL_PTR_ARG(...) __attribute__ ((nonnull (__VA_ARGS__)))
+		#define ATTR_ALWAYS_INLINE         __attribute__ ((always_inline))
+		#define ATTR_NO_INLINE             __attribute__ ((noinline))
+		#define ATTR_PACKED                __attribute__ ((packed))
+
+		#define GCC_MEMORY_BARRIER()       __asm__ __volatile__ ("" ::: "memory")
+
+		#define SwapEndian_16(Word)        ((uint16_t)((((Word) & 0xFF00) >> 8) | (((Word) & 0x00FF) << 8)))
+		#define SwapEndian_32(DWord)       __builtin_bswap32(DWord)
+
+	/* Type Defines: */
+		typedef uint8_t uint_reg_t;
+
+	/* Inline Functions: */
+		static inline uint_reg_t GetGlobalInterruptMask(void)
+		{
+			return SREG;
+		}
+
+		static inline void SetGlobalInterruptMask(const uint_reg_t GlobalIntState)
+		{
+			SimInterrupt_SetGlobalEnable(GlobalIntState & (1 << 7));
+		}
+
+		static inline void GlobalInterruptEnable(void)
+		{
+			SimInterrupt_SetGlobalEnable(true);
+		}
+
+		static inline void GlobalInterruptDisable(void)
+		{
+			SimInterrupt_SetGlobalEnable(false);
+		}
+
+#endif
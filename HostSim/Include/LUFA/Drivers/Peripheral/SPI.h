@@ -0,0 +1,68 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the LUFA hardware SPI driver. The speed masks encode the SPI clock prescaler
+ *  directly, so that the simulated SPI peripheral can time each byte.
+ */
+
+#ifndef _HOSTSIM_LUFA_SPI_H_
+#define _HOSTSIM_LUFA_SPI_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+
+	/* Macros: */
+		/** Mask of the speed bits of the SPI options, holding the base two logarithm of the clock prescaler. */
+		#define SPI_SPEED_MASK             0x07
+
+		#define SPI_SPEED_FCPU_DIV_2       1
+		#define SPI_SPEED_FCPU_DIV_4       2
+		#define SPI_SPEED_FCPU_DIV_8       3
+		#define SPI_SPEED_FCPU_DIV_16      4
+		#define SPI_SPEED_FCPU_DIV_32      5
+		#define SPI_SPEED_FCPU_DIV_64      6
+		#define SPI_SPEED_FCPU_DIV_128     7
+
+		#define SPI_SCK_LEAD_RISING        0
+		#define SPI_SCK_LEAD_FALLING       (1 << CPOL)
+		#define SPI_SAMPLE_LEADING         0
+		#define SPI_SAMPLE_TRAILING        (1 << CPHA)
+		#define SPI_ORDER_MSB_FIRST        0
+		#define SPI_ORDER_LSB_FIRST        (1 << DORD)
+		#define SPI_MODE_SLAVE             0
+		#define SPI_MODE_MASTER            (1 << MSTR)
+
+	/* Function Prototypes: */
+		void SPI_Init(const uint8_t SPIOptions);
+		void SPI_Disable(void);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the LUFA USB device stack. Only the endpoint functions used by the V2 protocol
+ *  sources are provided, implemented by the simulated endpoint in HostSim/SimEndpoint.c, together with the
+ *  descriptor types needed by the application's descriptor header.
+ */
+
+#ifndef _HOSTSIM_LUFA_USB_H_
+#define _HOSTSIM_LUFA_USB_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+
+		#include "../../Common/Common.h"
+
+	/* Macros: */
+		#define ENDPOINT_DIR_MASK          0x80
+		#define ENDPOINT_DIR_IN            0x80
+		#define ENDPOINT_DIR_OUT           0x00
+		#define ENDPOINT_EPNUM_MASK        0x0F
+		#define ENDPOINT_CONTROLEP         0
+
+		#define EP_TYPE_CONTROL            0x00
+		#define EP_TYPE_BULK               0x02
+		#define EP_TYPE_INTERRUPT          0x03
+
+		#define FIXED_CONTROL_ENDPOINT_SIZE 8
+		#define FIXED_NUM_CONFIGURATIONS   1
+
+		/** Timeout in milliseconds of a stream transfer waiting on the host, as in the real USB stack. */
+		#define USB_STREAM_TIMEOUT_MS      100
+
+	/* Enums: */
+		enum USB_Device_States_t
+		{
+			DEVICE_STATE_Unattached = 0,
+			DEVICE_STATE_Powered    = 1,
+			DEVICE_STATE_Default    = 2,
+			DEVICE_STATE_Addressed  = 3,
+			DEVICE_STATE_Configured = 4,
+			DEVICE_STATE_Suspended  = 5,
+		};
+
+		enum Endpoint_WaitUntilReady_ErrorCodes_t
+		{
+			ENDPOINT_READYWAIT_NoError            = 0,
+			ENDPOINT_READYWAIT_EndpointStalled    = 1,
+			ENDPOINT_READYWAIT_DeviceDisconnected = 2,
+			ENDPOINT_READYWAIT_BusSuspended       = 3,
+			ENDPOINT_READYWAIT_Timeout            = 4,
+		};
+
+		enum Endpoint_Stream_RW_ErrorCodes_t
+		{
+			ENDPOINT_RWSTREAM_NoError            = 0,
+			ENDPOINT_RWSTREAM_EndpointStalled    = 1,
+			ENDPOINT_RWSTREAM_DeviceDisconnected = 2,
+			ENDPOINT_RWSTREAM_BusSuspended       = 3,
+			ENDPOINT_RWSTREAM_Timeout            = 4,
+			ENDPOINT_RWSTREAM_IncompleteTransfer = 5,
+		};
+
+	/* Type Defines: */
+		typedef struct
+		{
+			uint8_t Size;
+			uint8_t Type;
+		} ATTR_PACKED USB_Descriptor_Header_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint16_t TotalConfigurationSize;
+			uint8_t  TotalInterfaces;
+			uint8_t  ConfigurationNumber;
+			uint8_t  ConfigurationStrIndex;
+			uint8_t  ConfigAttributes;
+			uint8_t  MaxPowerConsumption;
+		} ATTR_PACKED USB_Descriptor_Configuration_Header_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t InterfaceNumber;
+			uint8_t AlternateSetting;
+			uint8_t TotalEndpoints;
+			uint8_t Class;
+			uint8_t SubClass;
+			uint8_t Protocol;
+			uint8_t InterfaceStrIndex;
+		} ATTR_PACKED USB_Descriptor_Interface_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t  EndpointAddress;
+			uint8_t  Attributes;
+			uint16_t EndpointSize;
+			uint8_t  PollingIntervalMS;
+		} ATTR_PACKED USB_Descriptor_Endpoint_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t  Subtype;
+			uint16_t CDCSpecification;
+		} ATTR_PACKED USB_CDC_Descriptor_FunctionalHeader_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t Subtype;
+			uint8_t Capabilities;
+		} ATTR_PACKED USB_CDC_Descriptor_FunctionalACM_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t Subtype;
+			uint8_t MasterInterfaceNumber;
+			uint8_t SlaveInterfaceNumber;
+		} ATTR_PACKED USB_CDC_Descriptor_FunctionalUnion_t;
+
+	/* External Variables: */
+		extern volatile uint8_t USB_DeviceState;
+
+	/* Function Prototypes: */
+		void     Endpoint_SelectEndpoint(const uint8_t Address);
+		void     Endpoint_SetEndpointDirection(const uint8_t DirectionMask);
+		bool     Endpoint_IsOUTReceived(void);
+		bool     Endpoint_IsINReady(void);
+		bool     Endpoint_IsReadWriteAllowed(void);
+		uint16_t Endpoint_BytesInEndpoint(void);
+		uint8_t  Endpoint_GetBusyBanks(void);
+		void     Endpoint_ClearOUT(void);
+		void     Endpoint_ClearIN(void);
+		uint8_t  Endpoint_WaitUntilReady(void);
+
+		uint8_t  Endpoint_Read_8(void);
+		uint16_t Endpoint_Read_16_LE(void);
+		uint16_t Endpoint_Read_16_BE(void);
+		uint32_t Endpoint_Read_32_LE(void);
+		uint32_t Endpoint_Read_32_BE(void);
+		void     Endpoint_Discard_8(void);
+		void     Endpoint_Discard_16(void);
+		void     Endpoint_Write_8(const uint8_t Data);
+		void     Endpoint_Write_16_LE(const uint16_t Data);
+		void     Endpoint_Write_16_BE(const uint16_t Data);
+
+		uint8_t  Endpoint_Read_Stream_LE(void* const Buffer,
+		                                 uint16_t Length,
+		                                 uint16_t* const BytesProcessed);
+		uint8_t  Endpoint_Read_Stream_BE(void* const Buffer,
+		                                 uint16_t Length,
+		                                 uint16_t* const BytesProcessed);
+		uint8_t  Endpoint_Write_Stream_LE(const void* const Buffer,
+		                                  uint16_t Length,
+		                                  uint16_t* const BytesProcessed);
+		uint8_t  Endpoint_Discard_Stream(uint16_t Length,
+		                                 uint16_t* const BytesProcessed);
+
+#endif
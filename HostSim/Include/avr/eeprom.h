@@ -0,0 +1,75 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the AVR EEPROM access functions, where EEPROM variables are ordinary memory.
+ */
+
+#ifndef _HOSTSIM_AVR_EEPROM_H_
+#define _HOSTSIM_AVR_EEPROM_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <string.h>
+
+	/* Macros: */
+		/** EEPROM variables are gathered into their own section, so that the simulation can erase them all to 0xFF
+		 *  at power up as on a new part, see \c SimCore_EraseEEPROM().
+		 */
+		#define EEMEM                      __attribute__((section("SimEEPROM")))
+
+	/* Inline Functions: */
+		static inline uint8_t eeprom_read_byte(const uint8_t* Address)
+		{
+			return *Address;
+		}
+
+		static inline void eeprom_update_byte(uint8_t* Address, const uint8_t Value)
+		{
+			*Address = Value;
+		}
+
+		static inline void eeprom_write_byte(uint8_t* Address, const uint8_t Value)
+		{
+			*Address = Value;
+		}
+
+		static inline void eeprom_read_block(void* Destination, const void* Source, const size_t Length)
+		{
+			memcpy(Destination, Source, Length);
+		}
+
+		static inline void eeprom_update_block(const void* Source, void* Destination, const size_t Length)
+		{
+			memcpy(Destination, Source, Length);
+		}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the AVR interrupt definitions. Interrupt service routines become plain functions
+ *  called by the simulation, and the global interrupt flag is modeled by the simulated interrupt controller.
+ */
+
+#ifndef _HOSTSIM_AVR_INTERRUPT_H_
+#define _HOSTSIM_AVR_INTERRUPT_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+
+	/* Macros: */
+		#define ISR_BLOCK
+		#define ISR_NOBLOCK
+		#define ISR_NAKED
+
+		#define ISR(Vector, ...)           void Vector(void); void Vector(void)
+
+		#define sei()                      SimInterrupt_SetGlobalEnable(true)
+		#define cli()                      SimInterrupt_SetGlobalEnable(false)
+
+	/* Function Prototypes: */
+		void SimInterrupt_SetGlobalEnable(const bool Enabled);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the AVR register definitions of the ATmega32U2. Most registers are plain
+ *  variables, while the registers through which the firmware talks to a target are accessed through functions of
+ *  the simulated peripherals, so that each access can advance the simulated clock and exchange data with the
+ *  simulated target.
+ */
+
+#ifndef _HOSTSIM_AVR_IO_H_
+#define _HOSTSIM_AVR_IO_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+		#include <stddef.h>
+
+	/* Macros: */
+		#define _BV(Bit)                   (1 << (Bit))
+
+		#define USB_SERIES_2_AVR
+
+		/** Registers backed by a simulated peripheral, where each access is seen by the simulation. */
+		#define SPSR                       (*SimRegister_SPSR())
+		#define SPDR                       (*SimRegister_SPDR())
+		#define UCSR1A                     (*SimRegister_UCSR1A())
+		#define UDR1                       (*SimRegister_UDR1())
+		#define PIND                       (*SimRegister_PIND())
+		#define TCNT0                      (*SimRegister_TCNT0())
+		#define TIFR0                      (*SimRegister_TIFR0())
+
+		/** Interrupt vectors implemented by the firmware, as the names of the functions the simulation calls. */
+		#define TIMER0_OVF_vect            SimVector_Timer0Overflow
+
+		#define PB0                        0
+		#define PB1                        1
+		#define PB2                        2
+		#define PB3                        3
+		#define PB4                        4
+		#define PB5                        5
+		#define PB6                        6
+		#define PB7                        7
+		#define PD0                        0
+		#define PD7                        7
+
+		#define CS00                       0
+		#define CS01                       1
+		#define CS02                       2
+		#define WGM00                      0
+		#define WGM01                      1
+		#define TOIE0                      0
+		#define OCIE0A                     1
+		#define OCIE0B                     2
+		#define TOV0                       0
+		#define OCF0A                      1
+		#define OCF0B                      2
+
+		#define CS10                       0
+		#define CS11                       1
+		#define CS12                       2
+		#define WGM12                      3
+		#define COM1A0                     6
+		#define OCIE1A                     1
+		#define OCF1A                      1
+
+		#define RXC1                       7
+		#define TXC1                       6
+		#define UDRE1                      5
+		#define FE1                        4
+		#define DOR1                       3
+		#define UPE1                       2
+		#define U2X1                       1
+		#define RXCIE1                     7
+		#define TXCIE1                     6
+		#define UDRIE1                     5
+		#define RXEN1                      4
+		#define TXEN1                      3
+		#define UMSEL11                    7
+		#define UMSEL10                    6
+		#define UPM11                      5
+		#define UPM10                      4
+		#define USBS1                      3
+		#define UCSZ11                     2
+		#define UCSZ10                     1
+		#define UCPOL1                     0
+		#define UDORD1                     2
+		#define UCPHA1                     1
+
+		#define SPIF                       7
+		#define WCOL                       6
+		#define SPI2X                      0
+		#define SPIE                       7
+		#define SPE                        6
+		#define DORD                       5
+		#define MSTR                       4
+		#define CPOL                       3
+		#define CPHA                       2
+		#define SPR1                       1
+		#define SPR0                       0
+
+	/* External Variables: */
+		extern volatile uint8_t  PINB, DDRB, PORTB, PINC, DDRC, PORTC, DDRD, PORTD;
+		extern volatile uint8_t  TCCR0A, TCCR0B, OCR0A, OCR0B, TIMSK0;
+		extern volatile uint8_t  TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+		extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+		extern volatile uint8_t  UCSR1B, UCSR1C, UCSR1D;
+		extern volatile uint16_t UBRR1;
+		extern volatile uint8_t  SPCR;
+		extern volatile uint8_t  GPIOR0, GPIOR1, GPIOR2;
+		extern volatile uint8_t  MCUSR, CLKPR, SREG;
+
+	/* Function Prototypes: */
+		volatile uint8_t* SimRegister_SPSR(void);
+		volatile uint8_t* SimRegister_SPDR(void);
+		volatile uint8_t* SimRegister_UCSR1A(void);
+		volatile uint8_t* SimRegister_UDR1(void);
+		volatile uint8_t* SimRegister_PIND(void);
+		volatile uint8_t* SimRegister_TCNT0(void);
+		volatile uint8_t* SimRegister_TIFR0(void);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the AVR atomic block macros. Simulated interrupts are held off for the duration
+ *  of the block, and any that became pending are run once the outermost block ends.
+ */
+
+#ifndef _HOSTSIM_UTIL_ATOMIC_H_
+#define _HOSTSIM_UTIL_ATOMIC_H_
+
+	/* Includes: */
+		#include <stdint.h>
+
+	/* Macros: */
+		#define ATOMIC_RESTORESTATE        0
+		#define ATOMIC_FORCEON             1
+		#define NONATOMIC_RESTORESTATE     0
+		#define NONATOMIC_FORCEOFF         1
+
+		#define ATOMIC_BLOCK(Type)         for (uint8_t SimAtomic = SimInterrupt_BeginAtomicBlock(); SimAtomic; \
+		                                        SimAtomic = SimInterrupt_EndAtomicBlock())
+		#define NONATOMIC_BLOCK(Type)      for (uint8_t SimAtomic = 1; SimAtomic; SimAtomic = 0)
+
+	/* Function Prototypes: */
+		void SimInterrupt_EnterAtomic(void);
+		void SimInterrupt_ExitAtomic(void);
+
+	/* Inline Functions: */
+		/* The block's loop variable is set from constants here, so that the compiler can see that the body of each
+		 * atomic block runs exactly once, as it can for the real macros */
+		static inline uint8_t SimInterrupt_BeginAtomicBlock(void)
+		{
+			SimInterrupt_EnterAtomic();
+			return 1;
+		}
+
+		static inline uint8_t SimInterrupt_EndAtomicBlock(void)
+		{
+			SimInterrupt_ExitAtomic();
+			return 0;
+		}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the AVR CRC functions, implemented in C as given in the avr-libc documentation.
+ */
+
+#ifndef _HOSTSIM_UTIL_CRC16_H_
+#define _HOSTSIM_UTIL_CRC16_H_
+
+	/* Includes: */
+		#include <stdint.h>
+
+	/* Inline Functions: */
+		static inline uint16_t _crc16_update(uint16_t CRC, const uint8_t Data)
+		{
+			CRC ^= Data;
+
+			for (uint8_t i = 0; i < 8; i++)
+			  CRC = (CRC & 1) ? ((CRC >> 1) ^ 0xA001) : (CRC >> 1);
+
+			return CRC;
+		}
+
+		static inline uint16_t _crc_xmodem_update(uint16_t CRC, const uint8_t Data)
+		{
+			CRC ^= ((uint16_t)Data << 8);
+
+			for (uint8_t i = 0; i < 8; i++)
+			  CRC = (CRC & 0x8000) ? ((CRC << 1) ^ 0x1021) : (CRC << 1);
+
+			return CRC;
+		}
+
+		static inline uint16_t _crc_ccitt_update(uint16_t CRC, uint8_t Data)
+		{
+			Data ^= (CRC & 0xFF);
+			Data ^= (Data << 4);
+
+			return ((((uint16_t)Data << 8) | (CRC >> 8)) ^ (uint8_t)(Data >> 4) ^ ((uint16_t)Data << 3));
+		}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Host simulation replacement for the AVR delay loops, which advance the simulated clock by the cycles the loops
+ *  would have taken instead.
+ */
+
+#ifndef _HOSTSIM_UTIL_DELAY_BASIC_H_
+#define _HOSTSIM_UTIL_DELAY_BASIC_H_
+
+	/* Includes: */
+		#include <stdint.h>
+
+	/* Function Prototypes: */
+		void SimClock_Delay(const uint64_t DelayNS);
+
+	/* Inline Functions: */
+		static inline void _delay_loop_1(const uint8_t Count)
+		{
+			SimClock_Delay(((uint64_t)(Count ? Count : 256) * 3 * 1000000000ULL) / F_CPU);
+		}
+
+		static inline void _delay_loop_2(const uint16_t Count)
+		{
+			SimClock_Delay(((uint64_t)(Count ? Count : 65536) * 4 * 1000000000ULL) / F_CPU);
+		}
+
+#endif
@@ -0,0 +1,157 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Header file for the host simulation of the programmer. The simulation runs the unmodified V2 protocol sources of
+ *  the firmware on the host, against a simulated clock, USB endpoint and programming target. The clock only advances
+ *  when the firmware does something that takes time on the real hardware: shifting bytes over the target bus,
+ *  polling a peripheral register, waiting in a fixed delay or waiting for a USB packet.
+ */
+
+#ifndef _HOSTSIM_H_
+#define _HOSTSIM_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+		#include <stdio.h>
+
+		#include <avr/io.h>
+
+	/* Macros: */
+		/** Converts a number of system clock cycles of the programmer to simulated time in nanoseconds. */
+		#define SIM_CYCLES_TO_NS(Cycles)     ((((uint64_t)(Cycles)) * 1000000000ULL) / F_CPU)
+
+		/** Simulated time taken by each access to a polled peripheral register, as the firmware's poll loops take
+		 *  roughly this many system clock cycles per iteration.
+		 */
+		#define SIM_POLL_CYCLES              4
+
+		/** Number of bits in each frame of the PDI and TPI target buses: start, 8 data, parity and 2 stop bits. */
+		#define SIM_USART_FRAME_BITS         12
+
+		/** Size of the programmer's AVRISP data endpoints, in bytes. */
+		#define SIM_ENDPOINT_SIZE            64
+
+		/** Maximum length of a command or response exchanged with the simulated programmer, in bytes. */
+		#define SIM_MAX_TRANSFER_SIZE        (300 * 1024UL)
+
+	/* Enums: */
+		/** Enum for the categories of simulated time, so that each command's time can be broken down by its cause. */
+		enum SimTimeCategories_t
+		{
+			SIM_TIME_USB          = 0, /**< Waiting for USB packets to be transferred to or from the host */
+			SIM_TIME_TARGET_BUS   = 1, /**< Shifting data over the target's SPI, PDI or TPI bus */
+			SIM_TIME_POLLING      = 2, /**< Polling peripheral registers, including the timebase in timed waits */
+			SIM_TIME_FIXED_DELAY  = 3, /**< Fixed delays of the firmware, such as target reset pulses */
+			SIM_TIME_CATEGORIES   = 4, /**< Total number of time categories */
+		};
+
+		/** Enum for the programming interfaces of the simulated targets. */
+		enum SimInterfaces_t
+		{
+			SIM_INTERFACE_ISP     = 0, /**< Target is programmed over ISP, through the hardware SPI */
+			SIM_INTERFACE_PDI     = 1, /**< Target is programmed over PDI, through the synchronous USART */
+			SIM_INTERFACE_TPI     = 2, /**< Target is programmed over TPI, through the synchronous USART */
+		};
+
+	/* Type Defines: */
+		/** Type define for the counters of the simulation, which the harness samples around each command. */
+		typedef struct
+		{
+			uint64_t TimeNS[SIM_TIME_CATEGORIES]; /**< Simulated time spent in each \ref SimTimeCategories_t category */
+			uint32_t TargetBytesOut; /**< Bytes sent by the programmer over the target bus */
+			uint32_t TargetBytesIn; /**< Bytes received by the programmer over the target bus */
+			uint32_t USBPacketsOut; /**< USB packets sent by the host to the programmer, including ZLPs */
+			uint32_t USBBytesOut; /**< USB payload bytes sent by the host to the programmer */
+			uint32_t USBPacketsIn; /**< USB packets sent by the programmer to the host, including ZLPs */
+			uint32_t USBBytesIn; /**< USB payload bytes sent by the programmer to the host */
+			uint32_t EndpointErrors; /**< Misuses of the USB endpoints by the firmware, see \ref SimEndpoint_Error */
+			uint32_t TargetViolations; /**< Target protocol violations, see \ref SimTarget_Violation */
+		} SimStats_t;
+
+		/** Type define for a simulated programming target. The programmer side of the simulation calls into the target
+		 *  through these functions for each byte exchanged over its bus, and the harness uses the rest to set up the
+		 *  target and to check its memories.
+		 */
+		typedef struct
+		{
+			const char* Name; /**< Part name of the target */
+			uint8_t     Interface; /**< Programming interface of the target, a \ref SimInterfaces_t value */
+			uint8_t     Signature[3]; /**< Device signature bytes of the target */
+			uint32_t    FlashSize; /**< Size of the target's FLASH memory in bytes */
+			uint16_t    FlashPageSize; /**< Size of each of the target's FLASH pages in bytes */
+
+			void     (*Reset)(void); /**< Powers up the target, with all memories erased */
+			uint8_t* (*GetFlash)(void); /**< Retrieves the target's FLASH memory contents */
+			uint8_t  (*TransferSPIByte)(const uint8_t Byte); /**< Exchanges a byte over SPI, for ISP targets */
+			void     (*ReceiveUSARTByte)(const uint8_t Byte); /**< Accepts a byte from the programmer, for PDI and TPI */
+			bool     (*HasUSARTByte)(void); /**< Indicates if a reply byte is ready, for PDI and TPI targets */
+			uint8_t  (*SendUSARTByte)(void); /**< Removes the next reply byte, for PDI and TPI targets */
+			uint8_t  (*GetGuardTimeBits)(void); /**< Idle bits inserted before each reply, for PDI and TPI targets */
+		} SimTarget_t;
+
+	/* External Variables: */
+		extern SimStats_t        SimStats;
+		extern bool              SimVerbose;
+
+		extern const SimTarget_t SimTarget_ATmega328P;
+		extern const SimTarget_t SimTarget_ATmega2560;
+		extern const SimTarget_t SimTarget_ATxmega32A4U;
+		extern const SimTarget_t SimTarget_ATtiny10;
+
+	/* Function Prototypes: */
+		uint64_t SimClock_GetTimeNS(void);
+		void     SimClock_Advance(const uint64_t DelayNS,
+		                          const uint8_t Category);
+		void     SimClock_AdvanceTo(const uint64_t TimeNS,
+		                            const uint8_t Category);
+		void     SimClock_Delay(const uint64_t DelayNS);
+
+		void     SimInterrupt_SetGlobalEnable(const bool Enabled);
+		void     SimVector_Timer0Overflow(void);
+
+		void     SimCore_EraseEEPROM(void);
+		void     SimCore_AttachTarget(const SimTarget_t* const Target);
+		void     SimCore_SyncTimer(void);
+		bool     SimTarget_IsResetAsserted(void);
+		void     SimTarget_Violation(const char* const Format, ...) __attribute__((format(printf, 1, 2)));
+
+		void     SimEndpoint_Reset(void);
+		void     SimEndpoint_HostSend(const uint8_t* const Data,
+		                              const uint32_t Length);
+		uint32_t SimEndpoint_HostReceive(const uint8_t** const Data);
+		uint32_t SimEndpoint_HostDiscardUnread(void);
+		uint64_t SimEndpoint_GetINCompleteTime(void);
+		uint64_t SimEndpoint_GetPacketTimeNS(const uint16_t PayloadBytes);
+		void     SimEndpoint_Error(const char* const Format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
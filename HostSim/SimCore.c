@@ -0,0 +1,421 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Simulated clock, interrupts and target bus peripherals of the programmer for the host simulation. The registers
+ *  through which the firmware drives the target buses are backed by the functions here, which exchange each byte with
+ *  the attached simulated target and advance the simulated clock by the time the transfer takes on the real hardware.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <LUFA/Common/Common.h>
+#include <LUFA/Drivers/Peripheral/SPI.h>
+
+#include "Sim.h"
+#include "Config/AppConfig.h"
+
+/** Plain registers of the simulated programmer, which hold their values but have no side effects. */
+volatile uint8_t  PINB, DDRB, PORTB, PINC, DDRC, PORTC, DDRD, PORTD;
+volatile uint8_t  TCCR0A, TCCR0B, OCR0A, OCR0B, TIMSK0;
+volatile uint8_t  TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t  UCSR1B, UCSR1C, UCSR1D;
+volatile uint16_t UBRR1;
+volatile uint8_t  SPCR;
+volatile uint8_t  GPIOR0, GPIOR1, GPIOR2;
+volatile uint8_t  MCUSR, CLKPR, SREG;
+
+/** Counters of the simulation, sampled by the harness around each command. */
+SimStats_t SimStats;
+
+/** Indicates that each target protocol violation and endpoint error is to be printed as it occurs. */
+bool SimVerbose;
+
+/** Target attached to the programmer, or \c NULL if none. */
+static const SimTarget_t* AttachedTarget;
+
+/** Current simulated time in nanoseconds. */
+static uint64_t CurrentTimeNS;
+
+/** Nesting depth of the atomic blocks currently executing, during which no interrupts are run. */
+static uint8_t  AtomicDepth;
+
+/** Indicates that an interrupt handler is currently running, so that it is not re-entered. */
+static bool     InInterrupt;
+
+/** Number of Timer 0 overflows whose interrupt has been run. */
+static uint64_t TimerOverflowsServiced;
+
+/** Prescaler of the hardware SPI as a power of two, set by \ref SPI_Init. */
+static uint8_t  SPIClockShift = 1;
+
+/** Values returned by the register functions, which the firmware reads or writes through the returned pointer. */
+static uint8_t  SPIDataRegister;
+static uint8_t  SPIStatusRegister;
+static uint8_t  USARTDataRegister;
+static uint8_t  USARTStatusRegister;
+static uint8_t  PortDInputRegister;
+static uint8_t  TimerCountRegister;
+static uint8_t  TimerFlagRegister;
+
+/** Indicates that a byte written to the USART data register has yet to be passed to the target. */
+static bool     USARTTransmitPending;
+
+/** Indicates that the USART last transmitted to the target, so the next reception incurs the target's guard time. */
+static bool     USARTLastTransmitted;
+
+/** Current level of the simulated XCK line, which toggles each time it is sampled through PIND. */
+static bool     XCKLevel;
+
+
+/** Retrieves the number of nanoseconds per count of Timer 0, which runs from the system clock divided by 64. */
+static uint64_t SimCore_GetTimerCountNS(void)
+{
+	return SIM_CYCLES_TO_NS(64);
+}
+
+/** Retrieves the number of Timer 0 overflows since the start of the simulation. */
+static uint64_t SimCore_GetTimerOverflows(void)
+{
+	return ((CurrentTimeNS / SimCore_GetTimerCountNS()) >> 8);
+}
+
+/** Runs the interrupt handlers of any pending interrupts, if interrupts are currently enabled. */
+static void SimCore_ServiceInterrupts(void)
+{
+	if (AtomicDepth || InInterrupt || !(SREG & (1 << 7)))
+	  return;
+
+	/* The timer only runs once started, and its interrupt only fires while enabled */
+	if (!(TCCR0B & ((1 << CS02) | (1 << CS01) | (1 << CS00))) || !(TIMSK0 & (1 << TOIE0)))
+	  return;
+
+	InInterrupt = true;
+
+	while (TimerOverflowsServiced < SimCore_GetTimerOverflows())
+	{
+		TimerOverflowsServiced++;
+		SimVector_Timer0Overflow();
+	}
+
+	InInterrupt = false;
+}
+
+/** Passes any byte written to the USART data register on to the target. This happens on the first access to the
+ *  simulated peripherals after the write, as the firmware's polled USART driver writes the data register as the
+ *  last step of each transmission.
+ */
+static void SimCore_SettleUSART(void)
+{
+	if (!(USARTTransmitPending))
+	  return;
+
+	USARTTransmitPending = false;
+
+	if (AttachedTarget && (AttachedTarget->Interface != SIM_INTERFACE_ISP))
+	  AttachedTarget->ReceiveUSARTByte(USARTDataRegister);
+}
+
+/** Retrieves the number of nanoseconds per XCK clock period of the synchronous USART. */
+static uint64_t SimCore_GetUSARTBitNS(void)
+{
+	return SIM_CYCLES_TO_NS(2 * ((uint32_t)UBRR1 + 1));
+}
+
+/** Retrieves the current simulated time.
+ *
+ *  \return Simulated time in nanoseconds since the start of the simulation
+ */
+uint64_t SimClock_GetTimeNS(void)
+{
+	return CurrentTimeNS;
+}
+
+/** Advances the simulated clock, running any interrupts that become pending.
+ *
+ *  \param[in] DelayNS   Time to advance the clock by, in nanoseconds
+ *  \param[in] Category  Category the time is accounted to, a \ref SimTimeCategories_t value
+ */
+void SimClock_Advance(const uint64_t DelayNS,
+                      const uint8_t Category)
+{
+	CurrentTimeNS += DelayNS;
+	SimStats.TimeNS[Category] += DelayNS;
+
+	SimCore_ServiceInterrupts();
+}
+
+/** Advances the simulated clock to a given time, if it has not already passed.
+ *
+ *  \param[in] TimeNS    Time to advance the clock to, in nanoseconds
+ *  \param[in] Category  Category the time is accounted to, a \ref SimTimeCategories_t value
+ */
+void SimClock_AdvanceTo(const uint64_t TimeNS,
+                        const uint8_t Category)
+{
+	if (TimeNS > CurrentTimeNS)
+	  SimClock_Advance(TimeNS - CurrentTimeNS, Category);
+}
+
+/** Advances the simulated clock for a fixed delay of the firmware, backing the \c <util/delay.h> functions.
+ *
+ *  \param[in] DelayNS  Length of the delay in nanoseconds
+ */
+void SimClock_Delay(const uint64_t DelayNS)
+{
+	SimCore_SettleUSART();
+	SimClock_Advance(DelayNS, SIM_TIME_FIXED_DELAY);
+}
+
+/** Enables or disables interrupts globally, backing \c sei() and \c cli().
+ *
+ *  \param[in] Enabled  Boolean \c true to enable interrupts, \c false to disable them
+ */
+void SimInterrupt_SetGlobalEnable(const bool Enabled)
+{
+	if (Enabled)
+	  SREG |=  (1 << 7);
+	else
+	  SREG &= ~(1 << 7);
+
+	SimCore_ServiceInterrupts();
+}
+
+/** Starts an atomic block, backing \c ATOMIC_BLOCK(). */
+void SimInterrupt_EnterAtomic(void)
+{
+	AtomicDepth++;
+}
+
+/** Ends an atomic block, running any interrupts that became pending once the outermost block ends. */
+void SimInterrupt_ExitAtomic(void)
+{
+	AtomicDepth--;
+	SimCore_ServiceInterrupts();
+}
+
+/** Erases the EEPROM variables of the programmer to 0xFF, as on a newly programmed part. */
+void SimCore_EraseEEPROM(void)
+{
+	extern uint8_t __start_SimEEPROM[];
+	extern uint8_t __stop_SimEEPROM[];
+
+	memset(__start_SimEEPROM, 0xFF, (__stop_SimEEPROM - __start_SimEEPROM));
+}
+
+/** Attaches a target to the programmer, powering it up with all its memories erased.
+ *
+ *  \param[in] Target  Target to attach, or \c NULL to leave the programmer without a target
+ */
+void SimCore_AttachTarget(const SimTarget_t* const Target)
+{
+	AttachedTarget = Target;
+
+	if (Target)
+	  Target->Reset();
+}
+
+/** Marks all Timer 0 overflows up to the current time as serviced. This must be called once the firmware has started
+ *  the timer, so that the overflows of the time before that do not all fire at once.
+ */
+void SimCore_SyncTimer(void)
+{
+	TimerOverflowsServiced = SimCore_GetTimerOverflows();
+}
+
+/** Determines if the programmer is holding the target in reset, by driving its reset line low.
+ *
+ *  \return Boolean \c true if the target is held in reset, \c false otherwise
+ */
+bool SimTarget_IsResetAsserted(void)
+{
+	return ((AUX_LINE_DDR & AUX_LINE_MASK) && !(AUX_LINE_PORT & AUX_LINE_MASK));
+}
+
+/** Records a violation of the target's programming protocol by the programmer, such as an access to a memory while
+ *  the target is still busy writing it.
+ *
+ *  \param[in] Format  printf() style format of the violation's description, followed by its arguments
+ */
+void SimTarget_Violation(const char* const Format, ...)
+{
+	SimStats.TargetViolations++;
+
+	if (SimVerbose)
+	{
+		va_list Arguments;
+
+		va_start(Arguments, Format);
+		fprintf(stderr, "[%12.3f ms] target: ", (CurrentTimeNS / 1000000.0));
+		vfprintf(stderr, Format, Arguments);
+		fputc('\n', stderr);
+		va_end(Arguments);
+	}
+}
+
+/** Initializes the simulated hardware SPI, backing the LUFA driver function of the same name.
+ *
+ *  \param[in] SPIOptions  SPI setup options, a mask of \c SPI_* constants
+ */
+void SPI_Init(const uint8_t SPIOptions)
+{
+	SPIClockShift = (SPIOptions & SPI_SPEED_MASK);
+	SPCR          = ((1 << SPE) | (SPIOptions & (1 << MSTR)));
+}
+
+/** Turns off the simulated hardware SPI, backing the LUFA driver function of the same name. */
+void SPI_Disable(void)
+{
+	SPCR = 0;
+}
+
+/** Accesses the SPI status register. The firmware only reads it while waiting for a queued byte to finish shifting,
+ *  so each access completes the exchange of the byte in the SPI data register with the target.
+ */
+volatile uint8_t* SimRegister_SPSR(void)
+{
+	SimCore_SettleUSART();
+
+	uint8_t ReceivedByte = 0xFF;
+
+	if (AttachedTarget && (AttachedTarget->Interface == SIM_INTERFACE_ISP) && (SPCR & (1 << SPE)))
+	  ReceivedByte = AttachedTarget->TransferSPIByte(SPIDataRegister);
+
+	SPIDataRegister   = ReceivedByte;
+	SPIStatusRegister = (1 << SPIF);
+
+	SimStats.TargetBytesOut++;
+	SimStats.TargetBytesIn++;
+	SimClock_Advance(SIM_CYCLES_TO_NS(8UL << SPIClockShift), SIM_TIME_TARGET_BUS);
+
+	return &SPIStatusRegister;
+}
+
+/** Accesses the SPI data register, holding the byte to send or the byte received by the last exchange. */
+volatile uint8_t* SimRegister_SPDR(void)
+{
+	SimCore_SettleUSART();
+
+	return &SPIDataRegister;
+}
+
+/** Accesses the USART status register, whose flags reflect the target's pending reply bytes. */
+volatile uint8_t* SimRegister_UCSR1A(void)
+{
+	SimCore_SettleUSART();
+	SimClock_Advance(SIM_CYCLES_TO_NS(SIM_POLL_CYCLES), SIM_TIME_POLLING);
+
+	USARTStatusRegister = ((1 << UDRE1) | (1 << TXC1));
+
+	if ((UCSR1B & (1 << RXEN1)) && AttachedTarget && (AttachedTarget->Interface != SIM_INTERFACE_ISP) &&
+	    AttachedTarget->HasUSARTByte())
+	{
+		USARTStatusRegister |= (1 << RXC1);
+	}
+
+	return &USARTStatusRegister;
+}
+
+/** Accesses the USART data register. While the transmitter is enabled, a byte written to the register is sent to the
+ *  target; while the receiver is enabled, reading the register receives the target's next reply byte.
+ */
+volatile uint8_t* SimRegister_UDR1(void)
+{
+	SimCore_SettleUSART();
+
+	bool IsTarget = (AttachedTarget && (AttachedTarget->Interface != SIM_INTERFACE_ISP));
+
+	if (UCSR1B & (1 << RXEN1))
+	{
+		/* The target waits out its guard time before the first reply after the programmer's transmission */
+		if (USARTLastTransmitted)
+		{
+			USARTLastTransmitted = false;
+
+			if (IsTarget)
+			  SimClock_Advance(AttachedTarget->GetGuardTimeBits() * SimCore_GetUSARTBitNS(), SIM_TIME_TARGET_BUS);
+		}
+
+		if (IsTarget && AttachedTarget->HasUSARTByte())
+		{
+			USARTDataRegister = AttachedTarget->SendUSARTByte();
+
+			SimStats.TargetBytesIn++;
+			SimClock_Advance(SIM_USART_FRAME_BITS * SimCore_GetUSARTBitNS(), SIM_TIME_TARGET_BUS);
+		}
+	}
+	else if (UCSR1B & (1 << TXEN1))
+	{
+		/* The byte is only written once the pointer is returned, so is passed to the target afterwards */
+		USARTTransmitPending = true;
+		USARTLastTransmitted = true;
+
+		SimStats.TargetBytesOut++;
+		SimClock_Advance(SIM_USART_FRAME_BITS * SimCore_GetUSARTBitNS(), SIM_TIME_TARGET_BUS);
+	}
+
+	return &USARTDataRegister;
+}
+
+/** Accesses the port D input register, through which the firmware follows the USART's XCK clock line. Each access
+ *  samples the line half a clock period after the last, so that the firmware's clock edge waits see it toggle.
+ */
+volatile uint8_t* SimRegister_PIND(void)
+{
+	SimCore_SettleUSART();
+	SimClock_Advance(SimCore_GetUSARTBitNS() / 2, SIM_TIME_TARGET_BUS);
+
+	XCKLevel           = !(XCKLevel);
+	PortDInputRegister = (XCKLevel ? (1 << 5) : 0);
+
+	return &PortDInputRegister;
+}
+
+/** Accesses the Timer 0 count register, which counts the simulated time in units of 64 system clock cycles. */
+volatile uint8_t* SimRegister_TCNT0(void)
+{
+	SimCore_SettleUSART();
+	SimClock_Advance(SIM_CYCLES_TO_NS(SIM_POLL_CYCLES), SIM_TIME_POLLING);
+
+	TimerCountRegister = ((CurrentTimeNS / SimCore_GetTimerCountNS()) & 0xFF);
+
+	return &TimerCountRegister;
+}
+
+/** Accesses the Timer 0 interrupt flag register, whose overflow flag is set while an overflow interrupt is pending. */
+volatile uint8_t* SimRegister_TIFR0(void)
+{
+	TimerFlagRegister = ((TimerOverflowsServiced < SimCore_GetTimerOverflows()) ? (1 << TOV0) : 0);
+
+	return &TimerFlagRegister;
+}
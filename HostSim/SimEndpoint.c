@@ -0,0 +1,505 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Simulated USB endpoints of the programmer for the host simulation. Each command from the host is split into full
+ *  size OUT packets, ending with a short packet or a Zero Length Packet (ZLP) as the host's USB stack would send it,
+ *  and the packets the firmware sends back are collected into the response. Both directions have a single bank, as
+ *  the AVRISP data endpoints of the firmware do, so each packet takes the time to transfer it over the bus before the
+ *  next can follow; the host is assumed to always have the next packet ready to go.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+
+#include "Sim.h"
+
+/** Number of bytes of USB bus overhead per transferred packet: the token, data and handshake packets' PIDs, CRCs,
+ *  addresses, SYNC fields and EOPs, and the inter-packet gaps between them.
+ */
+#define SIM_USB_PACKET_OVERHEAD      13
+
+/** Number of nanoseconds per byte on the USB bus, at the 12Mbit/s of a full-speed device. */
+#define SIM_USB_BYTE_NS              (8 * 1000 / 12)
+
+/** Current state of the USB device, always configured in the simulation. */
+volatile uint8_t USB_DeviceState = DEVICE_STATE_Configured;
+
+/** Address of the currently selected endpoint. */
+static uint8_t  SelectedEndpoint;
+
+/** Command sent by the host, and the number of bytes of it. */
+static uint8_t  OUTData[SIM_MAX_TRANSFER_SIZE];
+static uint32_t OUTLength;
+
+/** Total number of OUT packets of the command, and the index of the packet currently in or next due in the bank. */
+static uint32_t OUTPackets;
+static uint32_t OUTPacketIndex;
+
+/** Time at which the next OUT packet will have arrived in the bank, once it is free. */
+static uint64_t OUTArrivalNS;
+
+/** Indicates that an OUT packet is in the bank, and the position of the next byte to read from it. */
+static bool     OUTBankLoaded;
+static uint32_t OUTBankPosition;
+
+/** Response collected for the host from the sent IN packets, and the number of bytes of it. */
+static uint8_t  INData[SIM_MAX_TRANSFER_SIZE];
+static uint32_t INLength;
+
+/** Indicates that at least one IN packet has been sent, and the size of the last one sent. */
+static bool     INPacketSent;
+static uint16_t INLastPacketSize;
+
+/** Contents of the IN bank, and the number of bytes written to it. */
+static uint8_t  INBank[SIM_ENDPOINT_SIZE];
+static uint16_t INBankLength;
+
+/** Time at which the host will have read the last sent IN packet, freeing the bank. */
+static uint64_t INCompleteNS;
+
+
+/** Determines if the selected endpoint is an IN endpoint. */
+static bool SimEndpoint_IsIN(void)
+{
+	return ((SelectedEndpoint & ENDPOINT_DIR_MASK) == ENDPOINT_DIR_IN);
+}
+
+/** Retrieves the size of the given OUT packet of the current command. */
+static uint16_t SimEndpoint_GetOUTPacketSize(const uint32_t PacketIndex)
+{
+	return MIN(OUTLength - (PacketIndex * SIM_ENDPOINT_SIZE), SIM_ENDPOINT_SIZE);
+}
+
+/** Retrieves the number of bytes left unread in the OUT packet currently in the bank. */
+static uint16_t SimEndpoint_GetOUTBytesLeft(void)
+{
+	if (!(OUTBankLoaded))
+	  return 0;
+
+	return (SimEndpoint_GetOUTPacketSize(OUTPacketIndex) - OUTBankPosition);
+}
+
+/** Loads the next OUT packet into the bank if it is free and the packet has arrived. */
+static void SimEndpoint_UpdateOUTBank(void)
+{
+	if (OUTBankLoaded || (OUTPacketIndex >= OUTPackets) || (SimClock_GetTimeNS() < OUTArrivalNS))
+	  return;
+
+	OUTBankLoaded   = true;
+	OUTBankPosition = 0;
+
+	SimStats.USBPacketsOut++;
+	SimStats.USBBytesOut += SimEndpoint_GetOUTPacketSize(OUTPacketIndex);
+}
+
+/** Resets the simulated endpoints, discarding any command and response. */
+void SimEndpoint_Reset(void)
+{
+	OUTLength      = 0;
+	OUTPackets     = 0;
+	OUTPacketIndex = 0;
+	OUTBankLoaded  = false;
+	INLength       = 0;
+	INPacketSent   = false;
+	INBankLength   = 0;
+}
+
+/** Sends a command from the host to the programmer. The first packet arrives in the OUT bank once it has been
+ *  transferred over the bus, and each following one the same time after the firmware frees the bank.
+ *
+ *  \param[in] Data    Command to send
+ *  \param[in] Length  Length of the command in bytes, at most \ref SIM_MAX_TRANSFER_SIZE
+ */
+void SimEndpoint_HostSend(const uint8_t* const Data,
+                          const uint32_t Length)
+{
+	memcpy(OUTData, Data, Length);
+
+	OUTLength      = Length;
+	OUTPackets     = ((Length / SIM_ENDPOINT_SIZE) + 1);
+	OUTPacketIndex = 0;
+	OUTBankLoaded  = false;
+	OUTArrivalNS   = (SimClock_GetTimeNS() + SimEndpoint_GetPacketTimeNS(SimEndpoint_GetOUTPacketSize(0)));
+}
+
+/** Retrieves the response sent by the programmer since the last call, checking that it was terminated by a short
+ *  packet as the host's USB stack requires to complete the transfer.
+ *
+ *  \param[out] Data  Location where a pointer to the response is to be stored
+ *
+ *  \return Length of the response in bytes
+ */
+uint32_t SimEndpoint_HostReceive(const uint8_t** const Data)
+{
+	uint32_t Length = INLength;
+
+	if (INBankLength)
+	  SimEndpoint_Error("%u response bytes were left unsent in the IN bank", INBankLength);
+	else if (!(INPacketSent) || (INLastPacketSize == SIM_ENDPOINT_SIZE))
+	  SimEndpoint_Error("response was not terminated by a short packet");
+
+	*Data = INData;
+
+	INLength     = 0;
+	INPacketSent = false;
+	INBankLength = 0;
+
+	return Length;
+}
+
+/** Discards the remainder of the current command, which the firmware should have read completely.
+ *
+ *  \return Number of OUT packets of the command the firmware did not release
+ */
+uint32_t SimEndpoint_HostDiscardUnread(void)
+{
+	uint32_t UnreadPackets = (OUTPackets - OUTPacketIndex);
+
+	OUTPacketIndex = OUTPackets;
+	OUTBankLoaded  = false;
+
+	return UnreadPackets;
+}
+
+/** Retrieves the time at which the host will have read the last IN packet sent by the programmer. */
+uint64_t SimEndpoint_GetINCompleteTime(void)
+{
+	return INCompleteNS;
+}
+
+/** Retrieves the time taken to transfer a packet over the USB bus, including the bus overhead of the transaction.
+ *
+ *  \param[in] PayloadBytes  Number of data bytes in the packet
+ *
+ *  \return Transfer time in nanoseconds
+ */
+uint64_t SimEndpoint_GetPacketTimeNS(const uint16_t PayloadBytes)
+{
+	return ((uint64_t)(PayloadBytes + SIM_USB_PACKET_OVERHEAD) * SIM_USB_BYTE_NS);
+}
+
+/** Records a misuse of the USB endpoints by the firmware, such as reading past the end of a packet.
+ *
+ *  \param[in] Format  printf() style format of the error's description, followed by its arguments
+ */
+void SimEndpoint_Error(const char* const Format, ...)
+{
+	SimStats.EndpointErrors++;
+
+	if (SimVerbose)
+	{
+		va_list Arguments;
+
+		va_start(Arguments, Format);
+		fprintf(stderr, "[%12.3f ms] endpoint: ", (SimClock_GetTimeNS() / 1000000.0));
+		vfprintf(stderr, Format, Arguments);
+		fputc('\n', stderr);
+		va_end(Arguments);
+	}
+}
+
+void Endpoint_SelectEndpoint(const uint8_t Address)
+{
+	SelectedEndpoint = Address;
+}
+
+void Endpoint_SetEndpointDirection(const uint8_t DirectionMask)
+{
+	/* The direction of each simulated endpoint is fixed by its address */
+}
+
+bool Endpoint_IsOUTReceived(void)
+{
+	if (SimEndpoint_IsIN())
+	  return false;
+
+	SimEndpoint_UpdateOUTBank();
+
+	return OUTBankLoaded;
+}
+
+bool Endpoint_IsINReady(void)
+{
+	if (!(SimEndpoint_IsIN()))
+	  return false;
+
+	return (SimClock_GetTimeNS() >= INCompleteNS);
+}
+
+bool Endpoint_IsReadWriteAllowed(void)
+{
+	if (SimEndpoint_IsIN())
+	  return (INBankLength < SIM_ENDPOINT_SIZE);
+
+	SimEndpoint_UpdateOUTBank();
+
+	return (SimEndpoint_GetOUTBytesLeft() != 0);
+}
+
+uint16_t Endpoint_BytesInEndpoint(void)
+{
+	if (SimEndpoint_IsIN())
+	  return INBankLength;
+
+	return SimEndpoint_GetOUTBytesLeft();
+}
+
+uint8_t Endpoint_GetBusyBanks(void)
+{
+	if (SimEndpoint_IsIN())
+	{
+		if (Endpoint_IsINReady())
+		  return 0;
+
+		/* The firmware polls this while waiting for the host to collect the response */
+		SimClock_Advance(SIM_CYCLES_TO_NS(SIM_POLL_CYCLES), SIM_TIME_USB);
+		return 1;
+	}
+
+	return (Endpoint_IsOUTReceived() ? 1 : 0);
+}
+
+void Endpoint_ClearOUT(void)
+{
+	if (SimEndpoint_IsIN() || !(OUTBankLoaded))
+	  return;
+
+	OUTBankLoaded = false;
+	OUTPacketIndex++;
+
+	/* The host starts sending the next packet as soon as the bank is freed */
+	if (OUTPacketIndex < OUTPackets)
+	  OUTArrivalNS = (SimClock_GetTimeNS() + SimEndpoint_GetPacketTimeNS(SimEndpoint_GetOUTPacketSize(OUTPacketIndex)));
+}
+
+void Endpoint_ClearIN(void)
+{
+	if (!(SimEndpoint_IsIN()))
+	  return;
+
+	if (!(Endpoint_IsINReady()))
+	  SimEndpoint_Error("IN packet sent while the previous one was still in the bank");
+
+	if ((INLength + INBankLength) <= sizeof(INData))
+	{
+		memcpy(&INData[INLength], INBank, INBankLength);
+		INLength += INBankLength;
+	}
+
+	INPacketSent     = true;
+	INLastPacketSize = INBankLength;
+	INCompleteNS     = (SimClock_GetTimeNS() + SimEndpoint_GetPacketTimeNS(INBankLength));
+
+	SimStats.USBPacketsIn++;
+	SimStats.USBBytesIn += INBankLength;
+
+	INBankLength = 0;
+}
+
+uint8_t Endpoint_WaitUntilReady(void)
+{
+	if (SimEndpoint_IsIN())
+	{
+		SimClock_AdvanceTo(INCompleteNS, SIM_TIME_USB);
+		return ENDPOINT_READYWAIT_NoError;
+	}
+
+	if (!(OUTBankLoaded) && (OUTPacketIndex < OUTPackets))
+	{
+		SimClock_AdvanceTo(OUTArrivalNS, SIM_TIME_USB);
+		SimEndpoint_UpdateOUTBank();
+	}
+
+	if (OUTBankLoaded)
+	  return ENDPOINT_READYWAIT_NoError;
+
+	/* The host has no more data to send, so the firmware waits out the full stream timeout */
+	SimEndpoint_Error("waited for an OUT packet beyond the end of the command");
+	SimClock_Advance(USB_STREAM_TIMEOUT_MS * 1000000ULL, SIM_TIME_USB);
+
+	return ENDPOINT_READYWAIT_Timeout;
+}
+
+uint8_t Endpoint_Read_8(void)
+{
+	if (SimEndpoint_IsIN() || !(SimEndpoint_GetOUTBytesLeft()))
+	{
+		SimEndpoint_Error("read past the end of the OUT packet in the bank");
+		return 0;
+	}
+
+	return OUTData[(OUTPacketIndex * SIM_ENDPOINT_SIZE) + OUTBankPosition++];
+}
+
+uint16_t Endpoint_Read_16_LE(void)
+{
+	uint16_t Data = Endpoint_Read_8();
+
+	return (Data | ((uint16_t)Endpoint_Read_8() << 8));
+}
+
+uint16_t Endpoint_Read_16_BE(void)
+{
+	uint16_t Data = ((uint16_t)Endpoint_Read_8() << 8);
+
+	return (Data | Endpoint_Read_8());
+}
+
+uint32_t Endpoint_Read_32_LE(void)
+{
+	uint32_t Data = Endpoint_Read_16_LE();
+
+	return (Data | ((uint32_t)Endpoint_Read_16_LE() << 16));
+}
+
+uint32_t Endpoint_Read_32_BE(void)
+{
+	uint32_t Data = ((uint32_t)Endpoint_Read_16_BE() << 16);
+
+	return (Data | Endpoint_Read_16_BE());
+}
+
+void Endpoint_Discard_8(void)
+{
+	(void)Endpoint_Read_8();
+}
+
+void Endpoint_Discard_16(void)
+{
+	(void)Endpoint_Read_16_LE();
+}
+
+void Endpoint_Write_8(const uint8_t Data)
+{
+	if (!(SimEndpoint_IsIN()))
+	{
+		SimEndpoint_Error("write to an OUT endpoint");
+		return;
+	}
+
+	if (!(Endpoint_IsINReady()))
+	  SimEndpoint_Error("write to the IN bank while its last packet was still being sent");
+
+	if (INBankLength >= SIM_ENDPOINT_SIZE)
+	{
+		SimEndpoint_Error("write past the end of the IN bank");
+		return;
+	}
+
+	INBank[INBankLength++] = Data;
+}
+
+void Endpoint_Write_16_LE(const uint16_t Data)
+{
+	Endpoint_Write_8(Data & 0xFF);
+	Endpoint_Write_8(Data >> 8);
+}
+
+void Endpoint_Write_16_BE(const uint16_t Data)
+{
+	Endpoint_Write_8(Data >> 8);
+	Endpoint_Write_8(Data & 0xFF);
+}
+
+/** Reads a stream of bytes from the OUT endpoint, releasing each packet as it is used up and waiting for the next as
+ *  the LUFA stream functions do.
+ *
+ *  \param[out] Buffer     Buffer to store the bytes in, or \c NULL to discard them
+ *  \param[in]  Length     Number of bytes to read
+ *  \param[in]  Reversed   Boolean \c true to store the bytes in reverse order, for big endian streams
+ *
+ *  \return A value from the \ref Endpoint_Stream_RW_ErrorCodes_t enum
+ */
+static uint8_t SimEndpoint_ReadStream(uint8_t* const Buffer,
+                                      const uint16_t Length,
+                                      const bool Reversed)
+{
+	for (uint16_t BytesRead = 0; BytesRead < Length; BytesRead++)
+	{
+		if (!(Endpoint_IsReadWriteAllowed()))
+		{
+			Endpoint_ClearOUT();
+
+			if (Endpoint_WaitUntilReady() != ENDPOINT_READYWAIT_NoError)
+			  return ENDPOINT_RWSTREAM_Timeout;
+		}
+
+		uint8_t Data = Endpoint_Read_8();
+
+		if (Buffer)
+		  Buffer[Reversed ? (Length - BytesRead - 1) : BytesRead] = Data;
+	}
+
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t Endpoint_Read_Stream_LE(void* const Buffer,
+                                uint16_t Length,
+                                uint16_t* const BytesProcessed)
+{
+	return SimEndpoint_ReadStream(Buffer, Length, false);
+}
+
+uint8_t Endpoint_Read_Stream_BE(void* const Buffer,
+                                uint16_t Length,
+                                uint16_t* const BytesProcessed)
+{
+	return SimEndpoint_ReadStream(Buffer, Length, true);
+}
+
+uint8_t Endpoint_Discard_Stream(uint16_t Length,
+                                uint16_t* const BytesProcessed)
+{
+	return SimEndpoint_ReadStream(NULL, Length, false);
+}
+
+uint8_t Endpoint_Write_Stream_LE(const void* const Buffer,
+                                 uint16_t Length,
+                                 uint16_t* const BytesProcessed)
+{
+	const uint8_t* DataStream = Buffer;
+
+	while (Length--)
+	{
+		if (!(Endpoint_IsReadWriteAllowed()))
+		{
+			Endpoint_ClearIN();
+			Endpoint_WaitUntilReady();
+		}
+
+		Endpoint_Write_8(*(DataStream++));
+	}
+
+	return ENDPOINT_RWSTREAM_NoError;
+}
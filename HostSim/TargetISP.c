@@ -0,0 +1,395 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Simulated ISP programming targets for the host simulation, modelling the serial programming instruction set of
+ *  the classic megaAVR devices. Each write operation keeps the target busy for the worst case wait time the device's
+ *  datasheet gives for it; while busy the target answers RDY/BSY polls and returns 0xFF for memory reads as the real
+ *  devices do, and any other instruction is recorded as a violation.
+ */
+
+#include <string.h>
+
+#include "Sim.h"
+
+/** Largest FLASH and EEPROM memories of the simulated ISP targets, in bytes. */
+#define ISP_MAX_FLASH_SIZE           (256 * 1024UL)
+#define ISP_MAX_EEPROM_SIZE          (4 * 1024U)
+
+/** Type define for the parameters of a simulated ISP target that are not part of its \ref SimTarget_t. */
+typedef struct
+{
+	uint16_t EEPROMSize; /**< Size of the target's EEPROM in bytes */
+	uint8_t  EEPROMPageSize; /**< Size of each of the target's EEPROM pages in bytes */
+	uint8_t  DefaultFuses[3]; /**< Factory values of the target's low, high and extended fuse bytes */
+	uint32_t FuseWriteNS; /**< Datasheet tWD_FUSE wait time after a fuse or lock bit write */
+	uint32_t FlashWriteNS; /**< Datasheet tWD_FLASH wait time after a FLASH page write */
+	uint32_t EEPROMWriteNS; /**< Datasheet tWD_EEPROM wait time after an EEPROM byte or page write */
+	uint32_t ChipEraseNS; /**< Datasheet tWD_ERASE wait time after a chip erase */
+} ISPTargetParams_t;
+
+static const ISPTargetParams_t ATmega328PParams =
+	{
+		.EEPROMSize     = 1024,
+		.EEPROMPageSize = 4,
+		.DefaultFuses   = {0x62, 0xD9, 0xFF},
+		.FuseWriteNS    = 4500000,
+		.FlashWriteNS   = 2600000,
+		.EEPROMWriteNS  = 3600000,
+		.ChipEraseNS    = 10500000,
+	};
+
+static const ISPTargetParams_t ATmega2560Params =
+	{
+		.EEPROMSize     = 4096,
+		.EEPROMPageSize = 8,
+		.DefaultFuses   = {0x62, 0x99, 0xFF},
+		.FuseWriteNS    = 4500000,
+		.FlashWriteNS   = 4500000,
+		.EEPROMWriteNS  = 9000000,
+		.ChipEraseNS    = 9000000,
+	};
+
+/** Descriptor and parameters of the currently attached ISP target. */
+static const SimTarget_t*       Target;
+static const ISPTargetParams_t* Params;
+
+/** Memories of the target. */
+static uint8_t  Flash[ISP_MAX_FLASH_SIZE];
+static uint8_t  EEPROM[ISP_MAX_EEPROM_SIZE];
+static uint8_t  Fuses[3];
+static uint8_t  LockBits;
+
+/** Page buffers of the target, and the mask of the EEPROM page buffer bytes loaded since the last page write. */
+static uint8_t  FlashPageBuffer[256];
+static uint8_t  EEPROMPageBuffer[8];
+static uint8_t  EEPROMPageLoaded;
+
+/** Extended FLASH address byte, set by the LOAD EXTENDED ADDRESS instruction. */
+static uint8_t  ExtendedAddress;
+
+/** Indicates that the target has accepted the PROGRAMMING ENABLE instruction since it was last put into reset. */
+static bool     ProgrammingEnabled;
+
+/** Indicates that the target was held in reset during the last byte exchange. */
+static bool     WasInReset;
+
+/** Bytes of the instruction currently being received, and the number received so far. */
+static uint8_t  Instruction[4];
+static uint8_t  InstructionBytes;
+
+/** Time at which the target completes its current write operation. */
+static uint64_t BusyUntilNS;
+
+
+/** Powers up the attached target with erased memories and factory fuse settings. */
+static void ISPTarget_Reset(void)
+{
+	memset(Flash, 0xFF, sizeof(Flash));
+	memset(EEPROM, 0xFF, sizeof(EEPROM));
+	memset(FlashPageBuffer, 0xFF, sizeof(FlashPageBuffer));
+	memcpy(Fuses, Params->DefaultFuses, sizeof(Fuses));
+
+	LockBits           = 0xFF;
+	EEPROMPageLoaded   = 0;
+	ExtendedAddress    = 0;
+	ProgrammingEnabled = false;
+	WasInReset         = false;
+	InstructionBytes   = 0;
+	BusyUntilNS        = 0;
+}
+
+static void ISPTarget_ResetATmega328P(void)
+{
+	Target = &SimTarget_ATmega328P;
+	Params = &ATmega328PParams;
+
+	ISPTarget_Reset();
+}
+
+static void ISPTarget_ResetATmega2560(void)
+{
+	Target = &SimTarget_ATmega2560;
+	Params = &ATmega2560Params;
+
+	ISPTarget_Reset();
+}
+
+static uint8_t* ISPTarget_GetFlash(void)
+{
+	return Flash;
+}
+
+/** Starts a write operation, keeping the target busy for the given time. */
+static void ISPTarget_StartWrite(const uint32_t WriteNS)
+{
+	BusyUntilNS = (SimClock_GetTimeNS() + WriteNS);
+}
+
+/** Retrieves the byte address in FLASH of the given word address, extended by the last loaded extended address. */
+static uint32_t ISPTarget_GetFlashAddress(const uint16_t WordAddress,
+                                          const bool HighByte)
+{
+	uint32_t ByteAddress = ((((uint32_t)ExtendedAddress << 16) | WordAddress) << 1) | (HighByte ? 1 : 0);
+
+	return (ByteAddress % Target->FlashSize);
+}
+
+/** Determines the byte the target shifts out during the last byte of the current instruction, from its first three
+ *  bytes.
+ */
+static uint8_t ISPTarget_GetInstructionOutput(void)
+{
+	uint16_t Address = (((uint16_t)Instruction[1] << 8) | Instruction[2]);
+
+	if (Instruction[0] == 0xF0)
+	  return ((SimClock_GetTimeNS() < BusyUntilNS) ? 0x01 : 0x00);
+
+	/* Memory reads return 0xFF while the target is busy, which is what polling for the written value relies on */
+	if (SimClock_GetTimeNS() < BusyUntilNS)
+	  return 0xFF;
+
+	switch (Instruction[0])
+	{
+		case 0x20:
+		case 0x28:
+			return Flash[ISPTarget_GetFlashAddress(Address, (Instruction[0] & 0x08))];
+		case 0xA0:
+			return EEPROM[Address % Params->EEPROMSize];
+		case 0x30:
+			return ((Instruction[2] & 0x03) < 3) ? Target->Signature[Instruction[2] & 0x03] : 0xFF;
+		case 0x38:
+			return 0x9A;
+		case 0x50:
+			return (Instruction[1] & 0x08) ? Fuses[2] : Fuses[0];
+		case 0x58:
+			return (Instruction[1] & 0x08) ? Fuses[1] : LockBits;
+		default:
+			return 0x00;
+	}
+}
+
+/** Executes the current instruction once all four of its bytes have been received. */
+static void ISPTarget_ExecuteInstruction(void)
+{
+	uint16_t Address = (((uint16_t)Instruction[1] << 8) | Instruction[2]);
+	bool     IsBusy  = (SimClock_GetTimeNS() < BusyUntilNS);
+
+	if ((Instruction[0] == 0xAC) && (Instruction[1] == 0x53))
+	  return;
+
+	if (!(ProgrammingEnabled))
+	{
+		SimTarget_Violation("instruction %02X %02X %02X %02X issued before programming was enabled",
+		                    Instruction[0], Instruction[1], Instruction[2], Instruction[3]);
+		return;
+	}
+
+	switch (Instruction[0])
+	{
+		case 0xF0:
+		case 0x20:
+		case 0x28:
+		case 0xA0:
+			return;
+	}
+
+	if (IsBusy)
+	{
+		SimTarget_Violation("instruction %02X %02X %02X %02X issued while the target was busy",
+		                    Instruction[0], Instruction[1], Instruction[2], Instruction[3]);
+		return;
+	}
+
+	uint16_t PageWords = (Target->FlashPageSize >> 1);
+
+	switch (Instruction[0])
+	{
+		case 0x30:
+		case 0x38:
+		case 0x50:
+		case 0x58:
+			break;
+		case 0x40:
+		case 0x48:
+			FlashPageBuffer[((Address % PageWords) << 1) | ((Instruction[0] & 0x08) ? 1 : 0)] = Instruction[3];
+			break;
+		case 0x4D:
+			ExtendedAddress = Instruction[2];
+			break;
+		case 0x4C:
+		{
+			uint32_t PageAddress = (ISPTarget_GetFlashAddress(Address, false) & ~(uint32_t)(Target->FlashPageSize - 1));
+
+			/* Programming can only clear FLASH bits, setting them again takes an erase */
+			for (uint16_t i = 0; i < Target->FlashPageSize; i++)
+			  Flash[PageAddress + i] &= FlashPageBuffer[i];
+
+			memset(FlashPageBuffer, 0xFF, sizeof(FlashPageBuffer));
+			ISPTarget_StartWrite(Params->FlashWriteNS);
+			break;
+		}
+		case 0xC0:
+			EEPROM[Address % Params->EEPROMSize] = Instruction[3];
+			ISPTarget_StartWrite(Params->EEPROMWriteNS);
+			break;
+		case 0xC1:
+			EEPROMPageBuffer[Address % Params->EEPROMPageSize] = Instruction[3];
+			EEPROMPageLoaded |= (1 << (Address % Params->EEPROMPageSize));
+			break;
+		case 0xC2:
+		{
+			uint16_t PageAddress = ((Address % Params->EEPROMSize) & ~(Params->EEPROMPageSize - 1));
+
+			/* Only the loaded bytes of an EEPROM page are erased and rewritten */
+			for (uint8_t i = 0; i < Params->EEPROMPageSize; i++)
+			{
+				if (EEPROMPageLoaded & (1 << i))
+				  EEPROM[PageAddress + i] = EEPROMPageBuffer[i];
+			}
+
+			EEPROMPageLoaded = 0;
+			ISPTarget_StartWrite(Params->EEPROMWriteNS);
+			break;
+		}
+		case 0xAC:
+			switch (Instruction[1])
+			{
+				case 0x80:
+					memset(Flash, 0xFF, Target->FlashSize);
+					memset(EEPROM, 0xFF, Params->EEPROMSize);
+					LockBits = 0xFF;
+					ISPTarget_StartWrite(Params->ChipEraseNS);
+					break;
+				case 0xA0:
+					Fuses[0] = Instruction[3];
+					ISPTarget_StartWrite(Params->FuseWriteNS);
+					break;
+				case 0xA8:
+					Fuses[1] = Instruction[3];
+					ISPTarget_StartWrite(Params->FuseWriteNS);
+					break;
+				case 0xA4:
+					Fuses[2] = Instruction[3];
+					ISPTarget_StartWrite(Params->FuseWriteNS);
+					break;
+				case 0xE0:
+					LockBits &= Instruction[3];
+					ISPTarget_StartWrite(Params->FuseWriteNS);
+					break;
+				default:
+					SimTarget_Violation("unknown instruction AC %02X %02X %02X", Instruction[1], Instruction[2],
+					                    Instruction[3]);
+					break;
+			}
+
+			break;
+		default:
+			SimTarget_Violation("unknown instruction %02X %02X %02X %02X",
+			                    Instruction[0], Instruction[1], Instruction[2], Instruction[3]);
+			break;
+	}
+}
+
+/** Exchanges a byte with the target over SPI. The target echoes the first two bytes of each instruction back during
+ *  its second and third bytes, and shifts out the result of the instruction during its fourth byte.
+ *
+ *  \param[in] Byte  Byte shifted into the target from the programmer
+ *
+ *  \return Byte shifted out of the target to the programmer at the same time
+ */
+static uint8_t ISPTarget_TransferSPIByte(const uint8_t Byte)
+{
+	bool InReset = SimTarget_IsResetAsserted();
+
+	/* Putting the target into reset restarts its serial programming interface */
+	if (InReset != WasInReset)
+	{
+		WasInReset         = InReset;
+		ProgrammingEnabled = false;
+		InstructionBytes   = 0;
+	}
+
+	if (!(InReset))
+	{
+		SimTarget_Violation("SPI byte %02X sent while the target was not held in reset", Byte);
+		return 0xFF;
+	}
+
+	uint8_t ReplyByte = 0x00;
+
+	if (InstructionBytes == 3)
+	  ReplyByte = ISPTarget_GetInstructionOutput();
+	else if (InstructionBytes)
+	  ReplyByte = Instruction[InstructionBytes - 1];
+
+	Instruction[InstructionBytes++] = Byte;
+
+	/* Until programming is enabled the target only looks for the PROGRAMMING ENABLE instruction, and the programmer
+	 * must realign to it by pulsing reset if it is not echoed back */
+	if ((InstructionBytes == 3) && !(ProgrammingEnabled))
+	{
+		if ((Instruction[0] == 0xAC) && (Instruction[1] == 0x53))
+		  ProgrammingEnabled = true;
+	}
+
+	if (InstructionBytes == 4)
+	{
+		ISPTarget_ExecuteInstruction();
+		InstructionBytes = 0;
+	}
+
+	return ReplyByte;
+}
+
+const SimTarget_t SimTarget_ATmega328P =
+	{
+		.Name             = "ATmega328P",
+		.Interface        = SIM_INTERFACE_ISP,
+		.Signature        = {0x1E, 0x95, 0x0F},
+		.FlashSize        = (32 * 1024UL),
+		.FlashPageSize    = 128,
+		.Reset            = ISPTarget_ResetATmega328P,
+		.GetFlash         = ISPTarget_GetFlash,
+		.TransferSPIByte  = ISPTarget_TransferSPIByte,
+	};
+
+const SimTarget_t SimTarget_ATmega2560 =
+	{
+		.Name             = "ATmega2560",
+		.Interface        = SIM_INTERFACE_ISP,
+		.Signature        = {0x1E, 0x98, 0x01},
+		.FlashSize        = (256 * 1024UL),
+		.FlashPageSize    = 256,
+		.Reset            = ISPTarget_ResetATmega2560,
+		.GetFlash         = ISPTarget_GetFlash,
+		.TransferSPIByte  = ISPTarget_TransferSPIByte,
+	};
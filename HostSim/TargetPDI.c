@@ -0,0 +1,748 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Simulated PDI programming target for the host simulation, modelling the PDI instruction set and the NVM controller
+ *  of an XMEGA device. The NVM operation times are assumed round figures rather than datasheet values, as the XMEGA
+ *  datasheets do not specify them for PDI programming; they only need to be realistic enough for the programmer to
+ *  have to wait on the target as it would on a real one.
+ */
+
+#include <string.h>
+
+#include "Sim.h"
+
+/** Addresses of the target's memories in the PDI address space. */
+#define PDI_FLASH_BASE               0x0800000UL
+#define PDI_EEPROM_BASE              0x08C0000UL
+#define PDI_USERSIG_BASE             0x08E0400UL
+#define PDI_FUSE_BASE                0x08F0020UL
+#define PDI_LOCKBITS_ADDRESS         0x08F0027UL
+#define PDI_DATA_SPACE_BASE          0x1000000UL
+#define PDI_DEVID_ADDRESS            (PDI_DATA_SPACE_BASE + 0x0090)
+#define PDI_NVM_BASE                 (PDI_DATA_SPACE_BASE + 0x01C0)
+
+/** Sizes of the target's memories, for an ATxmega32A4U with 32KB of application and 4KB of boot FLASH. */
+#define PDI_FLASH_SIZE               (36 * 1024UL)
+#define PDI_APP_SECTION_SIZE         (32 * 1024UL)
+#define PDI_FLASH_PAGE_SIZE          256
+#define PDI_EEPROM_SIZE              1024
+#define PDI_EEPROM_PAGE_SIZE         32
+#define PDI_USERSIG_SIZE             256
+
+/** Assumed busy times of the target's NVM controller operations, in nanoseconds. */
+#define PDI_PAGE_WRITE_NS            2500000ULL
+#define PDI_PAGE_ERASE_NS            2500000ULL
+#define PDI_EEPROM_WRITE_NS          4000000ULL
+#define PDI_CHIP_ERASE_NS            40000000ULL
+#define PDI_CRC_NS_PER_BYTE          500ULL
+
+/** PDI instruction opcodes and the PDI control and status registers used by the programmer. */
+#define PDI_LDS                      0x00
+#define PDI_LD                       0x20
+#define PDI_STS                      0x40
+#define PDI_ST                       0x60
+#define PDI_LDCS                     0x80
+#define PDI_REPEAT                   0xA0
+#define PDI_STCS                     0xC0
+#define PDI_KEY                      0xE0
+
+#define PDI_REG_STATUS               0
+#define PDI_REG_RESET                1
+#define PDI_REG_CTRL                 2
+
+/** NVM controller registers and commands used by the programmer. */
+#define NVM_REG_DAT0                 0x04
+#define NVM_REG_CMD                  0x0A
+#define NVM_REG_CTRLA                0x0B
+#define NVM_REG_STATUS               0x0F
+
+#define NVM_CMD_NOOP                 0x00
+#define NVM_CMD_READUSERSIG          0x03
+#define NVM_CMD_READFUSE             0x07
+#define NVM_CMD_WRITELOCK            0x08
+#define NVM_CMD_ERASEUSERSIG         0x18
+#define NVM_CMD_WRITEUSERSIG         0x1A
+#define NVM_CMD_ERASEAPPSEC          0x20
+#define NVM_CMD_ERASEAPPSECPAGE      0x22
+#define NVM_CMD_LOADFLASHPAGEBUFF    0x23
+#define NVM_CMD_WRITEAPPSECPAGE      0x24
+#define NVM_CMD_ERASEWRITEAPPSECPAGE 0x25
+#define NVM_CMD_ERASEFLASHPAGEBUFF   0x26
+#define NVM_CMD_ERASEBOOTSECPAGE     0x2A
+#define NVM_CMD_ERASEFLASHPAGE       0x2B
+#define NVM_CMD_WRITEBOOTSECPAGE     0x2C
+#define NVM_CMD_ERASEWRITEBOOTPAGE   0x2D
+#define NVM_CMD_WRITEFLASHPAGE       0x2E
+#define NVM_CMD_ERASEWRITEFLASHPAGE  0x2F
+#define NVM_CMD_ERASEEEPROM          0x30
+#define NVM_CMD_ERASEEEPROMPAGE      0x32
+#define NVM_CMD_LOADEEPROMPAGEBUFF   0x33
+#define NVM_CMD_WRITEEEPROMPAGE      0x34
+#define NVM_CMD_ERASEWRITEEEPROMPAGE 0x35
+#define NVM_CMD_ERASEEEPROMPAGEBUFF  0x36
+#define NVM_CMD_APPCRC               0x38
+#define NVM_CMD_BOOTCRC              0x39
+#define NVM_CMD_CHIPERASE            0x40
+#define NVM_CMD_READNVM              0x43
+#define NVM_CMD_WRITEFUSE            0x4C
+#define NVM_CMD_ERASEBOOTSEC         0x68
+#define NVM_CMD_FLASHCRC             0x78
+
+/** Size of the queue of reply bytes the target has yet to send to the programmer. */
+#define PDI_REPLY_QUEUE_SIZE         1024
+
+/** Enum for the states of the target's PDI instruction decoder. */
+enum PDIDecoderStates_t
+{
+	PDI_STATE_INSTRUCTION, /**< Waiting for the next instruction */
+	PDI_STATE_ADDRESS, /**< Receiving the address of an LDS or STS instruction */
+	PDI_STATE_DATA, /**< Receiving the data of an STS, ST or STCS instruction */
+	PDI_STATE_POINTER, /**< Receiving the new pointer of an ST instruction in direct pointer mode */
+	PDI_STATE_REPEAT, /**< Receiving the count of a REPEAT instruction */
+	PDI_STATE_KEY, /**< Receiving the key of a KEY instruction */
+};
+
+/** Key which enables access to the target's NVM controller, in the order it is sent. */
+static const uint8_t NVMEnableKey[8] = {0xFF, 0x88, 0xD8, 0xCD, 0x45, 0xAB, 0x89, 0x12};
+
+/** Memories of the target. */
+static uint8_t  Flash[PDI_FLASH_SIZE];
+static uint8_t  EEPROM[PDI_EEPROM_SIZE];
+static uint8_t  UserSignature[PDI_USERSIG_SIZE];
+static uint8_t  Fuses[8];
+
+/** Page buffers of the target, and the mask of the EEPROM page buffer bytes loaded since the buffer was erased. */
+static uint8_t  FlashPageBuffer[PDI_FLASH_PAGE_SIZE];
+static uint8_t  EEPROMPageBuffer[PDI_EEPROM_PAGE_SIZE];
+static uint32_t EEPROMPageLoaded;
+
+/** NVM controller registers of the target. */
+static uint8_t  NVMCommand;
+static uint8_t  NVMData[3];
+
+/** Time at which the NVM controller completes its current operation. */
+static uint64_t BusyUntilNS;
+
+/** PDI control and status registers of the target. */
+static bool     NVMEnabled;
+static uint8_t  ResetRegister;
+static uint8_t  ControlRegister;
+
+/** State of the PDI instruction decoder. */
+static uint8_t  DecoderState;
+static uint8_t  CurrentInstruction;
+static uint8_t  ReceivedBytes[8];
+static uint8_t  ReceivedCount;
+static uint8_t  ExpectedCount;
+static uint32_t CurrentAddress;
+static uint32_t PointerRegister;
+static uint32_t RepeatCount;
+static uint32_t DataBytesRemaining;
+
+/** Queue of reply bytes the target has yet to send to the programmer. */
+static uint8_t  ReplyQueue[PDI_REPLY_QUEUE_SIZE];
+static uint16_t ReplyHead;
+static uint16_t ReplyCount;
+
+
+static void PDITarget_Reset(void)
+{
+	memset(Flash, 0xFF, sizeof(Flash));
+	memset(EEPROM, 0xFF, sizeof(EEPROM));
+	memset(UserSignature, 0xFF, sizeof(UserSignature));
+	memset(Fuses, 0xFF, sizeof(Fuses));
+	memset(FlashPageBuffer, 0xFF, sizeof(FlashPageBuffer));
+
+	EEPROMPageLoaded = 0;
+	NVMCommand       = NVM_CMD_NOOP;
+	BusyUntilNS      = 0;
+	NVMEnabled       = false;
+	ResetRegister    = 0;
+	ControlRegister  = 0;
+	DecoderState     = PDI_STATE_INSTRUCTION;
+	RepeatCount      = 0;
+	ReplyCount       = 0;
+}
+
+static uint8_t* PDITarget_GetFlash(void)
+{
+	return Flash;
+}
+
+/** Determines if the target's NVM controller is busy with an operation. */
+static bool PDITarget_IsBusy(void)
+{
+	return (SimClock_GetTimeNS() < BusyUntilNS);
+}
+
+/** Starts an NVM controller operation, keeping the controller busy for the given time. */
+static void PDITarget_StartOperation(const uint64_t OperationNS)
+{
+	BusyUntilNS = (SimClock_GetTimeNS() + OperationNS);
+}
+
+/** Queues a reply byte to be sent to the programmer. */
+static void PDITarget_QueueReply(const uint8_t Byte)
+{
+	if (ReplyCount == PDI_REPLY_QUEUE_SIZE)
+	{
+		SimTarget_Violation("PDI reply queue overflow");
+		return;
+	}
+
+	ReplyQueue[(ReplyHead + ReplyCount++) % PDI_REPLY_QUEUE_SIZE] = Byte;
+}
+
+/** Writes the FLASH page buffer into the given page of the target's FLASH, which can only clear bits. */
+static void PDITarget_WriteFlashPage(const uint32_t Offset)
+{
+	uint32_t PageOffset = (Offset & ~(uint32_t)(PDI_FLASH_PAGE_SIZE - 1));
+
+	for (uint16_t i = 0; i < PDI_FLASH_PAGE_SIZE; i++)
+	  Flash[PageOffset + i] &= FlashPageBuffer[i];
+
+	memset(FlashPageBuffer, 0xFF, sizeof(FlashPageBuffer));
+}
+
+/** Erases the given page of the target's FLASH. */
+static void PDITarget_EraseFlashPage(const uint32_t Offset)
+{
+	memset(&Flash[Offset & ~(uint32_t)(PDI_FLASH_PAGE_SIZE - 1)], 0xFF, PDI_FLASH_PAGE_SIZE);
+}
+
+/** Performs the action of the current NVM command triggered by a write to an address in the NVM space. */
+static void PDITarget_NVMAddressTrigger(const uint32_t Address,
+                                        const uint8_t Byte)
+{
+	bool     IsFlash     = ((Address >= PDI_FLASH_BASE) && (Address < (PDI_FLASH_BASE + PDI_FLASH_SIZE)));
+	bool     IsEEPROM    = ((Address >= PDI_EEPROM_BASE) && (Address < (PDI_EEPROM_BASE + PDI_EEPROM_SIZE)));
+	uint32_t FlashOffset = (Address - PDI_FLASH_BASE);
+	uint32_t EEPROMPage  = ((Address - PDI_EEPROM_BASE) & ~(uint32_t)(PDI_EEPROM_PAGE_SIZE - 1));
+
+	switch (NVMCommand)
+	{
+		case NVM_CMD_LOADFLASHPAGEBUFF:
+			if (IsFlash)
+			  FlashPageBuffer[FlashOffset % PDI_FLASH_PAGE_SIZE] = Byte;
+			else
+			  SimTarget_Violation("FLASH page buffer load outside of FLASH at %07lX", (unsigned long)Address);
+
+			return;
+		case NVM_CMD_LOADEEPROMPAGEBUFF:
+			if (IsEEPROM)
+			{
+				EEPROMPageBuffer[Address % PDI_EEPROM_PAGE_SIZE] = Byte;
+				EEPROMPageLoaded |= (1UL << (Address % PDI_EEPROM_PAGE_SIZE));
+			}
+			else
+			{
+				SimTarget_Violation("EEPROM page buffer load outside of EEPROM at %07lX", (unsigned long)Address);
+			}
+
+			return;
+		case NVM_CMD_WRITEAPPSECPAGE:
+		case NVM_CMD_WRITEBOOTSECPAGE:
+		case NVM_CMD_WRITEFLASHPAGE:
+		case NVM_CMD_ERASEWRITEAPPSECPAGE:
+		case NVM_CMD_ERASEWRITEBOOTPAGE:
+		case NVM_CMD_ERASEWRITEFLASHPAGE:
+		{
+			bool IsErase = ((NVMCommand == NVM_CMD_ERASEWRITEAPPSECPAGE) || (NVMCommand == NVM_CMD_ERASEWRITEBOOTPAGE) ||
+			                (NVMCommand == NVM_CMD_ERASEWRITEFLASHPAGE));
+			bool IsApp   = ((NVMCommand == NVM_CMD_WRITEAPPSECPAGE) || (NVMCommand == NVM_CMD_ERASEWRITEAPPSECPAGE));
+			bool IsBoot  = ((NVMCommand == NVM_CMD_WRITEBOOTSECPAGE) || (NVMCommand == NVM_CMD_ERASEWRITEBOOTPAGE));
+
+			if (!(IsFlash) || (IsApp && (FlashOffset >= PDI_APP_SECTION_SIZE)) ||
+			    (IsBoot && (FlashOffset < PDI_APP_SECTION_SIZE)))
+			{
+				SimTarget_Violation("FLASH page write command %02X outside of its section at %07lX", NVMCommand,
+				                    (unsigned long)Address);
+				return;
+			}
+
+			if (IsErase)
+			  PDITarget_EraseFlashPage(FlashOffset);
+
+			PDITarget_WriteFlashPage(FlashOffset);
+			PDITarget_StartOperation(IsErase ? (PDI_PAGE_ERASE_NS + PDI_PAGE_WRITE_NS) : PDI_PAGE_WRITE_NS);
+			return;
+		}
+		case NVM_CMD_ERASEAPPSECPAGE:
+		case NVM_CMD_ERASEBOOTSECPAGE:
+		case NVM_CMD_ERASEFLASHPAGE:
+			if (IsFlash)
+			  PDITarget_EraseFlashPage(FlashOffset);
+
+			PDITarget_StartOperation(PDI_PAGE_ERASE_NS);
+			return;
+		case NVM_CMD_ERASEAPPSEC:
+			memset(Flash, 0xFF, PDI_APP_SECTION_SIZE);
+			PDITarget_StartOperation(PDI_CHIP_ERASE_NS / 2);
+			return;
+		case NVM_CMD_ERASEBOOTSEC:
+			memset(&Flash[PDI_APP_SECTION_SIZE], 0xFF, (PDI_FLASH_SIZE - PDI_APP_SECTION_SIZE));
+			PDITarget_StartOperation(PDI_PAGE_ERASE_NS);
+			return;
+		case NVM_CMD_ERASEUSERSIG:
+			memset(UserSignature, 0xFF, sizeof(UserSignature));
+			PDITarget_StartOperation(PDI_PAGE_ERASE_NS);
+			return;
+		case NVM_CMD_WRITEUSERSIG:
+			for (uint16_t i = 0; i < PDI_USERSIG_SIZE; i++)
+			  UserSignature[i] &= FlashPageBuffer[i];
+
+			memset(FlashPageBuffer, 0xFF, sizeof(FlashPageBuffer));
+			PDITarget_StartOperation(PDI_PAGE_WRITE_NS);
+			return;
+		case NVM_CMD_ERASEEEPROMPAGE:
+		case NVM_CMD_WRITEEEPROMPAGE:
+		case NVM_CMD_ERASEWRITEEEPROMPAGE:
+			if (!(IsEEPROM))
+			{
+				SimTarget_Violation("EEPROM page command %02X outside of EEPROM at %07lX", NVMCommand,
+				                    (unsigned long)Address);
+				return;
+			}
+
+			/* Only the loaded bytes of an EEPROM page are erased and written */
+			for (uint8_t i = 0; i < PDI_EEPROM_PAGE_SIZE; i++)
+			{
+				if (!(EEPROMPageLoaded & (1UL << i)))
+				  continue;
+
+				if (NVMCommand != NVM_CMD_WRITEEEPROMPAGE)
+				  EEPROM[EEPROMPage + i] = 0xFF;
+
+				if (NVMCommand != NVM_CMD_ERASEEEPROMPAGE)
+				  EEPROM[EEPROMPage + i] &= EEPROMPageBuffer[i];
+			}
+
+			EEPROMPageLoaded = 0;
+			PDITarget_StartOperation(PDI_EEPROM_WRITE_NS);
+			return;
+		case NVM_CMD_WRITEFUSE:
+			if ((Address >= PDI_FUSE_BASE) && (Address < (PDI_FUSE_BASE + sizeof(Fuses))))
+			  Fuses[Address - PDI_FUSE_BASE] = Byte;
+
+			PDITarget_StartOperation(PDI_EEPROM_WRITE_NS);
+			return;
+		case NVM_CMD_WRITELOCK:
+			Fuses[PDI_LOCKBITS_ADDRESS - PDI_FUSE_BASE] &= Byte;
+			PDITarget_StartOperation(PDI_EEPROM_WRITE_NS);
+			return;
+		default:
+			SimTarget_Violation("write to NVM address %07lX with NVM command %02X", (unsigned long)Address, NVMCommand);
+			return;
+	}
+}
+
+/** Performs the action of the current NVM command triggered by setting the CMDEX bit of the NVM CTRLA register. */
+static void PDITarget_NVMExecuteTrigger(void)
+{
+	uint32_t CRCStart  = 0;
+	uint32_t CRCLength = 0;
+
+	switch (NVMCommand)
+	{
+		case NVM_CMD_CHIPERASE:
+			memset(Flash, 0xFF, sizeof(Flash));
+			memset(EEPROM, 0xFF, sizeof(EEPROM));
+			Fuses[PDI_LOCKBITS_ADDRESS - PDI_FUSE_BASE] = 0xFF;
+			PDITarget_StartOperation(PDI_CHIP_ERASE_NS);
+			return;
+		case NVM_CMD_ERASEFLASHPAGEBUFF:
+			memset(FlashPageBuffer, 0xFF, sizeof(FlashPageBuffer));
+			PDITarget_StartOperation(SIM_CYCLES_TO_NS(PDI_FLASH_PAGE_SIZE));
+			return;
+		case NVM_CMD_ERASEEEPROMPAGEBUFF:
+			memset(EEPROMPageBuffer, 0xFF, sizeof(EEPROMPageBuffer));
+			EEPROMPageLoaded = 0;
+			PDITarget_StartOperation(SIM_CYCLES_TO_NS(PDI_EEPROM_PAGE_SIZE));
+			return;
+		case NVM_CMD_ERASEEEPROM:
+			memset(EEPROM, 0xFF, sizeof(EEPROM));
+			EEPROMPageLoaded = 0;
+			PDITarget_StartOperation(PDI_EEPROM_WRITE_NS);
+			return;
+		case NVM_CMD_APPCRC:
+			CRCLength = PDI_APP_SECTION_SIZE;
+			break;
+		case NVM_CMD_BOOTCRC:
+			CRCStart  = PDI_APP_SECTION_SIZE;
+			CRCLength = (PDI_FLASH_SIZE - PDI_APP_SECTION_SIZE);
+			break;
+		case NVM_CMD_FLASHCRC:
+			CRCLength = PDI_FLASH_SIZE;
+			break;
+		default:
+			SimTarget_Violation("NVM command %02X executed through CTRLA", NVMCommand);
+			return;
+	}
+
+	/* The XMEGA NVM controller generates a CRC-32 (IEEE 802.3) of the memory, of which DAT0-2 hold the low 24 bits */
+	uint32_t CRC = 0xFFFFFFFF;
+
+	for (uint32_t i = 0; i < CRCLength; i++)
+	{
+		CRC ^= Flash[CRCStart + i];
+
+		for (uint8_t Bit = 0; Bit < 8; Bit++)
+		  CRC = ((CRC & 1) ? ((CRC >> 1) ^ 0xEDB88320) : (CRC >> 1));
+	}
+
+	CRC = ~CRC;
+
+	NVMData[0] = (CRC & 0xFF);
+	NVMData[1] = ((CRC >> 8) & 0xFF);
+	NVMData[2] = ((CRC >> 16) & 0xFF);
+
+	PDITarget_StartOperation(CRCLength * PDI_CRC_NS_PER_BYTE);
+}
+
+/** Reads a byte from the PDI address space of the target. */
+static uint8_t PDITarget_ReadByte(const uint32_t Address)
+{
+	if (Address >= PDI_DATA_SPACE_BASE)
+	{
+		if ((Address >= PDI_DEVID_ADDRESS) && (Address < (PDI_DEVID_ADDRESS + 3)))
+		  return SimTarget_ATxmega32A4U.Signature[Address - PDI_DEVID_ADDRESS];
+
+		switch (Address - PDI_NVM_BASE)
+		{
+			case NVM_REG_DAT0:
+			case NVM_REG_DAT0 + 1:
+			case NVM_REG_DAT0 + 2:
+				return NVMData[Address - PDI_NVM_BASE - NVM_REG_DAT0];
+			case NVM_REG_CMD:
+				return NVMCommand;
+			case NVM_REG_STATUS:
+				return (PDITarget_IsBusy() ? (1 << 7) : 0);
+			default:
+				return 0x00;
+		}
+	}
+
+	if (PDITarget_IsBusy())
+	{
+		SimTarget_Violation("NVM read at %07lX while the NVM controller was busy", (unsigned long)Address);
+		return 0xFF;
+	}
+
+	if (NVMCommand != NVM_CMD_READNVM)
+	{
+		SimTarget_Violation("NVM read at %07lX with NVM command %02X", (unsigned long)Address, NVMCommand);
+		return 0xFF;
+	}
+
+	if ((Address >= PDI_FLASH_BASE) && (Address < (PDI_FLASH_BASE + PDI_FLASH_SIZE)))
+	  return Flash[Address - PDI_FLASH_BASE];
+	else if ((Address >= PDI_EEPROM_BASE) && (Address < (PDI_EEPROM_BASE + PDI_EEPROM_SIZE)))
+	  return EEPROM[Address - PDI_EEPROM_BASE];
+	else if ((Address >= PDI_USERSIG_BASE) && (Address < (PDI_USERSIG_BASE + PDI_USERSIG_SIZE)))
+	  return UserSignature[Address - PDI_USERSIG_BASE];
+	else if ((Address >= PDI_FUSE_BASE) && (Address < (PDI_FUSE_BASE + sizeof(Fuses))))
+	  return Fuses[Address - PDI_FUSE_BASE];
+
+	return 0xFF;
+}
+
+/** Writes a byte to the PDI address space of the target. */
+static void PDITarget_WriteByte(const uint32_t Address,
+                                const uint8_t Byte)
+{
+	if (Address >= PDI_DATA_SPACE_BASE)
+	{
+		switch (Address - PDI_NVM_BASE)
+		{
+			case NVM_REG_CMD:
+				if (PDITarget_IsBusy())
+				  SimTarget_Violation("NVM command %02X written while the NVM controller was busy", Byte);
+
+				NVMCommand = Byte;
+				break;
+			case NVM_REG_CTRLA:
+				if (PDITarget_IsBusy())
+				  SimTarget_Violation("NVM command %02X executed while the NVM controller was busy", NVMCommand);
+				else if (Byte & (1 << 0))
+				  PDITarget_NVMExecuteTrigger();
+
+				break;
+		}
+
+		return;
+	}
+
+	if (PDITarget_IsBusy())
+	{
+		SimTarget_Violation("NVM write at %07lX while the NVM controller was busy", (unsigned long)Address);
+		return;
+	}
+
+	PDITarget_NVMAddressTrigger(Address, Byte);
+}
+
+/** Retrieves a little endian value from the bytes received for the current instruction. */
+static uint32_t PDITarget_GetReceivedValue(void)
+{
+	uint32_t Value = 0;
+
+	for (uint8_t i = ReceivedCount; i > 0; i--)
+	  Value = ((Value << 8) | ReceivedBytes[i - 1]);
+
+	return Value;
+}
+
+/** Starts receiving a number of bytes for the current instruction in the given decoder state. */
+static void PDITarget_ExpectBytes(const uint8_t State,
+                                  const uint8_t Count)
+{
+	DecoderState  = State;
+	ReceivedCount = 0;
+	ExpectedCount = Count;
+}
+
+/** Decodes a new PDI instruction from the programmer. */
+static void PDITarget_StartInstruction(const uint8_t Instruction)
+{
+	uint8_t  DataSize     = ((Instruction & 0x03) + 1);
+	uint8_t  PointerMode  = ((Instruction >> 2) & 0x03);
+	uint32_t Repeats      = (RepeatCount + 1);
+
+	CurrentInstruction = Instruction;
+
+	if (((Instruction & 0xE0) != PDI_LDCS) && ((Instruction & 0xE0) != PDI_STCS) && (Instruction != PDI_KEY) &&
+	    !(NVMEnabled))
+	{
+		SimTarget_Violation("PDI instruction %02X issued before the NVM bus was enabled", Instruction);
+	}
+
+	switch (Instruction & 0xE0)
+	{
+		case PDI_LDS:
+		case PDI_STS:
+			PDITarget_ExpectBytes(PDI_STATE_ADDRESS, (PointerMode + 1));
+			break;
+		case PDI_LD:
+			RepeatCount = 0;
+
+			for (uint32_t Repeat = 0; Repeat < Repeats; Repeat++)
+			{
+				for (uint8_t i = 0; i < DataSize; i++)
+				{
+					if (PointerMode == 2)
+					{
+						PDITarget_QueueReply((PointerRegister >> (8 * i)) & 0xFF);
+						continue;
+					}
+
+					PDITarget_QueueReply(PDITarget_ReadByte(PointerRegister + ((PointerMode == 1) ? 0 : i)));
+
+					if (PointerMode == 1)
+					  PointerRegister++;
+				}
+			}
+
+			DecoderState = PDI_STATE_INSTRUCTION;
+			break;
+		case PDI_ST:
+			if (PointerMode == 2)
+			{
+				PDITarget_ExpectBytes(PDI_STATE_POINTER, DataSize);
+			}
+			else
+			{
+				DataBytesRemaining = (Repeats * DataSize);
+				RepeatCount        = 0;
+				DecoderState       = PDI_STATE_DATA;
+			}
+
+			break;
+		case PDI_LDCS:
+			if ((Instruction & 0x0F) == PDI_REG_STATUS)
+			  PDITarget_QueueReply(NVMEnabled ? (1 << 1) : 0);
+			else if ((Instruction & 0x0F) == PDI_REG_RESET)
+			  PDITarget_QueueReply(ResetRegister ? 0x01 : 0x00);
+			else
+			  PDITarget_QueueReply(ControlRegister);
+
+			break;
+		case PDI_STCS:
+			DataBytesRemaining = 1;
+			DecoderState       = PDI_STATE_DATA;
+			break;
+		case PDI_REPEAT:
+			PDITarget_ExpectBytes(PDI_STATE_REPEAT, DataSize);
+			break;
+		default:
+			if (Instruction == PDI_KEY)
+			  PDITarget_ExpectBytes(PDI_STATE_KEY, sizeof(NVMEnableKey));
+			else
+			  SimTarget_Violation("unknown PDI instruction %02X", Instruction);
+
+			break;
+	}
+}
+
+/** Accepts a byte sent by the programmer over PDI, decoding it as part of the current instruction. */
+static void PDITarget_ReceiveUSARTByte(const uint8_t Byte)
+{
+	if (ReplyCount)
+	{
+		SimTarget_Violation("PDI byte %02X sent while %u reply bytes were still pending", Byte, ReplyCount);
+		ReplyCount = 0;
+	}
+
+	if (DecoderState == PDI_STATE_INSTRUCTION)
+	{
+		PDITarget_StartInstruction(Byte);
+		return;
+	}
+
+	if (DecoderState == PDI_STATE_DATA)
+	{
+		if ((CurrentInstruction & 0xE0) == PDI_STCS)
+		{
+			if ((CurrentInstruction & 0x0F) == PDI_REG_RESET)
+			{
+				ResetRegister = (Byte == 0x59);
+
+				/* Releasing the target from reset ends the programming session */
+				if (!(ResetRegister))
+				  NVMEnabled = false;
+			}
+			else if ((CurrentInstruction & 0x0F) == PDI_REG_STATUS)
+			{
+				NVMEnabled = (Byte & (1 << 1));
+			}
+			else
+			{
+				ControlRegister = Byte;
+			}
+		}
+		else if ((CurrentInstruction & 0xE0) == PDI_STS)
+		{
+			PDITarget_WriteByte(CurrentAddress++, Byte);
+		}
+		else
+		{
+			PDITarget_WriteByte(PointerRegister, Byte);
+
+			if (((CurrentInstruction >> 2) & 0x03) == 1)
+			  PointerRegister++;
+		}
+
+		if (!(--DataBytesRemaining))
+		  DecoderState = PDI_STATE_INSTRUCTION;
+
+		return;
+	}
+
+	ReceivedBytes[ReceivedCount++] = Byte;
+
+	if (ReceivedCount < ExpectedCount)
+	  return;
+
+	switch (DecoderState)
+	{
+		case PDI_STATE_ADDRESS:
+			CurrentAddress = PDITarget_GetReceivedValue();
+
+			if ((CurrentInstruction & 0xE0) == PDI_LDS)
+			{
+				for (uint8_t i = 0; i < ((CurrentInstruction & 0x03) + 1); i++)
+				  PDITarget_QueueReply(PDITarget_ReadByte(CurrentAddress + i));
+
+				DecoderState = PDI_STATE_INSTRUCTION;
+			}
+			else
+			{
+				DataBytesRemaining = ((CurrentInstruction & 0x03) + 1);
+				DecoderState       = PDI_STATE_DATA;
+			}
+
+			break;
+		case PDI_STATE_POINTER:
+			PointerRegister = PDITarget_GetReceivedValue();
+			DecoderState    = PDI_STATE_INSTRUCTION;
+			break;
+		case PDI_STATE_REPEAT:
+			RepeatCount  = PDITarget_GetReceivedValue();
+			DecoderState = PDI_STATE_INSTRUCTION;
+			break;
+		case PDI_STATE_KEY:
+			if (!(memcmp(ReceivedBytes, NVMEnableKey, sizeof(NVMEnableKey))) && ResetRegister)
+			  NVMEnabled = true;
+			else
+			  SimTarget_Violation("invalid NVM enable key, or key sent while the target was not held in reset");
+
+			DecoderState = PDI_STATE_INSTRUCTION;
+			break;
+	}
+}
+
+static bool PDITarget_HasUSARTByte(void)
+{
+	return (ReplyCount != 0);
+}
+
+static uint8_t PDITarget_SendUSARTByte(void)
+{
+	uint8_t Byte = ReplyQueue[ReplyHead];
+
+	ReplyHead = ((ReplyHead + 1) % PDI_REPLY_QUEUE_SIZE);
+	ReplyCount--;
+
+	return Byte;
+}
+
+/** Retrieves the number of idle bits the target inserts before replying, set by the PDI CTRL register. */
+static uint8_t PDITarget_GetGuardTimeBits(void)
+{
+	uint8_t GuardTime = (ControlRegister & 0x07);
+
+	return ((GuardTime < 7) ? (128 >> GuardTime) : 2);
+}
+
+const SimTarget_t SimTarget_ATxmega32A4U =
+	{
+		.Name             = "ATxmega32A4U",
+		.Interface        = SIM_INTERFACE_PDI,
+		.Signature        = {0x1E, 0x95, 0x41},
+		.FlashSize        = PDI_FLASH_SIZE,
+		.FlashPageSize    = PDI_FLASH_PAGE_SIZE,
+		.Reset            = PDITarget_Reset,
+		.GetFlash         = PDITarget_GetFlash,
+		.ReceiveUSARTByte = PDITarget_ReceiveUSARTByte,
+		.HasUSARTByte     = PDITarget_HasUSARTByte,
+		.SendUSARTByte    = PDITarget_SendUSARTByte,
+		.GetGuardTimeBits = PDITarget_GetGuardTimeBits,
+	};
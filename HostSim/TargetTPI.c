@@ -0,0 +1,382 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Simulated TPI programming target for the host simulation, modelling the TPI instruction set and the NVM controller
+ *  of an ATtiny10. As for the PDI target, the NVM operation times are assumed round figures rather than datasheet
+ *  values.
+ */
+
+#include <string.h>
+
+#include "Sim.h"
+
+/** Addresses of the target's memories in its data space. */
+#define TPI_SIGNATURE_BASE           0x3FC0
+#define TPI_FLASH_BASE               0x4000
+#define TPI_FLASH_SIZE               1024
+
+/** I/O addresses of the target's NVM controller registers. */
+#define TPI_NVMCSR_ADDRESS           0x32
+#define TPI_NVMCMD_ADDRESS           0x33
+
+/** NVM controller commands used by the programmer. */
+#define TPI_NVM_CMD_NOOP             0x00
+#define TPI_NVM_CMD_CHIPERASE        0x10
+#define TPI_NVM_CMD_SECTIONERASE     0x14
+#define TPI_NVM_CMD_WORDWRITE        0x1D
+
+/** Assumed busy times of the target's NVM controller operations, in nanoseconds. */
+#define TPI_WORD_WRITE_NS            2500000ULL
+#define TPI_ERASE_NS                 5000000ULL
+
+/** TPI instruction opcodes and the TPI control and status registers used by the programmer. */
+#define TPI_SLD                      0x20
+#define TPI_SST                      0x60
+#define TPI_SSTPR                    0x68
+#define TPI_SKEY                     0xE0
+
+#define TPI_REG_STATUS               0x00
+#define TPI_REG_CTRL                 0x02
+#define TPI_REG_ID                   0x0F
+
+/** Size of the queue of reply bytes the target has yet to send to the programmer. */
+#define TPI_REPLY_QUEUE_SIZE         16
+
+/** Key which enables access to the target's NVM controller, in the order it is sent. */
+static const uint8_t NVMEnableKey[8] = {0xFF, 0x88, 0xD8, 0xCD, 0x45, 0xAB, 0x89, 0x12};
+
+/** FLASH memory of the target, and the low byte of the word being written latched until its high byte is written. */
+static uint8_t  Flash[TPI_FLASH_SIZE];
+static uint8_t  LatchedLowByte;
+
+/** NVM controller command register of the target, and the time at which the controller completes its operation. */
+static uint8_t  NVMCommand;
+static uint64_t BusyUntilNS;
+
+/** TPI control and status registers of the target. */
+static bool     NVMEnabled;
+static uint8_t  ControlRegister;
+
+/** State of the TPI instruction decoder: the instruction awaiting its operand bytes, if any. */
+static uint8_t  CurrentInstruction;
+static uint8_t  OperandBytes;
+static uint8_t  KeyBytes[8];
+
+/** Pointer register of the target. */
+static uint16_t PointerRegister;
+
+/** Queue of reply bytes the target has yet to send to the programmer. */
+static uint8_t  ReplyQueue[TPI_REPLY_QUEUE_SIZE];
+static uint8_t  ReplyHead;
+static uint8_t  ReplyCount;
+
+
+static void TPITarget_Reset(void)
+{
+	memset(Flash, 0xFF, sizeof(Flash));
+
+	NVMCommand         = TPI_NVM_CMD_NOOP;
+	BusyUntilNS        = 0;
+	NVMEnabled         = false;
+	ControlRegister    = 0;
+	CurrentInstruction = 0;
+	OperandBytes       = 0;
+	ReplyCount         = 0;
+}
+
+static uint8_t* TPITarget_GetFlash(void)
+{
+	return Flash;
+}
+
+/** Determines if the target's NVM controller is busy with an operation. */
+static bool TPITarget_IsBusy(void)
+{
+	return (SimClock_GetTimeNS() < BusyUntilNS);
+}
+
+/** Queues a reply byte to be sent to the programmer. */
+static void TPITarget_QueueReply(const uint8_t Byte)
+{
+	if (ReplyCount == TPI_REPLY_QUEUE_SIZE)
+	{
+		SimTarget_Violation("TPI reply queue overflow");
+		return;
+	}
+
+	ReplyQueue[(ReplyHead + ReplyCount++) % TPI_REPLY_QUEUE_SIZE] = Byte;
+}
+
+/** Reads a byte from the I/O space of the target. */
+static uint8_t TPITarget_ReadIO(const uint8_t Address)
+{
+	if (Address == TPI_NVMCSR_ADDRESS)
+	  return (TPITarget_IsBusy() ? (1 << 7) : 0);
+	else if (Address == TPI_NVMCMD_ADDRESS)
+	  return NVMCommand;
+
+	return 0x00;
+}
+
+/** Writes a byte to the I/O space of the target. */
+static void TPITarget_WriteIO(const uint8_t Address,
+                              const uint8_t Byte)
+{
+	if (Address != TPI_NVMCMD_ADDRESS)
+	  return;
+
+	if (TPITarget_IsBusy())
+	  SimTarget_Violation("NVM command %02X written while the NVM controller was busy", Byte);
+
+	NVMCommand = Byte;
+}
+
+/** Reads a byte from the data space of the target. */
+static uint8_t TPITarget_ReadData(const uint16_t Address)
+{
+	if (Address < 0x40)
+	  return TPITarget_ReadIO(Address);
+
+	if (TPITarget_IsBusy())
+	{
+		SimTarget_Violation("NVM read at %04X while the NVM controller was busy", Address);
+		return 0xFF;
+	}
+
+	if ((Address >= TPI_SIGNATURE_BASE) && (Address < (TPI_SIGNATURE_BASE + 3)))
+	  return SimTarget_ATtiny10.Signature[Address - TPI_SIGNATURE_BASE];
+	else if ((Address >= TPI_FLASH_BASE) && (Address < (TPI_FLASH_BASE + TPI_FLASH_SIZE)))
+	  return Flash[Address - TPI_FLASH_BASE];
+
+	return 0xFF;
+}
+
+/** Writes a byte to the data space of the target, triggering the current NVM command for FLASH addresses. */
+static void TPITarget_WriteData(const uint16_t Address,
+                                const uint8_t Byte)
+{
+	if (Address < 0x40)
+	{
+		TPITarget_WriteIO(Address, Byte);
+		return;
+	}
+
+	if ((Address < TPI_FLASH_BASE) || (Address >= (TPI_FLASH_BASE + TPI_FLASH_SIZE)))
+	  return;
+
+	if (TPITarget_IsBusy())
+	{
+		SimTarget_Violation("NVM write at %04X while the NVM controller was busy", Address);
+		return;
+	}
+
+	uint16_t Offset = (Address - TPI_FLASH_BASE);
+
+	switch (NVMCommand)
+	{
+		case TPI_NVM_CMD_WORDWRITE:
+			/* The low byte of each word is latched, and the word is written along with its high byte */
+			if (!(Offset & 0x01))
+			{
+				LatchedLowByte = Byte;
+				return;
+			}
+
+			Flash[Offset - 1] &= LatchedLowByte;
+			Flash[Offset]     &= Byte;
+			BusyUntilNS = (SimClock_GetTimeNS() + TPI_WORD_WRITE_NS);
+			return;
+		case TPI_NVM_CMD_CHIPERASE:
+		case TPI_NVM_CMD_SECTIONERASE:
+			if (!(Offset & 0x01))
+			  SimTarget_Violation("erase triggered by a write to the low byte at %04X", Address);
+
+			memset(Flash, 0xFF, sizeof(Flash));
+			BusyUntilNS = (SimClock_GetTimeNS() + TPI_ERASE_NS);
+			return;
+		default:
+			SimTarget_Violation("write to FLASH at %04X with NVM command %02X", Address, NVMCommand);
+			return;
+	}
+}
+
+/** Retrieves the I/O address encoded in an SIN or SOUT instruction. */
+static uint8_t TPITarget_GetIOAddress(const uint8_t Instruction)
+{
+	return (((Instruction >> 1) & 0x30) | (Instruction & 0x0F));
+}
+
+/** Accepts a byte sent by the programmer over TPI, decoding it as an instruction or as an operand of the last one. */
+static void TPITarget_ReceiveUSARTByte(const uint8_t Byte)
+{
+	if (ReplyCount)
+	{
+		SimTarget_Violation("TPI byte %02X sent while %u reply bytes were still pending", Byte, ReplyCount);
+		ReplyCount = 0;
+	}
+
+	if (!(SimTarget_IsResetAsserted()))
+	{
+		SimTarget_Violation("TPI byte %02X sent while the target was not held in reset", Byte);
+		return;
+	}
+
+	/* Instructions with operands are completed by the following bytes */
+	if (OperandBytes)
+	{
+		if (CurrentInstruction == TPI_SKEY)
+		{
+			KeyBytes[sizeof(KeyBytes) - OperandBytes] = Byte;
+
+			if ((OperandBytes == 1) && !(NVMEnabled = !(memcmp(KeyBytes, NVMEnableKey, sizeof(KeyBytes)))))
+			  SimTarget_Violation("invalid NVM enable key");
+		}
+		else if ((CurrentInstruction & 0xF8) == TPI_SSTPR)
+		{
+			if (CurrentInstruction & 0x01)
+			  PointerRegister = ((PointerRegister & 0x00FF) | ((uint16_t)Byte << 8));
+			else
+			  PointerRegister = ((PointerRegister & 0xFF00) | Byte);
+		}
+		else if ((CurrentInstruction & 0xF0) == TPI_SST)
+		{
+			TPITarget_WriteData(PointerRegister, Byte);
+
+			if (CurrentInstruction & 0x04)
+			  PointerRegister++;
+		}
+		else if ((CurrentInstruction & 0xF0) == 0xC0)
+		{
+			if ((CurrentInstruction & 0x0F) == TPI_REG_STATUS)
+			  NVMEnabled = (Byte & (1 << 1));
+			else if ((CurrentInstruction & 0x0F) == TPI_REG_CTRL)
+			  ControlRegister = Byte;
+		}
+		else
+		{
+			TPITarget_WriteIO(TPITarget_GetIOAddress(CurrentInstruction), Byte);
+		}
+
+		OperandBytes--;
+		return;
+	}
+
+	CurrentInstruction = Byte;
+
+	if (((Byte & 0xF0) != 0x80) && ((Byte & 0xF0) != 0xC0) && (Byte != TPI_SKEY) && !(NVMEnabled))
+	  SimTarget_Violation("TPI instruction %02X issued before the NVM bus was enabled", Byte);
+
+	if (Byte == TPI_SKEY)
+	{
+		OperandBytes = sizeof(KeyBytes);
+	}
+	else if ((Byte & 0xF8) == TPI_SSTPR)
+	{
+		OperandBytes = 1;
+	}
+	else if ((Byte & 0xF0) == TPI_SST)
+	{
+		OperandBytes = 1;
+	}
+	else if ((Byte & 0xF0) == TPI_SLD)
+	{
+		TPITarget_QueueReply(TPITarget_ReadData(PointerRegister));
+
+		if (Byte & 0x04)
+		  PointerRegister++;
+	}
+	else if ((Byte & 0xF0) == 0x80)
+	{
+		if ((Byte & 0x0F) == TPI_REG_STATUS)
+		  TPITarget_QueueReply(NVMEnabled ? (1 << 1) : 0);
+		else if ((Byte & 0x0F) == TPI_REG_CTRL)
+		  TPITarget_QueueReply(ControlRegister);
+		else if ((Byte & 0x0F) == TPI_REG_ID)
+		  TPITarget_QueueReply(0x80);
+		else
+		  TPITarget_QueueReply(0x00);
+	}
+	else if ((Byte & 0xF0) == 0xC0)
+	{
+		OperandBytes = 1;
+	}
+	else if ((Byte & 0x90) == 0x10)
+	{
+		TPITarget_QueueReply(TPITarget_ReadIO(TPITarget_GetIOAddress(Byte)));
+	}
+	else if ((Byte & 0x90) == 0x90)
+	{
+		OperandBytes = 1;
+	}
+	else
+	{
+		SimTarget_Violation("unknown TPI instruction %02X", Byte);
+	}
+}
+
+static bool TPITarget_HasUSARTByte(void)
+{
+	return (ReplyCount != 0);
+}
+
+static uint8_t TPITarget_SendUSARTByte(void)
+{
+	uint8_t Byte = ReplyQueue[ReplyHead];
+
+	ReplyHead = ((ReplyHead + 1) % TPI_REPLY_QUEUE_SIZE);
+	ReplyCount--;
+
+	return Byte;
+}
+
+/** Retrieves the number of idle bits the target inserts before replying, set by the TPI CTRL register. */
+static uint8_t TPITarget_GetGuardTimeBits(void)
+{
+	uint8_t GuardTime = (ControlRegister & 0x07);
+
+	return ((GuardTime < 7) ? (128 >> GuardTime) : 2);
+}
+
+const SimTarget_t SimTarget_ATtiny10 =
+	{
+		.Name             = "ATtiny10",
+		.Interface        = SIM_INTERFACE_TPI,
+		.Signature        = {0x1E, 0x90, 0x03},
+		.FlashSize        = TPI_FLASH_SIZE,
+		.FlashPageSize    = 16,
+		.Reset            = TPITarget_Reset,
+		.GetFlash         = TPITarget_GetFlash,
+		.ReceiveUSARTByte = TPITarget_ReceiveUSARTByte,
+		.HasUSARTByte     = TPITarget_HasUSARTByte,
+		.SendUSARTByte    = TPITarget_SendUSARTByte,
+		.GetGuardTimeBits = TPITarget_GetGuardTimeBits,
+	};
@@ -0,0 +1,245 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Lock-free single producer, single consumer ring buffers for the USART bridge.
+ *
+ *  Each buffer has a head index written only by the producer and a tail index written only by the consumer. Both
+ *  indices are a single byte, so either side can read the other's index with a single (atomic) load. This means no
+ *  interrupt masking is needed, provided that one side runs in an ISR and the other in the main loop, or both sides
+ *  run in the same context. One element is always left unused, so that a full buffer can be told apart from an empty
+ *  one. The buffer storage must be a power of two in size, no larger than 256 bytes.
+ *
+ *  Along with single element accesses, the producer and consumer can work directly on the contiguous span of
+ *  storage at their index. They then publish the number of elements written or read in one step. This allows
+ *  blocks of data to be moved with a single stream operation.
+ */
+
+#ifndef _BRIDGE_RING_BUFFER_H_
+#define _BRIDGE_RING_BUFFER_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+
+		#include <LUFA/Common/Common.h>
+
+	/* Type Defines: */
+		/** Type define for a lock-free single producer, single consumer ring buffer. */
+		typedef struct
+		{
+			volatile uint8_t Head; /**< Index of the next element to write, only modified by the producer */
+			volatile uint8_t Tail; /**< Index of the next element to read, only modified by the consumer */
+			uint8_t          Mask; /**< Index mask for the buffer storage, one less than its power of two size */
+			uint8_t*         Data; /**< Pointer to the buffer's underlying storage */
+		} BridgeRingBuffer_t;
+
+	/* Inline Functions: */
+		/** Initializes a ring buffer ready for use, discarding any existing contents. Neither the producer nor the
+		 *  consumer may access the buffer while it is being initialized.
+		 *
+		 *  \param[out] Buffer    Ring buffer to initialize
+		 *  \param[in]  DataPtr   Pointer to the storage to use for the buffer's elements
+		 *  \param[in]  Size      Size of the storage in bytes, which must be a power of two no larger than 256
+		 */
+		static inline void BridgeRingBuffer_InitBuffer(BridgeRingBuffer_t* const Buffer,
+		                                               uint8_t* const DataPtr,
+		                                               const uint16_t Size)
+		{
+			Buffer->Head = 0;
+			Buffer->Tail = 0;
+			Buffer->Mask = (Size - 1);
+			Buffer->Data = DataPtr;
+		}
+
+		/** Retrieves the number of elements currently stored in a ring buffer. The result is exact when called by
+		 *  either the producer or the consumer, although it may grow (producer side) or shrink (consumer side)
+		 *  immediately afterwards.
+		 *
+		 *  \param[in] Buffer  Ring buffer to check
+		 *
+		 *  \return Number of elements currently stored in the buffer
+		 */
+		static inline uint8_t BridgeRingBuffer_GetCount(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline uint8_t BridgeRingBuffer_GetCount(BridgeRingBuffer_t* const Buffer)
+		{
+			return ((Buffer->Head - Buffer->Tail) & Buffer->Mask);
+		}
+
+		/** Retrieves the number of elements that can currently be inserted into a ring buffer before it becomes full.
+		 *
+		 *  \param[in] Buffer  Ring buffer to check
+		 *
+		 *  \return Number of free elements in the buffer
+		 */
+		static inline uint8_t BridgeRingBuffer_GetFreeCount(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline uint8_t BridgeRingBuffer_GetFreeCount(BridgeRingBuffer_t* const Buffer)
+		{
+			return (Buffer->Mask - BridgeRingBuffer_GetCount(Buffer));
+		}
+
+		/** Determines if a ring buffer currently contains no elements.
+		 *
+		 *  \param[in] Buffer  Ring buffer to check
+		 *
+		 *  \return Boolean \c true if the buffer is empty, \c false otherwise
+		 */
+		static inline bool BridgeRingBuffer_IsEmpty(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline bool BridgeRingBuffer_IsEmpty(BridgeRingBuffer_t* const Buffer)
+		{
+			return (Buffer->Head == Buffer->Tail);
+		}
+
+		/** Determines if a ring buffer is currently full, so that no further elements can be inserted.
+		 *
+		 *  \param[in] Buffer  Ring buffer to check
+		 *
+		 *  \return Boolean \c true if the buffer is full, \c false otherwise
+		 */
+		static inline bool BridgeRingBuffer_IsFull(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline bool BridgeRingBuffer_IsFull(BridgeRingBuffer_t* const Buffer)
+		{
+			return (((Buffer->Head + 1) & Buffer->Mask) == Buffer->Tail);
+		}
+
+		/** Inserts an element into a ring buffer. May only be called by the producer, and only when the buffer is not
+		 *  full.
+		 *
+		 *  \param[in,out] Buffer  Ring buffer to insert into
+		 *  \param[in]     Data    Element to insert into the buffer
+		 */
+		static inline void BridgeRingBuffer_Insert(BridgeRingBuffer_t* const Buffer,
+		                                           const uint8_t Data)
+		{
+			uint8_t Head = Buffer->Head;
+
+			Buffer->Data[Head] = Data;
+			GCC_MEMORY_BARRIER();
+			Buffer->Head = ((Head + 1) & Buffer->Mask);
+		}
+
+		/** Removes the oldest element from a ring buffer. May only be called by the consumer, and only when the buffer
+		 *  is not empty.
+		 *
+		 *  \param[in,out] Buffer  Ring buffer to remove from
+		 *
+		 *  \return Removed element
+		 */
+		static inline uint8_t BridgeRingBuffer_Remove(BridgeRingBuffer_t* const Buffer)
+		{
+			uint8_t Tail = Buffer->Tail;
+			uint8_t Data = Buffer->Data[Tail];
+
+			GCC_MEMORY_BARRIER();
+			Buffer->Tail = ((Tail + 1) & Buffer->Mask);
+
+			return Data;
+		}
+
+		/** Retrieves the number of elements the producer can write directly into the ring buffer's storage at the
+		 *  current head, before either the buffer becomes full or the storage wraps around. The elements are written
+		 *  starting from \ref BridgeRingBuffer_GetHeadPtr(), and then published with \ref BridgeRingBuffer_CommitInsert().
+		 *
+		 *  \param[in] Buffer  Ring buffer to check
+		 *
+		 *  \return Number of elements that can be written contiguously
+		 */
+		static inline uint8_t BridgeRingBuffer_GetFreeSpan(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline uint8_t BridgeRingBuffer_GetFreeSpan(BridgeRingBuffer_t* const Buffer)
+		{
+			return MIN(BridgeRingBuffer_GetFreeCount(Buffer), (uint16_t)(Buffer->Mask + 1 - Buffer->Head));
+		}
+
+		/** Retrieves the number of stored elements the consumer can read directly from the ring buffer's storage at the
+		 *  current tail, before either the buffer becomes empty or the storage wraps around. The elements are read
+		 *  starting from \ref BridgeRingBuffer_GetTailPtr(), and then released with \ref BridgeRingBuffer_CommitRemove().
+		 *
+		 *  \param[in] Buffer  Ring buffer to check
+		 *
+		 *  \return Number of elements that can be read contiguously
+		 */
+		static inline uint8_t BridgeRingBuffer_GetDataSpan(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline uint8_t BridgeRingBuffer_GetDataSpan(BridgeRingBuffer_t* const Buffer)
+		{
+			return MIN(BridgeRingBuffer_GetCount(Buffer), (uint16_t)(Buffer->Mask + 1 - Buffer->Tail));
+		}
+
+		/** Retrieves a pointer to the ring buffer storage at the current head, for use by the producer.
+		 *
+		 *  \param[in] Buffer  Ring buffer to retrieve the pointer for
+		 *
+		 *  \return Pointer to the storage location the next inserted element will occupy
+		 */
+		static inline uint8_t* BridgeRingBuffer_GetHeadPtr(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline uint8_t* BridgeRingBuffer_GetHeadPtr(BridgeRingBuffer_t* const Buffer)
+		{
+			return &Buffer->Data[Buffer->Head];
+		}
+
+		/** Retrieves a pointer to the ring buffer storage at the current tail, for use by the consumer.
+		 *
+		 *  \param[in] Buffer  Ring buffer to retrieve the pointer for
+		 *
+		 *  \return Pointer to the oldest stored element
+		 */
+		static inline uint8_t* BridgeRingBuffer_GetTailPtr(BridgeRingBuffer_t* const Buffer) ATTR_WARN_UNUSED_RESULT;
+		static inline uint8_t* BridgeRingBuffer_GetTailPtr(BridgeRingBuffer_t* const Buffer)
+		{
+			return &Buffer->Data[Buffer->Tail];
+		}
+
+		/** Publishes elements written directly into the ring buffer storage by the producer, making them visible to the
+		 *  consumer. The count must not exceed the value last returned by \ref BridgeRingBuffer_GetFreeSpan().
+		 *
+		 *  \param[in,out] Buffer  Ring buffer to update
+		 *  \param[in]     Count   Number of elements written at the head of the buffer
+		 */
+		static inline void BridgeRingBuffer_CommitInsert(BridgeRingBuffer_t* const Buffer,
+		                                                 const uint8_t Count)
+		{
+			GCC_MEMORY_BARRIER();
+			Buffer->Head = ((Buffer->Head + Count) & Buffer->Mask);
+		}
+
+		/** Releases elements read directly from the ring buffer storage by the consumer, making their space available to
+		 *  the producer. The count must not exceed the value last returned by \ref BridgeRingBuffer_GetDataSpan().
+		 *
+		 *  \param[in,out] Buffer  Ring buffer to update
+		 *  \param[in]     Count   Number of elements read from the tail of the buffer
+		 */
+		static inline void BridgeRingBuffer_CommitRemove(BridgeRingBuffer_t* const Buffer,
+		                                                 const uint8_t Count)
+		{
+			GCC_MEMORY_BARRIER();
+			Buffer->Tail = ((Buffer->Tail + Count) & Buffer->Mask);
+		}
+
+#endif
+
@@ -0,0 +1,239 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Trace of the most recently processed V2 commands, with a latency histogram of each command, read out by the host
+ *  with the vendor specific CMD_READ_COMMAND_TRACE command.
+ */
+
+#define  INCLUDE_FROM_COMMANDTRACE_C
+#include "CommandTrace.h"
+
+#if defined(ENABLE_COMMAND_TRACE)
+
+/** Record of the command currently being processed, filled in as it is processed. */
+CommandTrace_Record_t CommandTrace_Current;
+
+/** Records and latency histograms of the trace, in memory provided by the application. */
+static CommandTrace_Storage_t* TraceStorage;
+
+/** Index of the next record to be overwritten in the trace's records. */
+static uint8_t TraceHead;
+
+/** Number of commands processed since the trace was last cleared. */
+static uint32_t TotalCommands;
+
+/** Number of the trace's latency histograms in use. */
+static uint8_t TotalHistograms;
+
+
+/** Initializes an empty command trace in the given memory, which must not be used for anything else until the
+ *  device is next reset.
+ *
+ *  \param[in] Storage  Memory where the trace's records and latency histograms are to be kept
+ */
+void CommandTrace_Init(CommandTrace_Storage_t* const Storage)
+{
+	memset(Storage, 0, sizeof(CommandTrace_Storage_t));
+
+	TraceStorage    = Storage;
+	TraceHead       = 0;
+	TotalCommands   = 0;
+	TotalHistograms = 0;
+}
+
+/** Starts the trace record of a newly received command.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
+void CommandTrace_Begin(const uint8_t V2Command)
+{
+	CommandTrace_Current.Command     = V2Command;
+	CommandTrace_Current.SubCommand  = 0;
+	CommandTrace_Current.Status      = STATUS_CMD_UNKNOWN;
+	CommandTrace_Current.Polls       = 0;
+	CommandTrace_Current.StartTimeUS = Timebase_GetTimeUS();
+}
+
+/** Completes the trace record of the current command once the host has read its response, storing it in the trace
+ *  and counting it in its command's latency histogram.
+ */
+void CommandTrace_End(void)
+{
+	CommandTrace_Current.DurationUS = (Timebase_GetTimeUS() - CommandTrace_Current.StartTimeUS);
+
+	TraceStorage->Records[TraceHead] = CommandTrace_Current;
+	TraceHead = ((TraceHead + 1) & (COMMAND_TRACE_ENTRIES - 1));
+	TotalCommands++;
+
+	CommandTrace_Histogram_t* Histogram = CommandTrace_FindHistogram();
+
+	if (!(Histogram))
+	  return;
+
+	/* Find the bin of the duration, each covering four times the durations of the one before */
+	uint8_t  Bin      = 0;
+	uint32_t BinLimit = COMMAND_TRACE_FIRST_BIN_US;
+
+	while ((Bin < (COMMAND_TRACE_HISTOGRAM_BINS - 1)) && (CommandTrace_Current.DurationUS >= BinLimit))
+	{
+		Bin++;
+		BinLimit <<= 2;
+	}
+
+	if (Histogram->Counts[Bin] != UINT16_MAX)
+	  Histogram->Counts[Bin]++;
+}
+
+/** Retrieves the latency histogram of the current command, allocating one if it has none and a free one remains.
+ *
+ *  \return Pointer to the command's histogram, or \c NULL if all histograms are in use by other commands
+ */
+static CommandTrace_Histogram_t* CommandTrace_FindHistogram(void)
+{
+	for (uint8_t HistogramIndex = 0; HistogramIndex < TotalHistograms; HistogramIndex++)
+	{
+		CommandTrace_Histogram_t* Histogram = &TraceStorage->Histograms[HistogramIndex];
+
+		if ((Histogram->Command == CommandTrace_Current.Command) &&
+		    (Histogram->SubCommand == CommandTrace_Current.SubCommand))
+		{
+			return Histogram;
+		}
+	}
+
+	if (TotalHistograms == COMMAND_TRACE_HISTOGRAMS)
+	  return NULL;
+
+	CommandTrace_Histogram_t* Histogram = &TraceStorage->Histograms[TotalHistograms++];
+
+	Histogram->Command    = CommandTrace_Current.Command;
+	Histogram->SubCommand = CommandTrace_Current.SubCommand;
+
+	return Histogram;
+}
+
+/** Writes a byte to the response for the host, sending the response packet each time the endpoint bank fills.
+ *
+ *  \param[in] Byte  Byte to write to the response
+ */
+static void CommandTrace_WriteByte(const uint8_t Byte)
+{
+	Endpoint_Write_8(Byte);
+
+	if (!(Endpoint_IsReadWriteAllowed()))
+	{
+		Endpoint_ClearIN();
+		Endpoint_WaitUntilReady();
+	}
+}
+
+/** Writes a 16-bit value to the response for the host, most significant byte first.
+ *
+ *  \param[in] Value  Value to write to the response
+ */
+static void CommandTrace_WriteBE16(const uint16_t Value)
+{
+	CommandTrace_WriteByte(Value >> 8);
+	CommandTrace_WriteByte(Value & 0xFF);
+}
+
+/** Writes a 32-bit value to the response for the host, most significant byte first.
+ *
+ *  \param[in] Value  Value to write to the response
+ */
+static void CommandTrace_WriteBE32(const uint32_t Value)
+{
+	CommandTrace_WriteBE16(Value >> 16);
+	CommandTrace_WriteBE16(Value & 0xFFFF);
+}
+
+/** Handler for the vendor specific CMD_READ_COMMAND_TRACE command, returning the records of the most recently
+ *  processed commands oldest first, followed by the latency histogram of each command, and optionally clearing the
+ *  trace afterwards. The command reading the trace is itself only traced once it has completed.
+ */
+void CommandTrace_ReadTrace(void)
+{
+	uint8_t ClearTrace = Endpoint_Read_8();
+
+	Endpoint_ClearOUT();
+	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
+	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
+
+	uint8_t TotalRecords = MIN(TotalCommands, COMMAND_TRACE_ENTRIES);
+
+	CommandTrace_WriteByte(CMD_READ_COMMAND_TRACE);
+	CommandTrace_WriteByte(STATUS_CMD_OK);
+	CommandTrace_SetStatus(STATUS_CMD_OK);
+
+	CommandTrace_WriteBE32(TotalCommands);
+	CommandTrace_WriteByte(TotalRecords);
+
+	for (uint8_t RecordIndex = 0; RecordIndex < TotalRecords; RecordIndex++)
+	{
+		const CommandTrace_Record_t* Record =
+		    &TraceStorage->Records[(TraceHead - TotalRecords + RecordIndex) & (COMMAND_TRACE_ENTRIES - 1)];
+
+		CommandTrace_WriteByte(Record->Command);
+		CommandTrace_WriteByte(Record->SubCommand);
+		CommandTrace_WriteByte(Record->Status);
+		CommandTrace_WriteBE32(Record->StartTimeUS);
+		CommandTrace_WriteBE32(Record->DurationUS);
+		CommandTrace_WriteBE16(Record->Polls);
+	}
+
+	CommandTrace_WriteByte(TotalHistograms);
+	CommandTrace_WriteByte(COMMAND_TRACE_HISTOGRAM_BINS);
+
+	for (uint8_t HistogramIndex = 0; HistogramIndex < TotalHistograms; HistogramIndex++)
+	{
+		const CommandTrace_Histogram_t* Histogram = &TraceStorage->Histograms[HistogramIndex];
+
+		CommandTrace_WriteByte(Histogram->Command);
+		CommandTrace_WriteByte(Histogram->SubCommand);
+
+		for (uint8_t Bin = 0; Bin < COMMAND_TRACE_HISTOGRAM_BINS; Bin++)
+		  CommandTrace_WriteBE16(Histogram->Counts[Bin]);
+	}
+
+	/* Full banks have already been sent, so this ends the response with a short packet or a ZLP */
+	Endpoint_ClearIN();
+
+	if (ClearTrace)
+	{
+		TraceHead       = 0;
+		TotalCommands   = 0;
+		TotalHistograms = 0;
+		memset(TraceStorage->Histograms, 0, sizeof(TraceStorage->Histograms));
+	}
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Header file for CommandTrace.c.
+ */
+
+#ifndef _COMMAND_TRACE_
+#define _COMMAND_TRACE_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <stdint.h>
+		#include <string.h>
+
+		#include <LUFA/Drivers/USB/USB.h>
+
+		#include "../Descriptors.h"
+		#include "V2ProtocolConstants.h"
+		#include "Timebase.h"
+		#include "Config/AppConfig.h"
+
+	/* Macros: */
+		#if (!defined(COMMAND_TRACE_ENTRIES) || defined(__DOXYGEN__))
+			/** Number of the most recent commands kept in the command trace. Must be a power of two no larger than 128. */
+			#define COMMAND_TRACE_ENTRIES          8
+		#endif
+
+		#if (!defined(COMMAND_TRACE_HISTOGRAMS) || defined(__DOXYGEN__))
+			/** Number of distinct commands whose latency histogram is kept by the command trace. */
+			#define COMMAND_TRACE_HISTOGRAMS       12
+		#endif
+
+		#if ((COMMAND_TRACE_ENTRIES & (COMMAND_TRACE_ENTRIES - 1)) || (COMMAND_TRACE_ENTRIES > 128))
+			#error COMMAND_TRACE_ENTRIES must be a power of two no larger than 128.
+		#endif
+
+		/** Number of bins of each latency histogram. Each bin covers four times the durations of the one before, the
+		 *  first covering commands shorter than \ref COMMAND_TRACE_FIRST_BIN_US and the last all longer commands.
+		 */
+		#define COMMAND_TRACE_HISTOGRAM_BINS   8
+
+		/** Upper limit of the first latency histogram bin, in microseconds. */
+		#define COMMAND_TRACE_FIRST_BIN_US     64
+
+	/* Type Defines: */
+		/** Type define for a command trace record, describing a single processed V2 command. */
+		typedef struct
+		{
+			uint8_t  Command; /**< V2 command byte */
+			uint8_t  SubCommand; /**< XPROG command byte of a CMD_XPROG command, zero for other commands */
+			uint8_t  Status; /**< Last status byte written to the command's response */
+			uint32_t StartTimeUS; /**< Timebase time at which processing of the command started */
+			uint32_t DurationUS; /**< Time from the start of the command until the host had read its response */
+			uint16_t Polls; /**< Iterations of the target completion and busy wait loops, saturating */
+		} CommandTrace_Record_t;
+
+		/** Type define for the latency histogram of a single command. */
+		typedef struct
+		{
+			uint8_t  Command; /**< V2 command byte */
+			uint8_t  SubCommand; /**< XPROG command byte of a CMD_XPROG command, zero for other commands */
+			uint16_t Counts[COMMAND_TRACE_HISTOGRAM_BINS]; /**< Number of commands in each latency bin, saturating */
+		} CommandTrace_Histogram_t;
+
+		/** Type define for the records and latency histograms of the command trace. The memory for these is provided
+		 *  by the application, so that it can be shared with data that is never in use at the same time.
+		 */
+		typedef struct
+		{
+			CommandTrace_Record_t    Records[COMMAND_TRACE_ENTRIES]; /**< Most recently processed commands, in a circular buffer */
+			CommandTrace_Histogram_t Histograms[COMMAND_TRACE_HISTOGRAMS]; /**< Latency histogram of each traced command */
+		} CommandTrace_Storage_t;
+
+	/* External Variables: */
+		#if defined(ENABLE_COMMAND_TRACE)
+		extern CommandTrace_Record_t CommandTrace_Current;
+		#endif
+
+	/* Function Prototypes: */
+		#if defined(ENABLE_COMMAND_TRACE)
+		void CommandTrace_Init(CommandTrace_Storage_t* const Storage);
+		void CommandTrace_Begin(const uint8_t V2Command);
+		void CommandTrace_End(void);
+		void CommandTrace_ReadTrace(void);
+
+			#if defined(INCLUDE_FROM_COMMANDTRACE_C)
+			static CommandTrace_Histogram_t* CommandTrace_FindHistogram(void);
+			static void CommandTrace_WriteByte(const uint8_t Byte);
+			static void CommandTrace_WriteBE16(const uint16_t Value);
+			static void CommandTrace_WriteBE32(const uint32_t Value);
+			#endif
+		#endif
+
+	/* Inline Functions: */
+		/** Records the XPROG command byte of the command being processed, so that each XPROG command is traced
+		 *  separately.
+		 *
+		 *  \param[in] XPROGCommand  XPROG command byte of the command
+		 */
+		static inline void CommandTrace_SetSubCommand(const uint8_t XPROGCommand)
+		{
+			#if defined(ENABLE_COMMAND_TRACE)
+			CommandTrace_Current.SubCommand = XPROGCommand;
+			#endif
+		}
+
+		/** Records a status byte written to the response of the command being processed.
+		 *
+		 *  \param[in] Status  V2 protocol status byte
+		 */
+		static inline void CommandTrace_SetStatus(const uint8_t Status)
+		{
+			#if defined(ENABLE_COMMAND_TRACE)
+			CommandTrace_Current.Status = Status;
+			#endif
+		}
+
+		/** Counts an iteration of a loop waiting for the target to complete an operation. */
+		static inline void CommandTrace_CountPoll(void)
+		{
+			#if defined(ENABLE_COMMAND_TRACE)
+			if (CommandTrace_Current.Polls != UINT16_MAX)
+			  CommandTrace_Current.Polls++;
+			#endif
+		}
+
+#endif
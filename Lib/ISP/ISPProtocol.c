@@ -33,74 +33,572 @@
  *  ISP Protocol handler, to process V2 Protocol wrapped ISP commands used in Atmel programmer devices.
  */
 
+#define  INCLUDE_FROM_ISPPROTOCOL_C
 #include "ISPProtocol.h"
 
 #if defined(ENABLE_ISP_PROTOCOL) || defined(__DOXYGEN__)
 
-/** Handler for the CMD_ENTER_PROGMODE_ISP command, which attempts to enter programming mode on
- *  the attached device, returning success or failure back to the host.
+/** Completion check of the last page write, when it is polled. Rather than wait for the target to finish programming
+ *  the page before responding, the response is sent straight away and the check is deferred until the target is next
+ *  accessed, so that the page is programmed while the response and the host's next command are in transit.
  */
-void ISPProtocol_EnterISPMode(void)
+static struct
 {
-	V2Params_SetParameterValue(PARAM_VTARGET, 50);
-	struct
+	uint8_t  ProgrammingMode; /**< Programming mode of the deferred write, or zero if there is none */
+	uint16_t PollAddress; /**< Address to poll for the written value, in data polling mode */
+	uint8_t  PollValue; /**< Value read back while the write is in progress, in data polling mode */
+	uint8_t  DelayMS; /**< Write delay in milliseconds, if the completion check falls back to a timed delay */
+	uint8_t  ReadMemCommand; /**< Memory read command used to poll for the written value */
+	uint8_t  Status; /**< Failed status of a check finished by a command that cannot report it, or STATUS_CMD_OK */
+} DeferredCompletion;
+
+#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+/** Page write times measured for recently programmed devices, kept in RAM by device signature. */
+static ISPProtocol_WriteTimingEntry_t WriteTimingTable[ISP_WRITE_TIMING_ENTRIES];
+
+/** Timing of page writes to the target. Once the longest write time of a memory has been measured for the device in
+ *  programming mode, it is used in place of the host's worst case delay for its timed page writes.
+ */
+static struct
+{
+	ISPProtocol_WriteTimingEntry_t* Entry; /**< Write times of the device in programming mode, or NULL if it has none */
+	uint32_t StartTimeUS; /**< Time at which the last page write was started */
+	uint8_t  Memory; /**< Memory of the last page write, zero for FLASH and one for EEPROM */
+} PageWriteTiming;
+#endif
+
+#if defined(ENABLE_WRITE_SKIP)
+/** Indicates that the target's FLASH has been erased since programming mode was entered, so that any page with data
+ *  other than 0xFF must differ from the target and is written without first being compared against it.
+ */
+static bool FlashErased;
+
+/** Indicates that data has been loaded into the target's page buffer without the page being written yet. Each location
+ *  of the page buffer can only be loaded once between page writes, so no page may be skipped while this is set.
+ */
+static bool PageBufferLoaded;
+#endif
+
+#if defined(ISP_AUTO_SCK)
+/** ISP speeds negotiated in automatic SCK mode, stored in EEPROM by device signature. */
+static ISPProtocol_SCKCacheEntry_t EEMEM EEPROM_SCKCache[ISP_AUTO_SCK_CACHE_ENTRIES];
+#endif
+
+/** Waits for any page write whose completion check was deferred to finish in the target, for a command such as a
+ *  read that cannot report a failed write without the host mistaking it for a failure of its own. A failure is instead
+ *  held for the next command that calls \ref ISPProtocol_CompleteDeferredWrite().
+ */
+static void ISPProtocol_FinishDeferredWrite(void)
+{
+	if (!(DeferredCompletion.ProgrammingMode))
+	  return;
+
+	uint8_t ProgrammingMode = DeferredCompletion.ProgrammingMode;
+	DeferredCompletion.ProgrammingMode = 0;
+
+	uint8_t ProgrammingStatus = ISPProtocol_WaitForPageComplete(ProgrammingMode, DeferredCompletion.PollAddress,
+	                                                            DeferredCompletion.PollValue,
+	                                                            DeferredCompletion.DelayMS,
+	                                                            DeferredCompletion.ReadMemCommand);
+
+	if (DeferredCompletion.Status == STATUS_CMD_OK)
+	  DeferredCompletion.Status = ProgrammingStatus;
+}
+
+/** Waits for any page write whose completion check was deferred to finish in the target. The caller must report a
+ *  failure in the response to the command it is processing, as the host has already been told the page was written;
+ *  only program, erase and leave programming mode commands do so.
+ *
+ *  \return V2 Protocol status code of the first deferred completion check to fail since the last call, or
+ *          STATUS_CMD_OK if none failed
+ */
+uint8_t ISPProtocol_CompleteDeferredWrite(void)
+{
+	ISPProtocol_FinishDeferredWrite();
+
+	uint8_t DeferredStatus = DeferredCompletion.Status;
+	DeferredCompletion.Status = STATUS_CMD_OK;
+
+	return DeferredStatus;
+}
+
+/** Records the start of a page write in the target, once its PROGRAM PAGE instruction has been sent, so that the time
+ *  the target takes to write the page can be measured.
+ *
+ *  \param[in] EEPROMMemory  Boolean \c true if the page is being written to EEPROM, \c false for FLASH
+ */
+static void ISPProtocol_StartPageWrite(const bool EEPROMMemory)
+{
+	#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+	ISPTarget_FlushSPI();
+
+	PageWriteTiming.StartTimeUS = Timebase_GetTimeUS();
+	PageWriteTiming.Memory      = EEPROMMemory;
+	#endif
+}
+
+#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+/** Selects the page write times of the device that has just entered programming mode, by its signature. A device not
+ *  yet in the table replaces the first free entry, or else the entry its signature hashes to.
+ */
+static void ISPProtocol_SelectWriteTiming(void)
+{
+	uint8_t Signature[3];
+
+	for (uint8_t SignatureByte = 0; SignatureByte < 3; SignatureByte++)
+	  Signature[SignatureByte] = ISPTarget_TransferInstruction(READ_SIGNATURE_CMD, 0x00, SignatureByte, 0x00);
+
+	/* A missing target reads as all zeros or all ones, and has no write times of its own */
+	if ((Signature[0] == 0x00) || (Signature[0] == 0xFF))
+	  return;
+
+	uint8_t TableSlot = ((Signature[1] ^ Signature[2]) % ISP_WRITE_TIMING_ENTRIES);
+
+	for (uint8_t Entry = ISP_WRITE_TIMING_ENTRIES; Entry-- > 0;)
 	{
-		uint8_t TimeoutMS;
-		uint8_t PinStabDelayMS;
-		uint8_t ExecutionDelayMS;
-		uint8_t SynchLoops;
-		uint8_t ByteDelay;
-		uint8_t PollValue;
-		uint8_t PollIndex;
-		uint8_t EnterProgBytes[4];
-	} Enter_ISP_Params;
+		if (!(WriteTimingTable[Entry].Signature[0]))
+		  TableSlot = Entry;
 
-	Endpoint_Read_Stream_LE(&Enter_ISP_Params, sizeof(Enter_ISP_Params), NULL);
+		if (!(memcmp(WriteTimingTable[Entry].Signature, Signature, sizeof(Signature))))
+		{
+			PageWriteTiming.Entry = &WriteTimingTable[Entry];
+			return;
+		}
+	}
 
-	Endpoint_ClearOUT();
-	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
-	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
+	PageWriteTiming.Entry = &WriteTimingTable[TableSlot];
 
-	uint8_t ResponseStatus = STATUS_CMD_FAILED;
+	memcpy(PageWriteTiming.Entry->Signature, Signature, sizeof(Signature));
+	memset(PageWriteTiming.Entry->WriteTimeCounts, 0, sizeof(PageWriteTiming.Entry->WriteTimeCounts));
+}
 
-	CurrentAddress = 0;
+/** Records the time the target has taken to write the last page, once a completion check that found it still busy
+ *  has ended, as the device's write time for the memory if it is the longest yet.
+ */
+static void ISPProtocol_RecordPageWriteTime(void)
+{
+	if (!(PageWriteTiming.Entry))
+	  return;
 
-	/* Perform execution delay, initialize SPI bus */
-	ISPProtocol_DelayMS(Enter_ISP_Params.ExecutionDelayMS);
-	ISPTarget_EnableTargetISP();
+	uint32_t  WriteTimeCounts = ((Timebase_GetTimeUS() - PageWriteTiming.StartTimeUS) / TIMEBASE_US_PER_COUNT);
+	uint16_t* LongestCounts   = &PageWriteTiming.Entry->WriteTimeCounts[PageWriteTiming.Memory];
 
-	ISPTarget_ChangeTargetResetLine(true);
-	ISPProtocol_DelayMS(Enter_ISP_Params.PinStabDelayMS);
+	if (WriteTimeCounts > *LongestCounts)
+	  *LongestCounts = MIN(WriteTimeCounts, UINT16_MAX);
+}
+
+/** Waits for a page write whose completion is timed rather than polled. Once the device's write time for the memory
+ *  is known, the known time plus a quarter is waited for if that is shorter than the host's delay, after which the
+ *  target's RDY/BSY flag is polled to confirm the write has finished, up to the host's delay. Otherwise the host's
+ *  delay is waited out in full, polling the RDY/BSY flag to measure the write time of a target that reports itself
+ *  busy straight after the write is started, and so is known to support RDY/BSY polling.
+ *
+ *  \param[in] DelayMS  Time in milliseconds the page write can take, as given by the host
+ */
+static void ISPProtocol_WaitForTimedPageWrite(const uint8_t DelayMS)
+{
+	uint32_t DelayUS   = ((uint32_t)DelayMS * 1000);
+	uint32_t LearnedUS = 0;
+
+	if (PageWriteTiming.Entry)
+	  LearnedUS = ((uint32_t)PageWriteTiming.Entry->WriteTimeCounts[PageWriteTiming.Memory] * TIMEBASE_US_PER_COUNT);
+
+	uint32_t LearnedWaitUS = (LearnedUS + (LearnedUS >> 2) + TIMEBASE_US_PER_COUNT);
+	bool     EndWhenReady  = (LearnedUS && (LearnedWaitUS < DelayUS));
+	bool     PollTarget    = EndWhenReady;
+	bool     TargetWasBusy = false;
+
+	if (EndWhenReady)
+	{
+		while (!(Timebase_HasElapsed(PageWriteTiming.StartTimeUS + LearnedWaitUS)))
+		  CommandTrace_CountPoll();
+	}
+	else
+	{
+		TargetWasBusy = PollTarget = (ISPTarget_TransferInstruction(0xF0, 0x00, 0x00, 0x00) & 0x01);
+	}
+
+	while (!(Timebase_HasElapsed(PageWriteTiming.StartTimeUS + DelayUS + TIMEBASE_US_PER_COUNT)))
+	{
+		CommandTrace_CountPoll();
+
+		if (!(PollTarget))
+		  continue;
+
+		if (ISPTarget_TransferInstruction(0xF0, 0x00, 0x00, 0x00) & 0x01)
+		{
+			TargetWasBusy = true;
+			continue;
+		}
+
+		/* A check that found the target still busy has measured the write time to within one poll */
+		if (TargetWasBusy)
+		  ISPProtocol_RecordPageWriteTime();
+
+		/* While the write time is being measured, the rest of the host's delay is still waited out */
+		if (EndWhenReady)
+		  break;
+
+		PollTarget = false;
+	}
+
+	Timebase_StartTimeout(COMMAND_TIMEOUT_US);
+}
+#endif
+
+/** Waits until a page write started in the target has completed, via the check mode given and using the given
+ *  parameters. A page whose data all matches the poll value cannot be value polled, and is instead waited on for the
+ *  host's fixed delay. With ISP_ADAPTIVE_WRITE_DELAY, timed page writes are instead waited on with
+ *  \ref ISPProtocol_WaitForTimedPageWrite(), and polled ones measure the device's write time.
+ *
+ *  \param[in] ProgrammingMode  Programming mode used and completion check to use, a mask of \c PROG_MODE_* constants
+ *  \param[in] PollAddress      Memory address to poll for completion, or zero if no byte differs from the poll value
+ *  \param[in] PollValue        Poll value to check against if polling check mode used
+ *  \param[in] DelayMS          Milliseconds to delay before returning if delay check mode used
+ *  \param[in] ReadMemCommand   Device low-level READ MEMORY command to send if value check mode used
+ *
+ *  \return V2 Protocol status \ref STATUS_CMD_OK if the no timeout occurred, \ref STATUS_RDY_BSY_TOUT or
+ *          \ref STATUS_CMD_TOUT otherwise
+ */
+static uint8_t ISPProtocol_WaitForPageComplete(uint8_t ProgrammingMode,
+                                               const uint16_t PollAddress,
+                                               const uint8_t PollValue,
+                                               const uint8_t DelayMS,
+                                               const uint8_t ReadMemCommand)
+{
+	/* Check if polling is enabled and possible, if not switch to timed delay mode */
+	if ((ProgrammingMode & PROG_MODE_PAGED_VALUE_MASK) && !(PollAddress))
+	  ProgrammingMode = (ProgrammingMode & ~PROG_MODE_PAGED_VALUE_MASK) | PROG_MODE_PAGED_TIMEDELAY_MASK;
+
+	#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+	if (ProgrammingMode & PROG_MODE_PAGED_TIMEDELAY_MASK)
+	{
+		ISPProtocol_WaitForTimedPageWrite(DelayMS);
+		return STATUS_CMD_OK;
+	}
+	#endif
+
+	uint8_t ProgrammingStatus = ISPTarget_WaitForProgComplete(ProgrammingMode, PollAddress, PollValue, DelayMS,
+	                                                          ReadMemCommand);
+
+	#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+	/* A polled check that found the target still busy has measured the write time to within one poll */
+	if ((ProgrammingStatus == STATUS_CMD_OK) && TargetBusyOnPoll)
+	  ISPProtocol_RecordPageWriteTime();
+	#endif
+
+	return ProgrammingStatus;
+}
+
+/** Releases the OUT endpoint once the given command has been completely read, discarding the Zero Length Packet
+ *  (ZLP) terminating commands that are a round multiple of the endpoint size, and switches to the IN endpoint for
+ *  the response.
+ *
+ *  \param[in] CommandParamBytes  Number of parameter bytes of the command, following the command byte itself
+ */
+static void ISPProtocol_ReleaseCommandData(const uint32_t CommandParamBytes)
+{
+	// The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+	// to catch this and discard it before continuing on with packet processing to prevent communication issues
+	if (((sizeof(uint8_t) + CommandParamBytes) % AVRISP_DATA_EPSIZE) == 0)
+	{
+		Endpoint_ClearOUT();
+		Endpoint_WaitUntilReady();
+	}
+
+	Endpoint_ClearOUT();
+	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
+	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
+}
+
+/** Attempts to synchronize with a target held in reset by sending it the Programming Enable instruction, pulsing its
+ *  /RESET line between attempts, until either the target echoes the expected value or the attempts run out.
+ *
+ *  \param[in] Enter_ISP_Params  Parameters of the CMD_ENTER_PROGMODE_ISP command issued by the host
+ *
+ *  \return V2 Protocol status code indicating whether the target has entered programming mode
+ */
+static uint8_t ISPProtocol_SynchronizeTarget(const ISPProtocol_EnterProgParams_t* const Enter_ISP_Params)
+{
+	uint8_t SynchLoops = Enter_ISP_Params->SynchLoops;
 
 	/* Continuously attempt to synchronize with the target until either the number of attempts specified
 	 * by the host has exceeded, or the the device sends back the expected response values */
-	while (Enter_ISP_Params.SynchLoops-- && TimeoutTicksRemaining)
+	while (SynchLoops-- && TimeoutRemaining)
 	{
 		uint8_t ResponseBytes[4];
 
 		for (uint8_t RByte = 0; RByte < sizeof(ResponseBytes); RByte++)
 		{
-			ISPProtocol_DelayMS(Enter_ISP_Params.ByteDelay);
-			ResponseBytes[RByte] = ISPTarget_TransferByte(Enter_ISP_Params.EnterProgBytes[RByte]);
+			ISPProtocol_DelayMS(Enter_ISP_Params->ByteDelay);
+			ResponseBytes[RByte] = ISPTarget_TransferByte(Enter_ISP_Params->EnterProgBytes[RByte]);
 		}
 
 		/* Check if polling disabled, or if the polled value matches the expected value */
-		if (!(Enter_ISP_Params.PollIndex) || (ResponseBytes[Enter_ISP_Params.PollIndex - 1] == Enter_ISP_Params.PollValue))
+		if (!(Enter_ISP_Params->PollIndex) || (ResponseBytes[Enter_ISP_Params->PollIndex - 1] == Enter_ISP_Params->PollValue))
+		  return STATUS_CMD_OK;
+
+		ISPTarget_ChangeTargetResetLine(false);
+		ISPProtocol_DelayMS(Enter_ISP_Params->PinStabDelayMS);
+		ISPTarget_ChangeTargetResetLine(true);
+		ISPProtocol_DelayMS(Enter_ISP_Params->PinStabDelayMS);
+	}
+
+	return STATUS_CMD_FAILED;
+}
+
+#if defined(ISP_AUTO_SCK)
+/** Resets the target and synchronizes with it again at the given ISP speed, after it has been accessed at a speed it
+ *  could not follow, as a corrupted instruction may have left it out of step with the programmer.
+ *
+ *  \param[in] Enter_ISP_Params  Parameters of the CMD_ENTER_PROGMODE_ISP command issued by the host
+ *  \param[in] SCKDuration       ISP speed to synchronize at, as an AVRStudio SCK duration parameter value
+ *
+ *  \return V2 Protocol status code indicating whether the target has entered programming mode again
+ */
+static uint8_t ISPProtocol_ResynchronizeTarget(const ISPProtocol_EnterProgParams_t* const Enter_ISP_Params,
+                                               const uint8_t SCKDuration)
+{
+	ISPTarget_SetSCKDuration(SCKDuration);
+
+	ISPTarget_ChangeTargetResetLine(false);
+	ISPProtocol_DelayMS(Enter_ISP_Params->PinStabDelayMS);
+	ISPTarget_ChangeTargetResetLine(true);
+	ISPProtocol_DelayMS(Enter_ISP_Params->PinStabDelayMS);
+
+	/* The search may have used up the command's timeout period, which must not prevent the target's recovery */
+	Timebase_StartTimeout(COMMAND_TIMEOUT_US);
+
+	return ISPProtocol_SynchronizeTarget(Enter_ISP_Params);
+}
+
+/** Reads the device signature and the first bytes of FLASH from the target at the current ISP speed, for comparison
+ *  against the same values read at another speed.
+ *
+ *  \param[out] Identity  Buffer of 3 + \ref ISP_AUTO_SCK_READBACK_BYTES bytes where the read values are to be stored
+ */
+static void ISPProtocol_ReadTargetIdentity(uint8_t* const Identity)
+{
+	for (uint8_t SignatureByte = 0; SignatureByte < 3; SignatureByte++)
+	  Identity[SignatureByte] = ISPTarget_TransferInstruction(READ_SIGNATURE_CMD, 0x00, SignatureByte, 0x00);
+
+	for (uint8_t FlashByte = 0; FlashByte < ISP_AUTO_SCK_READBACK_BYTES; FlashByte++)
+	{
+		uint8_t ReadCommand = READ_FLASH_LOW_BYTE_CMD;
+
+		if (FlashByte & 0x01)
+		  ReadCommand |= READ_WRITE_HIGH_BYTE_MASK;
+
+		Identity[3 + FlashByte] = ISPTarget_TransferInstruction(ReadCommand, 0x00, (FlashByte >> 1), 0x00);
+	}
+}
+
+/** Raises the ISP speed of a target that has just entered programming mode at the speed set by the host, to the
+ *  fastest speed at which the device signature and the start of FLASH read back unchanged, less one step of margin.
+ *  The negotiated speed is cached in EEPROM by device signature; a cached speed is used directly if it still reads
+ *  back correctly, so that subsequent devices of the same type skip the search. After any speed fails to read back,
+ *  the target is reset and synchronized with again at the host's speed, and the selected speed must itself read back
+ *  correctly before it is used and cached; otherwise the host's speed is kept. The host's speed is never lowered,
+ *  and the host's SCK duration parameter is left unchanged.
+ *
+ *  \param[in] Enter_ISP_Params  Parameters of the CMD_ENTER_PROGMODE_ISP command issued by the host
+ *
+ *  \return V2 Protocol status code indicating whether the target is still in programming mode
+ */
+static uint8_t ISPProtocol_NegotiateSCKDuration(const ISPProtocol_EnterProgParams_t* const Enter_ISP_Params)
+{
+	uint8_t HostSCKDuration = V2Params_GetParameterValue(PARAM_SCK_DURATION);
+	uint8_t ReferenceIdentity[3 + ISP_AUTO_SCK_READBACK_BYTES];
+	uint8_t Identity[3 + ISP_AUTO_SCK_READBACK_BYTES];
+
+	if (!(HostSCKDuration))
+	  return STATUS_CMD_OK;
+
+	ISPProtocol_ReadTargetIdentity(ReferenceIdentity);
+
+	/* A missing target reads as all zeros or all ones, which would match at any speed */
+	for (uint8_t SignatureByte = 0; SignatureByte < 3; SignatureByte++)
+	{
+		if ((ReferenceIdentity[SignatureByte] == 0x00) || (ReferenceIdentity[SignatureByte] == 0xFF))
+		  return STATUS_CMD_OK;
+	}
+
+	ISPProtocol_SCKCacheEntry_t CacheEntry;
+	uint8_t CacheSlot = ((ReferenceIdentity[1] ^ ReferenceIdentity[2]) % ISP_AUTO_SCK_CACHE_ENTRIES);
+
+	/* Look for the device in the cache, otherwise use the first free entry or replace the hashed one */
+	for (uint8_t Entry = ISP_AUTO_SCK_CACHE_ENTRIES; Entry-- > 0;)
+	{
+		eeprom_read_block(&CacheEntry, &EEPROM_SCKCache[Entry], sizeof(CacheEntry));
+
+		if (CacheEntry.Signature[0] == 0xFF)
+		  CacheSlot = Entry;
+
+		if (!(memcmp(CacheEntry.Signature, ReferenceIdentity, sizeof(CacheEntry.Signature))))
 		{
-			ResponseStatus = STATUS_CMD_OK;
+			CacheSlot = Entry;
+
+			if (CacheEntry.SCKDuration < HostSCKDuration)
+			{
+				ISPTarget_SetSCKDuration(CacheEntry.SCKDuration);
+				ISPProtocol_ReadTargetIdentity(Identity);
+
+				if (!(memcmp(Identity, ReferenceIdentity, sizeof(Identity))))
+				  return STATUS_CMD_OK;
+
+				/* The cached speed is no longer reliable, so the target must be recovered before a new search */
+				if (ISPProtocol_ResynchronizeTarget(Enter_ISP_Params, HostSCKDuration) != STATUS_CMD_OK)
+				  return STATUS_CMD_FAILED;
+			}
+
 			break;
 		}
-		else
+	}
+
+	/* Step the speed up from the host's until the target no longer reads back correctly */
+	uint8_t FastestSCKDuration = HostSCKDuration;
+	bool    TargetOutOfStep    = false;
+
+	for (uint8_t SCKDuration = MIN(HostSCKDuration, ISP_HARDWARE_SCK_DURATIONS); SCKDuration-- > 0;)
+	{
+		ISPTarget_SetSCKDuration(SCKDuration);
+		ISPProtocol_ReadTargetIdentity(Identity);
+
+		if (memcmp(Identity, ReferenceIdentity, sizeof(Identity)))
 		{
-			ISPTarget_ChangeTargetResetLine(false);
-			ISPProtocol_DelayMS(Enter_ISP_Params.PinStabDelayMS);
-			ISPTarget_ChangeTargetResetLine(true);
-			ISPProtocol_DelayMS(Enter_ISP_Params.PinStabDelayMS);
+			TargetOutOfStep = true;
+			break;
 		}
+
+		if (!(TimeoutRemaining))
+		  break;
+
+		FastestSCKDuration = SCKDuration;
 	}
 
+	if (TargetOutOfStep && (ISPProtocol_ResynchronizeTarget(Enter_ISP_Params, HostSCKDuration) != STATUS_CMD_OK))
+	  return STATUS_CMD_FAILED;
+
+	/* Nothing faster than the host's speed read back correctly, so there is nothing to select or cache */
+	if (FastestSCKDuration == HostSCKDuration)
+	{
+		ISPTarget_SetSCKDuration(HostSCKDuration);
+		return STATUS_CMD_OK;
+	}
+
+	/* The selected speed must read back correctly in its own right before it is used or cached */
+	uint8_t SelectedSCKDuration = (FastestSCKDuration + 1);
+
+	ISPTarget_SetSCKDuration(SelectedSCKDuration);
+	ISPProtocol_ReadTargetIdentity(Identity);
+
+	if (memcmp(Identity, ReferenceIdentity, sizeof(Identity)))
+	  return ISPProtocol_ResynchronizeTarget(Enter_ISP_Params, HostSCKDuration);
+
+	memcpy(CacheEntry.Signature, ReferenceIdentity, sizeof(CacheEntry.Signature));
+	CacheEntry.SCKDuration = SelectedSCKDuration;
+	eeprom_update_block(&CacheEntry, &EEPROM_SCKCache[CacheSlot], sizeof(CacheEntry));
+
+	return STATUS_CMD_OK;
+}
+#endif
+
+#if defined(ENABLE_WRITE_SKIP)
+/** Compares a page of data to be programmed against the current contents of the target's memory at the current
+ *  address, so that writing an unchanged page can be skipped.
+ *
+ *  \param[in] V2Command          Issued V2 Protocol command byte from the host
+ *  \param[in] PageData           Data to be programmed into the page
+ *  \param[in] PageBytes          Number of bytes of data to be programmed
+ *  \param[in] ReadMemoryCommand  Low level device command to read a byte of the memory being programmed
+ *
+ *  \return Boolean \c true if the target's memory already holds the given data
+ */
+static bool ISPProtocol_PageMatchesTarget(const uint8_t V2Command,
+                                          const uint8_t* PageData,
+                                          const uint16_t PageBytes,
+                                          uint8_t ReadMemoryCommand)
+{
+	uint16_t ReadAddress = (CurrentAddress & 0xFFFF);
+
+	/* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
+	if (MustLoadExtendedAddress)
+	{
+		ISPTarget_LoadExtendedAddress();
+		MustLoadExtendedAddress = false;
+	}
+
+	ReadMemoryCommand &= ~READ_WRITE_HIGH_BYTE_MASK;
+
+	for (uint16_t CurrentByte = 0; CurrentByte < PageBytes; CurrentByte++)
+	{
+		ISPTarget_SendInstruction(ReadMemoryCommand, (ReadAddress >> 8), (ReadAddress & 0xFF), 0x00);
+
+		/* FLASH alternates between the low and high byte of each word, EEPROM moves on after every byte */
+		if (V2Command == CMD_PROGRAM_FLASH_ISP)
+		  ReadMemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
+
+		if ((V2Command == CMD_PROGRAM_EEPROM_ISP) || !(ReadMemoryCommand & READ_WRITE_HIGH_BYTE_MASK))
+		  ReadAddress++;
+
+		if (ISPTarget_ReadQueuedByte() != PageData[CurrentByte])
+		  return false;
+	}
+
+	return true;
+}
+#endif
+
+/** Handler for the CMD_ENTER_PROGMODE_ISP command, which attempts to enter programming mode on
+ *  the attached device, returning success or failure back to the host.
+ */
+void ISPProtocol_EnterISPMode(void)
+{
+	#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+	PageWriteTiming.Entry = NULL;
+	#endif
+
+	#if defined(ENABLE_WRITE_SKIP)
+	FlashErased      = false;
+	PageBufferLoaded = false;
+	#endif
+
+	V2Params_SetParameterValue(PARAM_VTARGET, 50);
+	ISPProtocol_EnterProgParams_t Enter_ISP_Params;
+
+	Endpoint_Read_Stream_LE(&Enter_ISP_Params, sizeof(Enter_ISP_Params), NULL);
+
+	Endpoint_ClearOUT();
+	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
+	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
+
+	/* A host entering programming mode again without leaving it may have left the last page still programming, which
+	 * must finish before the target is sent Programming Enable; its result belongs to the abandoned session */
+	ISPProtocol_CompleteDeferredWrite();
+
+	CurrentAddress = 0;
+
+	/* Perform execution delay, initialize SPI bus */
+	ISPProtocol_DelayMS(Enter_ISP_Params.ExecutionDelayMS);
+	ISPTarget_EnableTargetISP();
+
+	ISPTarget_ChangeTargetResetLine(true);
+	ISPProtocol_DelayMS(Enter_ISP_Params.PinStabDelayMS);
+
+	uint8_t ResponseStatus = ISPProtocol_SynchronizeTarget(&Enter_ISP_Params);
+
+	#if defined(ISP_AUTO_SCK)
+	if (ResponseStatus == STATUS_CMD_OK)
+	  ResponseStatus = ISPProtocol_NegotiateSCKDuration(&Enter_ISP_Params);
+	#endif
+
+	#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+	if (ResponseStatus == STATUS_CMD_OK)
+	  ISPProtocol_SelectWriteTiming();
+	#endif
+
 	Endpoint_Write_8(CMD_ENTER_PROGMODE_ISP);
-	Endpoint_Write_8(ResponseStatus);
+	V2Protocol_WriteStatus(ResponseStatus);
 	Endpoint_ClearIN();
 }
 
@@ -119,6 +617,9 @@ void ISPProtocol_LeaveISPMode(void)
 	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
+	/* The last page must finish programming before the target is released from reset */
+	uint8_t ResponseStatus = ISPProtocol_CompleteDeferredWrite();
+
 	/* Perform pre-exit delay, release the target /RESET, disable the SPI bus and perform the post-exit delay */
 	ISPProtocol_DelayMS(Leave_ISP_Params.PreDelayMS);
 	ISPTarget_ChangeTargetResetLine(false);
@@ -126,7 +627,7 @@ void ISPProtocol_LeaveISPMode(void)
 	ISPProtocol_DelayMS(Leave_ISP_Params.PostDelayMS);
 
 	Endpoint_Write_8(CMD_LEAVE_PROGMODE_ISP);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(ResponseStatus);
 	Endpoint_ClearIN();
 }
 
@@ -145,50 +646,109 @@ void ISPProtocol_ProgramMemory(uint8_t V2Command)
 		uint8_t  ProgrammingCommands[3];
 		uint8_t  PollValue1;
 		uint8_t  PollValue2;
-		uint8_t  ProgData[256]; // Note, the Jungo driver has a very short ACK timeout period, need to buffer the
-	} Write_Memory_Params;      // whole page and ACK the packet as fast as possible to prevent it from aborting
-
-	Endpoint_Read_Stream_LE(&Write_Memory_Params, (sizeof(Write_Memory_Params) -
-	                                               sizeof(Write_Memory_Params.ProgData)), NULL);
+		#if !defined(ISP_STREAM_PROGRAM_DATA)
+		uint8_t  ProgData[ISP_MAX_PROGRAM_BYTES]; // Note, the Jungo driver has a very short ACK timeout period, need to
+		#endif                                    // buffer the whole page and ACK the packet as fast as possible to
+	} Write_Memory_Params;                        // prevent it from aborting
+
+	#if defined(ISP_STREAM_PROGRAM_DATA)
+	const uint8_t ParamsSize = sizeof(Write_Memory_Params);
+	#else
+	const uint8_t ParamsSize = (sizeof(Write_Memory_Params) - sizeof(Write_Memory_Params.ProgData));
+	#endif
+
+	Endpoint_Read_Stream_LE(&Write_Memory_Params, ParamsSize, NULL);
 	Write_Memory_Params.BytesToWrite = SwapEndian_16(Write_Memory_Params.BytesToWrite);
 
-	if (Write_Memory_Params.BytesToWrite > sizeof(Write_Memory_Params.ProgData))
+	if (Write_Memory_Params.BytesToWrite > ISP_MAX_PROGRAM_BYTES)
 	{
 		Endpoint_ClearOUT();
 		Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
 		Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
 		Endpoint_Write_8(V2Command);
-		Endpoint_Write_8(STATUS_CMD_FAILED);
+		V2Protocol_WriteStatus(STATUS_CMD_FAILED);
 		Endpoint_ClearIN();
 		return;
 	}
 
+	#if !defined(ISP_STREAM_PROGRAM_DATA)
 	Endpoint_Read_Stream_LE(&Write_Memory_Params.ProgData, Write_Memory_Params.BytesToWrite, NULL);
+	ISPProtocol_ReleaseCommandData(ParamsSize + Write_Memory_Params.BytesToWrite);
+	#endif
 
-	// The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
-	// to catch this and discard it before continuing on with packet processing to prevent communication issues
-	if (((sizeof(uint8_t) + sizeof(Write_Memory_Params) - sizeof(Write_Memory_Params.ProgData)) +
-	    Write_Memory_Params.BytesToWrite) % AVRISP_DATA_EPSIZE == 0)
-	{
-		Endpoint_ClearOUT();
-		Endpoint_WaitUntilReady();
-	}
-
-	Endpoint_ClearOUT();
-	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
-	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
-
+	/* The target may still be programming the previous page, which must finish before new data is loaded */
+	uint8_t  DeferredStatus    = ISPProtocol_CompleteDeferredWrite();
 	uint8_t  ProgrammingStatus = STATUS_CMD_OK;
 	uint8_t  PollValue         = (V2Command == CMD_PROGRAM_FLASH_ISP) ? Write_Memory_Params.PollValue1 :
 	                                                                    Write_Memory_Params.PollValue2;
 	uint16_t PollAddress       = 0;
-	uint8_t* NextWriteByte     = Write_Memory_Params.ProgData;
 	uint16_t PageStartAddress  = (CurrentAddress & 0xFFFF);
+	uint16_t CurrentByte;
+
+	#if defined(ENABLE_WRITE_SKIP)
+	/* A page held entirely in this command can be skipped if writing it would not change the target's memory */
+	if ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK) &&
+	    (Write_Memory_Params.ProgrammingMode & PROG_MODE_COMMIT_PAGE_MASK) && !(PageBufferLoaded))
+	{
+		bool PageUnchanged = (V2Command == CMD_PROGRAM_FLASH_ISP);
+
+		/* Programming FLASH can only clear bits, so a page of all 0xFF never changes it */
+		for (CurrentByte = 0; PageUnchanged && (CurrentByte < Write_Memory_Params.BytesToWrite); CurrentByte++)
+		{
+			if (Write_Memory_Params.ProgData[CurrentByte] != 0xFF)
+			  PageUnchanged = false;
+		}
+
+		if (!(PageUnchanged) && !((V2Command == CMD_PROGRAM_FLASH_ISP) && FlashErased))
+		{
+			PageUnchanged = ISPProtocol_PageMatchesTarget(V2Command, Write_Memory_Params.ProgData,
+			                                              Write_Memory_Params.BytesToWrite,
+			                                              Write_Memory_Params.ProgrammingCommands[2]);
+		}
+
+		if (PageUnchanged)
+		{
+			/* Move on past the page as if it had been written */
+			if (V2Command == CMD_PROGRAM_FLASH_ISP)
+			{
+				CurrentAddress += (Write_Memory_Params.BytesToWrite >> 1);
+
+				if ((CurrentAddress & 0xFFFF) < PageStartAddress)
+				  MustLoadExtendedAddress = true;
+			}
+			else
+			{
+				CurrentAddress += Write_Memory_Params.BytesToWrite;
+			}
+
+			Endpoint_Write_8(V2Command);
+			V2Protocol_WriteStatus(DeferredStatus);
+			Endpoint_ClearIN();
+			return;
+		}
+	}
+	#endif
+
+	#if !defined(ISP_STREAM_PROGRAM_DATA)
+	uint8_t* NextWriteByte     = Write_Memory_Params.ProgData;
+	#endif
 
-	for (uint16_t CurrentByte = 0; CurrentByte < Write_Memory_Params.BytesToWrite; CurrentByte++)
+	for (CurrentByte = 0; CurrentByte < Write_Memory_Params.BytesToWrite; CurrentByte++)
 	{
+		#if defined(ISP_STREAM_PROGRAM_DATA)
+		/* Clock each byte into the target straight out of the endpoint bank, so that the host can send the next
+		 * packet while this one is being loaded into the target */
+		if (!(Endpoint_BytesInEndpoint()))
+		{
+			Endpoint_ClearOUT();
+			Endpoint_WaitUntilReady();
+		}
+
+		uint8_t ByteToWrite     = Endpoint_Read_8();
+		#else
 		uint8_t ByteToWrite     = *(NextWriteByte++);
+		#endif
 		uint8_t ProgrammingMode = Write_Memory_Params.ProgrammingMode;
 
 		/* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
@@ -198,10 +758,9 @@ void ISPProtocol_ProgramMemory(uint8_t V2Command)
 			MustLoadExtendedAddress = false;
 		}
 
-		ISPTarget_SendByte(Write_Memory_Params.ProgrammingCommands[0]);
-		ISPTarget_SendByte(CurrentAddress >> 8);
-		ISPTarget_SendByte(CurrentAddress & 0xFF);
-		ISPTarget_SendByte(ByteToWrite);
+		/* The last byte of the instruction is left shifting out while the next byte is prepared */
+		ISPTarget_SendInstruction(Write_Memory_Params.ProgrammingCommands[0], (CurrentAddress >> 8),
+		                          (CurrentAddress & 0xFF), ByteToWrite);
 
 		/* AVR FLASH addressing requires us to modify the write command based on if we are writing a high
 		 * or low byte at the current word address */
@@ -250,37 +809,230 @@ void ISPProtocol_ProgramMemory(uint8_t V2Command)
 		}
 	}
 
+	#if defined(ISP_STREAM_PROGRAM_DATA)
+	/* Discard any data left unread after a failed write, and release the command so the host can send the next */
+	if (CurrentByte < Write_Memory_Params.BytesToWrite)
+	  Endpoint_Discard_Stream(Write_Memory_Params.BytesToWrite - (CurrentByte + 1), NULL);
+
+	ISPProtocol_ReleaseCommandData(ParamsSize + Write_Memory_Params.BytesToWrite);
+	#endif
+
+	#if defined(ENABLE_WRITE_SKIP)
+	PageBufferLoaded = ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK) &&
+	                    !(Write_Memory_Params.ProgrammingMode & PROG_MODE_COMMIT_PAGE_MASK));
+	#endif
+
 	/* If the current page must be committed, send the PROGRAM PAGE command to the target */
 	if (Write_Memory_Params.ProgrammingMode & PROG_MODE_COMMIT_PAGE_MASK)
 	{
-		ISPTarget_SendByte(Write_Memory_Params.ProgrammingCommands[1]);
-		ISPTarget_SendByte(PageStartAddress >> 8);
-		ISPTarget_SendByte(PageStartAddress & 0xFF);
-		ISPTarget_SendByte(0x00);
-
-		/* Check if polling is enabled and possible, if not switch to timed delay mode */
-		if ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_VALUE_MASK) && !(PollAddress))
+		ISPTarget_SendInstruction(Write_Memory_Params.ProgrammingCommands[1], (PageStartAddress >> 8),
+		                          (PageStartAddress & 0xFF), 0x00);
+		ISPProtocol_StartPageWrite(V2Command == CMD_PROGRAM_EEPROM_ISP);
+
+		/* A polled completion check is deferred until the target is next used, so that the page is programmed while
+		 * the host receives this response and sends its next command; a timed delay, whether asked for by the host or
+		 * used for a page with no byte differing from the poll value, must be waited out here */
+		if ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_READYBUSY_MASK) ||
+		    ((Write_Memory_Params.ProgrammingMode & PROG_MODE_PAGED_VALUE_MASK) && PollAddress))
 		{
-			Write_Memory_Params.ProgrammingMode = (Write_Memory_Params.ProgrammingMode & ~PROG_MODE_PAGED_VALUE_MASK) |
-												   PROG_MODE_PAGED_TIMEDELAY_MASK;
+			DeferredCompletion.ProgrammingMode = Write_Memory_Params.ProgrammingMode;
+			DeferredCompletion.PollAddress     = PollAddress;
+			DeferredCompletion.PollValue       = PollValue;
+			DeferredCompletion.DelayMS         = Write_Memory_Params.DelayMS;
+			DeferredCompletion.ReadMemCommand  = Write_Memory_Params.ProgrammingCommands[2];
+		}
+		else
+		{
+			ProgrammingStatus = ISPProtocol_WaitForPageComplete(Write_Memory_Params.ProgrammingMode, PollAddress, PollValue,
+			                                                    Write_Memory_Params.DelayMS,
+			                                                    Write_Memory_Params.ProgrammingCommands[2]);
 		}
-
-		ProgrammingStatus = ISPTarget_WaitForProgComplete(Write_Memory_Params.ProgrammingMode, PollAddress, PollValue,
-		                                                  Write_Memory_Params.DelayMS,
-		                                                  Write_Memory_Params.ProgrammingCommands[2]);
 
 		/* Check to see if the FLASH address has crossed the extended address boundary */
 		if ((V2Command == CMD_PROGRAM_FLASH_ISP) && !(CurrentAddress & 0xFFFF))
 		  MustLoadExtendedAddress = true;
 	}
 
+	/* Report a failed deferred check of an earlier page, if this command has not failed in its own right */
+	if (ProgrammingStatus == STATUS_CMD_OK)
+	  ProgrammingStatus = DeferredStatus;
+
+	Endpoint_Write_8(V2Command);
+	V2Protocol_WriteStatus(ProgrammingStatus);
+	Endpoint_ClearIN();
+}
+
+#if defined(ISP_STREAM_PROGRAM_DATA)
+/** Handler for the vendor specific CMD_BURST_FLASH_ISP and CMD_BURST_EEPROM_ISP commands, writing a
+ *  contiguous image of any length to the attached device page by page, starting at the current address. The image is
+ *  loaded into the target straight from the endpoint as it arrives, and each page is committed and waited on before
+ *  the next is loaded, so that a single command and response replace one round trip per page. The command stops at
+ *  the first page that fails, and reports the number of pages written before it.
+ *
+ *  As the endpoint is held through each page write, this is only available where program data is streamed; the
+ *  Jungo driver would abort the transfer while it waits.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
+void ISPProtocol_ProgramMemoryBurst(const uint8_t V2Command)
+{
+	struct
+	{
+		uint32_t BytesToWrite;
+		uint16_t PageSize;
+		uint8_t  ProgrammingMode;
+		uint8_t  DelayMS;
+		uint8_t  ProgrammingCommands[3];
+		uint8_t  PollValue1;
+		uint8_t  PollValue2;
+	} Burst_Params;
+
+	Endpoint_Read_Stream_LE(&Burst_Params, sizeof(Burst_Params), NULL);
+	Burst_Params.BytesToWrite = SwapEndian_32(Burst_Params.BytesToWrite);
+	Burst_Params.PageSize     = SwapEndian_16(Burst_Params.PageSize);
+
+	bool     FlashMemory       = (V2Command == CMD_BURST_FLASH_ISP);
+	uint8_t  ProgrammingStatus = STATUS_CMD_OK;
+	uint8_t  PollValue         = FlashMemory ? Burst_Params.PollValue1 : Burst_Params.PollValue2;
+	uint32_t BytesRemaining    = Burst_Params.BytesToWrite;
+	uint16_t PagesWritten      = 0;
+	uint16_t PageAddresses     = FlashMemory ? (Burst_Params.PageSize >> 1) : Burst_Params.PageSize;
+
+	/* Only paged memories can be burst written, a FLASH page must hold whole words, and the image must start on a
+	 * page boundary as each page is committed at the address of its first byte */
+	if (!(Burst_Params.ProgrammingMode & PROG_MODE_PAGED_WRITES_MASK) || !(PageAddresses) ||
+	    (FlashMemory && (Burst_Params.PageSize & 0x01)) || ((CurrentAddress & 0xFFFF) % PageAddresses))
+	{
+		ProgrammingStatus = STATUS_CMD_ILLEGAL_PARAM;
+	}
+	else
+	{
+		/* The target may still be programming a page from an earlier command, which must finish first */
+		ProgrammingStatus = ISPProtocol_CompleteDeferredWrite();
+	}
+
+	while (BytesRemaining && (ProgrammingStatus == STATUS_CMD_OK))
+	{
+		uint16_t PageBytes        = MIN(BytesRemaining, Burst_Params.PageSize);
+		uint16_t PageStartAddress = (CurrentAddress & 0xFFFF);
+		uint16_t PollAddress      = 0;
+		uint8_t  ReadMemCommand   = Burst_Params.ProgrammingCommands[2];
+
+		/* Each page gets a fresh timeout period, so that the length of the image is not limited by it */
+		Timebase_StartTimeout(COMMAND_TIMEOUT_US);
+
+		for (uint16_t CurrentByte = 0; CurrentByte < PageBytes; CurrentByte++)
+		{
+			/* Clock each byte into the target straight out of the endpoint bank, releasing each bank once read so
+			 * that the host can fill it with more of the image */
+			if (!(Endpoint_BytesInEndpoint()))
+			{
+				Endpoint_ClearOUT();
+
+				if (Endpoint_WaitUntilReady() != ENDPOINT_READYWAIT_NoError)
+				{
+					ProgrammingStatus = STATUS_CMD_TOUT;
+					break;
+				}
+			}
+
+			uint8_t ByteToWrite = Endpoint_Read_8();
+			BytesRemaining--;
+
+			/* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
+			if (MustLoadExtendedAddress)
+			{
+				ISPTarget_LoadExtendedAddress();
+				MustLoadExtendedAddress = false;
+			}
+
+			ISPTarget_SendInstruction(Burst_Params.ProgrammingCommands[0], (CurrentAddress >> 8),
+			                          (CurrentAddress & 0xFF), ByteToWrite);
+
+			/* AVR FLASH addressing requires us to modify the write command based on if we are writing a high
+			 * or low byte at the current word address */
+			if (FlashMemory)
+			  Burst_Params.ProgrammingCommands[0] ^= READ_WRITE_HIGH_BYTE_MASK;
+
+			/* Check to see if we have a valid polling address */
+			if (!(PollAddress) && (ByteToWrite != PollValue))
+			{
+				if ((CurrentByte & 0x01) && FlashMemory)
+				  ReadMemCommand |=  READ_WRITE_HIGH_BYTE_MASK;
+				else
+				  ReadMemCommand &= ~READ_WRITE_HIGH_BYTE_MASK;
+
+				PollAddress = (CurrentAddress & 0xFFFF);
+			}
+
+			/* EEPROM just increments the address each byte, flash needs to increment on each word and
+			 * also check to ensure that a LOAD EXTENDED ADDRESS command is issued each time the extended
+			 * address boundary has been crossed during FLASH memory programming */
+			if ((CurrentByte & 0x01) || !(FlashMemory))
+			{
+				CurrentAddress++;
+
+				if (FlashMemory && !(CurrentAddress & 0xFFFF))
+				  MustLoadExtendedAddress = true;
+			}
+		}
+
+		if (ProgrammingStatus != STATUS_CMD_OK)
+		  break;
+
+		ISPTarget_SendInstruction(Burst_Params.ProgrammingCommands[1], (PageStartAddress >> 8),
+		                          (PageStartAddress & 0xFF), 0x00);
+		ISPProtocol_StartPageWrite(!(FlashMemory));
+
+		/* The next page cannot be loaded until this one is programmed, so there is nothing to gain from deferring */
+		ProgrammingStatus = ISPProtocol_WaitForPageComplete(Burst_Params.ProgrammingMode, PollAddress, PollValue,
+		                                                    Burst_Params.DelayMS, ReadMemCommand);
+
+		if (ProgrammingStatus == STATUS_CMD_OK)
+		  PagesWritten++;
+	}
+
+	/* Discard the rest of the image after a failed page, in pieces as it may be too long for a single stream */
+	while (BytesRemaining)
+	{
+		uint16_t DiscardBytes = MIN(BytesRemaining, 0x8000);
+
+		if (Endpoint_Discard_Stream(DiscardBytes, NULL) != ENDPOINT_RWSTREAM_NoError)
+		  break;
+
+		BytesRemaining -= DiscardBytes;
+	}
+
+	ISPProtocol_ReleaseCommandData(sizeof(Burst_Params) + Burst_Params.BytesToWrite);
+
 	Endpoint_Write_8(V2Command);
-	Endpoint_Write_8(ProgrammingStatus);
+	V2Protocol_WriteStatus(ProgrammingStatus);
+	Endpoint_Write_16_BE(PagesWritten);
 	Endpoint_ClearIN();
 }
+#endif
+
+/** Writes a byte of read memory data to the response for the host, sending the response packet each time the
+ *  endpoint bank fills.
+ *
+ *  \param[in] DataByte  Byte of data to write to the response
+ */
+static inline void ISPProtocol_WriteReadData(const uint8_t DataByte)
+{
+	Endpoint_Write_8(DataByte);
+
+	/* Check if the endpoint bank is currently full, if so send the packet */
+	if (!(Endpoint_IsReadWriteAllowed()))
+	{
+		Endpoint_ClearIN();
+		Endpoint_WaitUntilReady();
+	}
+}
 
 /** Handler for the CMD_READ_FLASH_ISP and CMD_READ_EEPROM_ISP commands, reading in bytes,
- *  words or pages of data from the attached device.
+ *  words or pages of data from the attached device. Also handles the vendor specific CMD_READ_FLASH_RLE_ISP and
+ *  CMD_READ_EEPROM_RLE_ISP commands, which return the same data with each run of 0xFF bytes replaced by a 0xFF
+ *  marker byte followed by the run length, from 1 to 255.
  *
  *  \param[in] V2Command  Issued V2 Protocol command byte from the host
  */
@@ -299,11 +1051,21 @@ void ISPProtocol_ReadMemory(uint8_t V2Command)
 	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
+	/* The last page must finish programming before the target is read, but a failed write is left for the next
+	 * programming command to report, as the host would otherwise take it for a failed read */
+	ISPProtocol_FinishDeferredWrite();
+
 	Endpoint_Write_8(V2Command);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(STATUS_CMD_OK);
 
-	/* Read each byte from the device and write them to the packet for the host */
-	for (uint16_t CurrentByte = 0; CurrentByte < Read_Memory_Params.BytesToRead; CurrentByte++)
+	bool     FlashMemory     = ((V2Command == CMD_READ_FLASH_ISP) || (V2Command == CMD_READ_FLASH_RLE_ISP));
+	bool     RunLengthEncode = ((V2Command == CMD_READ_FLASH_RLE_ISP) || (V2Command == CMD_READ_EEPROM_RLE_ISP));
+	uint8_t  BlankRunLength  = 0;
+	uint16_t BytesRemaining  = Read_Memory_Params.BytesToRead;
+
+	/* Each read instruction is started as soon as the previous one has completed, so that its command byte is
+	 * shifting out to the target while the byte read by the previous one is packed into the endpoint bank */
+	if (BytesRemaining)
 	{
 		/* Check to see if we need to send a LOAD EXTENDED ADDRESS command to the target */
 		if (MustLoadExtendedAddress)
@@ -312,34 +1074,73 @@ void ISPProtocol_ReadMemory(uint8_t V2Command)
 			MustLoadExtendedAddress = false;
 		}
 
-		/* Read the next byte from the desired memory space in the device */
 		ISPTarget_SendByte(Read_Memory_Params.ReadMemoryCommand);
+	}
+
+	while (BytesRemaining)
+	{
+		/* Complete the read instruction whose command byte has already been sent */
 		ISPTarget_SendByte(CurrentAddress >> 8);
 		ISPTarget_SendByte(CurrentAddress & 0xFF);
-		Endpoint_Write_8(ISPTarget_ReceiveByte());
-
-		/* Check if the endpoint bank is currently full, if so send the packet */
-		if (!(Endpoint_IsReadWriteAllowed()))
-		{
-			Endpoint_ClearIN();
-			Endpoint_WaitUntilReady();
-		}
+		ISPTarget_SendByte(0x00);
 
 		/* AVR FLASH addressing requires us to modify the read command based on if we are reading a high
-		 * or low byte at the current word address */
-		if (V2Command == CMD_READ_FLASH_ISP)
+		 * or low byte at the current word address - this and the address update below are done while the
+		 * data byte is still being shifted in from the target */
+		if (FlashMemory)
 		  Read_Memory_Params.ReadMemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
 
 		/* EEPROM just increments the address each byte, flash needs to increment on each word and
 		 * also check to ensure that a LOAD EXTENDED ADDRESS command is issued each time the extended
 		 * address boundary has been crossed */
-		if ((CurrentByte & 0x01) || (V2Command == CMD_READ_EEPROM_ISP))
+		if (!(FlashMemory) || ((Read_Memory_Params.BytesToRead - BytesRemaining) & 0x01))
 		{
 			CurrentAddress++;
 
-			if ((V2Command != CMD_READ_EEPROM_ISP) && !(CurrentAddress & 0xFFFF))
+			if (FlashMemory && !(CurrentAddress & 0xFFFF))
 			  MustLoadExtendedAddress = true;
 		}
+
+		uint8_t ReceivedByte = ISPTarget_ReadQueuedByte();
+
+		if (--BytesRemaining)
+		{
+			if (MustLoadExtendedAddress)
+			{
+				ISPTarget_LoadExtendedAddress();
+				MustLoadExtendedAddress = false;
+			}
+
+			ISPTarget_SendByte(Read_Memory_Params.ReadMemoryCommand);
+		}
+
+		if (RunLengthEncode && (ReceivedByte == 0xFF))
+		{
+			/* Blank bytes are only counted, and reported once the run ends or reaches the longest encodable length */
+			if (++BlankRunLength == 0xFF)
+			{
+				ISPProtocol_WriteReadData(0xFF);
+				ISPProtocol_WriteReadData(BlankRunLength);
+				BlankRunLength = 0;
+			}
+		}
+		else
+		{
+			if (BlankRunLength)
+			{
+				ISPProtocol_WriteReadData(0xFF);
+				ISPProtocol_WriteReadData(BlankRunLength);
+				BlankRunLength = 0;
+			}
+
+			ISPProtocol_WriteReadData(ReceivedByte);
+		}
+	}
+
+	if (BlankRunLength)
+	{
+		ISPProtocol_WriteReadData(0xFF);
+		ISPProtocol_WriteReadData(BlankRunLength);
 	}
 
 	Endpoint_Write_8(STATUS_CMD_OK);
@@ -356,6 +1157,129 @@ void ISPProtocol_ReadMemory(uint8_t V2Command)
 	}
 }
 
+/** Handler for the vendor specific CMD_VERIFY_FLASH_CRC_ISP and CMD_VERIFY_EEPROM_CRC_ISP commands, reading blocks
+ *  of memory from the attached device starting at the current address and checking each against a CRC supplied by
+ *  the host, so that a verify does not need to send the memory contents back over USB. The CRC used is CRC-16-CCITT
+ *  (polynomial 0x1021, initial value 0xFFFF, not reflected), computed separately for each block.
+ *
+ *  \param[in] V2Command  Issued V2 Protocol command byte from the host
+ */
+void ISPProtocol_VerifyMemoryCRC(const uint8_t V2Command)
+{
+	struct
+	{
+		uint8_t  ReadMemoryCommand;
+		uint16_t BlockSize;
+		uint8_t  TotalBlocks;
+		uint8_t  ExpectedCRCs[ISP_MAX_VERIFY_BLOCKS * 2];
+	} Verify_CRC_Params;
+
+	Endpoint_Read_Stream_LE(&Verify_CRC_Params, (sizeof(Verify_CRC_Params) - sizeof(Verify_CRC_Params.ExpectedCRCs)), NULL);
+	Verify_CRC_Params.BlockSize = SwapEndian_16(Verify_CRC_Params.BlockSize);
+
+	uint16_t CRCBytes = (Verify_CRC_Params.TotalBlocks * 2);
+
+	if ((Verify_CRC_Params.TotalBlocks > ISP_MAX_VERIFY_BLOCKS) || !(Verify_CRC_Params.BlockSize))
+	{
+		Endpoint_Discard_Stream(CRCBytes, NULL);
+		ISPProtocol_ReleaseCommandData((sizeof(Verify_CRC_Params) - sizeof(Verify_CRC_Params.ExpectedCRCs)) + CRCBytes);
+
+		Endpoint_Write_8(V2Command);
+		V2Protocol_WriteStatus(STATUS_CMD_ILLEGAL_PARAM);
+		Endpoint_ClearIN();
+		return;
+	}
+
+	Endpoint_Read_Stream_LE(&Verify_CRC_Params.ExpectedCRCs, CRCBytes, NULL);
+	ISPProtocol_ReleaseCommandData((sizeof(Verify_CRC_Params) - sizeof(Verify_CRC_Params.ExpectedCRCs)) + CRCBytes);
+
+	ISPProtocol_FinishDeferredWrite();
+
+	uint8_t  VerifyStatus = STATUS_CMD_OK;
+	uint8_t  CurrentBlock;
+	uint16_t BlockCRC     = 0;
+
+	for (CurrentBlock = 0; CurrentBlock < Verify_CRC_Params.TotalBlocks; CurrentBlock++)
+	{
+		/* Each block gets a fresh timeout period, so that the range checked by one command is not limited by it */
+		Timebase_StartTimeout(COMMAND_TIMEOUT_US);
+
+		BlockCRC = 0xFFFF;
+
+		uint16_t BytesRemaining = Verify_CRC_Params.BlockSize;
+
+		/* As for memory reads, each read instruction of the block is started as soon as the previous one has
+		 * completed, so that its command byte is shifting out to the target while the byte read by the previous one
+		 * is folded into the CRC */
+		if (MustLoadExtendedAddress)
+		{
+			ISPTarget_LoadExtendedAddress();
+			MustLoadExtendedAddress = false;
+		}
+
+		ISPTarget_SendByte(Verify_CRC_Params.ReadMemoryCommand);
+
+		while (BytesRemaining)
+		{
+			/* Complete the read instruction whose command byte has already been sent */
+			ISPTarget_SendByte(CurrentAddress >> 8);
+			ISPTarget_SendByte(CurrentAddress & 0xFF);
+			ISPTarget_SendByte(0x00);
+
+			/* FLASH alternates between the low and high byte of each word, and only moves to the next word
+			 * address once the high byte has been read; EEPROM moves on after every byte */
+			if (V2Command == CMD_VERIFY_FLASH_CRC_ISP)
+			  Verify_CRC_Params.ReadMemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
+
+			if ((V2Command == CMD_VERIFY_EEPROM_CRC_ISP) ||
+			    !(Verify_CRC_Params.ReadMemoryCommand & READ_WRITE_HIGH_BYTE_MASK))
+			{
+				CurrentAddress++;
+
+				if ((V2Command != CMD_VERIFY_EEPROM_CRC_ISP) && !(CurrentAddress & 0xFFFF))
+				  MustLoadExtendedAddress = true;
+			}
+
+			uint8_t ReceivedByte = ISPTarget_ReadQueuedByte();
+
+			/* No instruction is left half sent at the end of a block, as the verification may stop there */
+			if (--BytesRemaining)
+			{
+				if (MustLoadExtendedAddress)
+				{
+					ISPTarget_LoadExtendedAddress();
+					MustLoadExtendedAddress = false;
+				}
+
+				ISPTarget_SendByte(Verify_CRC_Params.ReadMemoryCommand);
+			}
+
+			BlockCRC = _crc_xmodem_update(BlockCRC, ReceivedByte);
+		}
+
+		if (!(TimeoutRemaining))
+		{
+			VerifyStatus = STATUS_CMD_TOUT;
+			break;
+		}
+
+		uint16_t ExpectedCRC = (((uint16_t)Verify_CRC_Params.ExpectedCRCs[CurrentBlock * 2] << 8) |
+		                        Verify_CRC_Params.ExpectedCRCs[(CurrentBlock * 2) + 1]);
+
+		if (BlockCRC != ExpectedCRC)
+		{
+			VerifyStatus = STATUS_CMD_FAILED;
+			break;
+		}
+	}
+
+	Endpoint_Write_8(V2Command);
+	V2Protocol_WriteStatus(VerifyStatus);
+	Endpoint_Write_8(CurrentBlock);
+	Endpoint_Write_16_BE(BlockCRC);
+	Endpoint_ClearIN();
+}
+
 /** Handler for the CMD_CHI_ERASE_ISP command, clearing the target's FLASH memory. */
 void ISPProtocol_ChipErase(void)
 {
@@ -372,6 +1296,7 @@ void ISPProtocol_ChipErase(void)
 	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
+	uint8_t DeferredStatus = ISPProtocol_CompleteDeferredWrite();
 	uint8_t ResponseStatus = STATUS_CMD_OK;
 
 	/* Send the chip erase commands as given by the host to the device */
@@ -384,8 +1309,16 @@ void ISPProtocol_ChipErase(void)
 	else
 	  ResponseStatus = ISPTarget_WaitWhileTargetBusy();
 
+	#if defined(ENABLE_WRITE_SKIP)
+	FlashErased = (ResponseStatus == STATUS_CMD_OK);
+	#endif
+
+	/* Report a failed write of the last page, if the erase has not failed in its own right */
+	if (ResponseStatus == STATUS_CMD_OK)
+	  ResponseStatus = DeferredStatus;
+
 	Endpoint_Write_8(CMD_CHIP_ERASE_ISP);
-	Endpoint_Write_8(ResponseStatus);
+	V2Protocol_WriteStatus(ResponseStatus);
 	Endpoint_ClearIN();
 }
 
@@ -408,6 +1341,8 @@ void ISPProtocol_ReadFuseLockSigOSCCAL(uint8_t V2Command)
 	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
+	ISPProtocol_FinishDeferredWrite();
+
 	uint8_t ResponseBytes[4];
 
 	/* Send the Fuse or Lock byte read commands as given by the host to the device, store response */
@@ -415,7 +1350,7 @@ void ISPProtocol_ReadFuseLockSigOSCCAL(uint8_t V2Command)
 	  ResponseBytes[RByte] = ISPTarget_TransferByte(Read_FuseLockSigOSCCAL_Params.ReadCommandBytes[RByte]);
 
 	Endpoint_Write_8(V2Command);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(STATUS_CMD_OK);
 	Endpoint_Write_8(ResponseBytes[Read_FuseLockSigOSCCAL_Params.RetByte - 1]);
 	Endpoint_Write_8(STATUS_CMD_OK);
 	Endpoint_ClearIN();
@@ -439,12 +1374,14 @@ void ISPProtocol_WriteFuseLock(uint8_t V2Command)
 	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
+	uint8_t DeferredStatus = ISPProtocol_CompleteDeferredWrite();
+
 	/* Send the Fuse or Lock byte program commands as given by the host to the device */
 	for (uint8_t SByte = 0; SByte < sizeof(Write_FuseLockSig_Params.WriteCommandBytes); SByte++)
 	  ISPTarget_SendByte(Write_FuseLockSig_Params.WriteCommandBytes[SByte]);
 
 	Endpoint_Write_8(V2Command);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(DeferredStatus);
 	Endpoint_Write_8(STATUS_CMD_OK);
 	Endpoint_ClearIN();
 }
@@ -467,8 +1404,10 @@ void ISPProtocol_SPIMulti(void)
 	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
+	ISPProtocol_FinishDeferredWrite();
+
 	Endpoint_Write_8(CMD_SPI_MULTI);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(STATUS_CMD_OK);
 
 	uint8_t CurrTxPos = 0;
 	uint8_t CurrRxPos = 0;
@@ -516,16 +1455,17 @@ void ISPProtocol_SPIMulti(void)
 	}
 }
 
-/** Blocking delay for a given number of milliseconds. This provides a simple wrapper around
- *  the avr-libc provided delay function, so that the delay function can be called with a
- *  constant value (to prevent run-time floating point operations being required).
+/** Blocking delay for a given number of milliseconds, timed by the timebase so that the delay costs only the time
+ *  given by the host. The delay ends early if the command times out.
  *
  *  \param[in] DelayMS  Number of milliseconds to delay for
  */
 void ISPProtocol_DelayMS(uint8_t DelayMS)
 {
-	while (DelayMS-- && TimeoutTicksRemaining)
-	  Delay_MS(1);
+	/* Time the delay from the end of any SPI transfer still in progress */
+	ISPTarget_FlushSPI();
+
+	Timebase_DelayUS((uint32_t)DelayMS * 1000);
 }
 
 #endif
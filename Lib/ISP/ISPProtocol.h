@@ -38,7 +38,10 @@
 
 	/* Includes: */
 		#include <avr/io.h>
+		#include <avr/eeprom.h>
+		#include <util/crc16.h>
 		#include <util/delay.h>
+		#include <string.h>
 
 		#include <LUFA/Drivers/USB/USB.h>
 
@@ -58,6 +61,19 @@
 		/** Mask for the reading or writing of the high byte in a FLASH word when issuing a low-level programming command. */
 		#define READ_WRITE_HIGH_BYTE_MASK       (1 << 3)
 
+		/** Maximum number of bytes of memory that can be programmed by a single program memory command. */
+		#define ISP_MAX_PROGRAM_BYTES           256
+
+		#if (defined(LIBUSB_DRIVER_COMPAT) && !defined(ENABLE_WRITE_SKIP)) || defined(__DOXYGEN__)
+			/** Defined when the data of program memory commands is loaded into the target straight from the endpoint,
+			 *  rather than buffered first; write skipping needs the whole page in hand before any of it is loaded.
+			 */
+			#define ISP_STREAM_PROGRAM_DATA
+		#endif
+
+		/** Maximum number of blocks whose CRC can be checked by a single memory CRC verify command. */
+		#define ISP_MAX_VERIFY_BLOCKS           64
+
 		#define PROG_MODE_PAGED_WRITES_MASK     (1 << 0)
 		#define PROG_MODE_WORD_TIMEDELAY_MASK   (1 << 1)
 		#define PROG_MODE_WORD_VALUE_MASK       (1 << 2)
@@ -67,15 +83,113 @@
 		#define PROG_MODE_PAGED_READYBUSY_MASK  (1 << 6)
 		#define PROG_MODE_COMMIT_PAGE_MASK      (1 << 7)
 
+		/** Low level device command to read a signature byte, used to verify the ISP speed in automatic SCK mode. */
+		#define READ_SIGNATURE_CMD              0x30
+
+		/** Low level device command to read the low byte of a FLASH word, used to verify the ISP speed in automatic
+		 *  SCK mode.
+		 */
+		#define READ_FLASH_LOW_BYTE_CMD         0x20
+
+		#if (!defined(ISP_AUTO_SCK_CACHE_ENTRIES) || defined(__DOXYGEN__))
+			/** Number of device signatures whose negotiated ISP speed is remembered in EEPROM in automatic SCK mode. */
+			#define ISP_AUTO_SCK_CACHE_ENTRIES  8
+		#endif
+
+		#if (!defined(ISP_AUTO_SCK_READBACK_BYTES) || defined(__DOXYGEN__))
+			/** Number of bytes from the start of the target's FLASH that must read back identically at a candidate ISP
+			 *  speed in automatic SCK mode, in addition to the device signature.
+			 */
+			#define ISP_AUTO_SCK_READBACK_BYTES 16
+		#endif
+
+		#if (!defined(ISP_WRITE_TIMING_ENTRIES) || defined(__DOXYGEN__))
+			/** Number of device signatures whose measured page write times are remembered in RAM with adaptive write
+			 *  delays.
+			 */
+			#define ISP_WRITE_TIMING_ENTRIES    4
+		#endif
+
+	/* Type Defines: */
+		/** Type define for the parameters of the CMD_ENTER_PROGMODE_ISP command, which are kept for the duration of the
+		 *  command so that the target can be synchronized with again after being accessed at an unreliable ISP speed.
+		 */
+		typedef struct
+		{
+			uint8_t TimeoutMS; /**< Command timeout in milliseconds */
+			uint8_t PinStabDelayMS; /**< Delay in milliseconds after each change of the target's /RESET line */
+			uint8_t ExecutionDelayMS; /**< Delay in milliseconds before the target is first accessed */
+			uint8_t SynchLoops; /**< Maximum number of attempts to synchronize with the target */
+			uint8_t ByteDelay; /**< Delay in milliseconds before each byte of the Programming Enable instruction */
+			uint8_t PollValue; /**< Value expected back from the target once it is synchronized */
+			uint8_t PollIndex; /**< One-based index of the response byte compared to the poll value, zero for none */
+			uint8_t EnterProgBytes[4]; /**< Programming Enable instruction bytes */
+		} ISPProtocol_EnterProgParams_t;
+
+		/** Type define for an entry of the automatic SCK mode cache, recording the ISP speed negotiated for a device. */
+		typedef struct
+		{
+			uint8_t Signature[3]; /**< Device signature bytes, all 0xFF for an unused entry */
+			uint8_t SCKDuration; /**< Negotiated ISP speed for the device, as an AVRStudio SCK duration parameter value */
+		} ISPProtocol_SCKCacheEntry_t;
+
+		/** Type define for an entry of the adaptive write delay table, recording the page write times measured for a
+		 *  device.
+		 */
+		typedef struct
+		{
+			uint8_t  Signature[3]; /**< Device signature bytes, all zero for an unused entry */
+			uint16_t WriteTimeCounts[2]; /**< Longest page write time of FLASH and EEPROM in timebase counts, or zero */
+		} ISPProtocol_WriteTimingEntry_t;
+
 	/* Function Prototypes: */
+		uint8_t ISPProtocol_CompleteDeferredWrite(void);
 		void ISPProtocol_EnterISPMode(void);
 		void ISPProtocol_LeaveISPMode(void);
 		void ISPProtocol_ProgramMemory(const uint8_t V2Command);
+		#if defined(ISP_STREAM_PROGRAM_DATA)
+		void ISPProtocol_ProgramMemoryBurst(const uint8_t V2Command);
+		#endif
 		void ISPProtocol_ReadMemory(const uint8_t V2Command);
+		void ISPProtocol_VerifyMemoryCRC(const uint8_t V2Command);
 		void ISPProtocol_ChipErase(void);
 		void ISPProtocol_ReadFuseLockSigOSCCAL(const uint8_t V2Command);
 		void ISPProtocol_WriteFuseLock(const uint8_t V2Command);
 		void ISPProtocol_SPIMulti(void);
 		void ISPProtocol_DelayMS(uint8_t DelayMS);
+
+		#if (defined(INCLUDE_FROM_ISPPROTOCOL_C) && defined(ENABLE_ISP_PROTOCOL))
+			static void ISPProtocol_FinishDeferredWrite(void);
+			static void ISPProtocol_ReleaseCommandData(const uint32_t CommandParamBytes);
+			static void ISPProtocol_StartPageWrite(const bool EEPROMMemory);
+			static uint8_t ISPProtocol_WaitForPageComplete(uint8_t ProgrammingMode,
+			                                               const uint16_t PollAddress,
+			                                               const uint8_t PollValue,
+			                                               const uint8_t DelayMS,
+			                                               const uint8_t ReadMemCommand);
+			static inline void ISPProtocol_WriteReadData(const uint8_t DataByte);
+
+			#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+			static void ISPProtocol_SelectWriteTiming(void);
+			static void ISPProtocol_RecordPageWriteTime(void);
+			static void ISPProtocol_WaitForTimedPageWrite(const uint8_t DelayMS);
+			#endif
+
+			#if defined(ENABLE_WRITE_SKIP)
+			static bool ISPProtocol_PageMatchesTarget(const uint8_t V2Command,
+			                                          const uint8_t* PageData,
+			                                          const uint16_t PageBytes,
+			                                          uint8_t ReadMemoryCommand);
+			#endif
+
+			static uint8_t ISPProtocol_SynchronizeTarget(const ISPProtocol_EnterProgParams_t* const Enter_ISP_Params);
+
+			#if defined(ISP_AUTO_SCK)
+			static uint8_t ISPProtocol_ResynchronizeTarget(const ISPProtocol_EnterProgParams_t* const Enter_ISP_Params,
+			                                               const uint8_t SCKDuration);
+			static void ISPProtocol_ReadTargetIdentity(uint8_t* const Identity);
+			static uint8_t ISPProtocol_NegotiateSCKDuration(const ISPProtocol_EnterProgParams_t* const Enter_ISP_Params);
+			#endif
+		#endif
 #endif
 
@@ -33,6 +33,7 @@
  *  Target-related functions for the ISP Protocol decoder.
  */
 
+#define  INCLUDE_FROM_ISPTARGET_C
 #include "ISPTarget.h"
 
 #if defined(ENABLE_ISP_PROTOCOL) || defined(__DOXYGEN__)
@@ -64,105 +65,159 @@ static const uint8_t SPIMaskFromSCKDuration[] PROGMEM =
 #endif
 };
 
-/** Lookup table to convert the slower ISP speeds into a compare value for the software SPI driver.
+#if defined(ISP_USART_SPI)
+/** List of USART master SPI mode baud rate register values for the same ISP programming speeds as
+ *  \ref SPIMaskFromSCKDuration, where the SCK frequency is F_CPU / (2 * (UBRR1 + 1)).
  *
  *  \hideinitializer
  */
-static const uint16_t TimerCompareFromSCKDuration[] PROGMEM =
+static const uint8_t USARTBaudFromSCKDuration[] PROGMEM =
 {
-	TIMER_COMP(96386), TIMER_COMP(89888), TIMER_COMP(84211), TIMER_COMP(79208), TIMER_COMP(74767),
-	TIMER_COMP(70797), TIMER_COMP(67227), TIMER_COMP(64000), TIMER_COMP(61069), TIMER_COMP(58395),
-	TIMER_COMP(55945), TIMER_COMP(51613), TIMER_COMP(49690), TIMER_COMP(47905), TIMER_COMP(46243),
-	TIMER_COMP(43244), TIMER_COMP(41885), TIMER_COMP(39409), TIMER_COMP(38278), TIMER_COMP(36200),
-	TIMER_COMP(34335), TIMER_COMP(32654), TIMER_COMP(31129), TIMER_COMP(29740), TIMER_COMP(28470),
-	TIMER_COMP(27304), TIMER_COMP(25724), TIMER_COMP(24768), TIMER_COMP(23461), TIMER_COMP(22285),
-	TIMER_COMP(21221), TIMER_COMP(20254), TIMER_COMP(19371), TIMER_COMP(18562), TIMER_COMP(17583),
-	TIMER_COMP(16914), TIMER_COMP(16097), TIMER_COMP(15356), TIMER_COMP(14520), TIMER_COMP(13914),
-	TIMER_COMP(13224), TIMER_COMP(12599), TIMER_COMP(12031), TIMER_COMP(11511), TIMER_COMP(10944),
-	TIMER_COMP(10431), TIMER_COMP(9963),  TIMER_COMP(9468),  TIMER_COMP(9081),  TIMER_COMP(8612),
-	TIMER_COMP(8239),  TIMER_COMP(7851),  TIMER_COMP(7498),  TIMER_COMP(7137),  TIMER_COMP(6809),
-	TIMER_COMP(6478),  TIMER_COMP(6178),  TIMER_COMP(5879),  TIMER_COMP(5607),  TIMER_COMP(5359),
-	TIMER_COMP(5093),  TIMER_COMP(4870),  TIMER_COMP(4633),  TIMER_COMP(4418),  TIMER_COMP(4209),
-	TIMER_COMP(4019),  TIMER_COMP(3823),  TIMER_COMP(3645),  TIMER_COMP(3474),  TIMER_COMP(3310),
-	TIMER_COMP(3161),  TIMER_COMP(3011),  TIMER_COMP(2869),  TIMER_COMP(2734),  TIMER_COMP(2611),
-	TIMER_COMP(2484),  TIMER_COMP(2369),  TIMER_COMP(2257),  TIMER_COMP(2152),  TIMER_COMP(2052),
-	TIMER_COMP(1956),  TIMER_COMP(1866),  TIMER_COMP(1779),  TIMER_COMP(1695),  TIMER_COMP(1615),
-	TIMER_COMP(1539),  TIMER_COMP(1468),  TIMER_COMP(1398),  TIMER_COMP(1333),  TIMER_COMP(1271),
-	TIMER_COMP(1212),  TIMER_COMP(1155),  TIMER_COMP(1101),  TIMER_COMP(1049),  TIMER_COMP(1000),
-	TIMER_COMP(953),   TIMER_COMP(909),   TIMER_COMP(866),   TIMER_COMP(826),   TIMER_COMP(787),
-	TIMER_COMP(750),   TIMER_COMP(715),   TIMER_COMP(682),   TIMER_COMP(650),   TIMER_COMP(619),
-	TIMER_COMP(590),   TIMER_COMP(563),   TIMER_COMP(536),   TIMER_COMP(511),   TIMER_COMP(487),
-	TIMER_COMP(465),   TIMER_COMP(443),   TIMER_COMP(422),   TIMER_COMP(402),   TIMER_COMP(384),
-	TIMER_COMP(366),   TIMER_COMP(349),   TIMER_COMP(332),   TIMER_COMP(317),   TIMER_COMP(302),
-	TIMER_COMP(288),   TIMER_COMP(274),   TIMER_COMP(261),   TIMER_COMP(249),   TIMER_COMP(238),
-	TIMER_COMP(226),   TIMER_COMP(216),   TIMER_COMP(206),   TIMER_COMP(196),   TIMER_COMP(187),
-	TIMER_COMP(178),   TIMER_COMP(170),   TIMER_COMP(162),   TIMER_COMP(154),   TIMER_COMP(147),
-	TIMER_COMP(140),   TIMER_COMP(134),   TIMER_COMP(128),   TIMER_COMP(122),   TIMER_COMP(116),
-	TIMER_COMP(111),   TIMER_COMP(105),   TIMER_COMP(100),   TIMER_COMP(95.4),  TIMER_COMP(90.9),
-	TIMER_COMP(86.6),  TIMER_COMP(82.6),  TIMER_COMP(78.7),  TIMER_COMP(75.0),  TIMER_COMP(71.5),
-	TIMER_COMP(68.2),  TIMER_COMP(65.0),  TIMER_COMP(61.9),  TIMER_COMP(59.0),  TIMER_COMP(56.3),
-	TIMER_COMP(53.6),  TIMER_COMP(51.1)
+#if (F_CPU == 8000000)
+	0,                       // AVRStudio =   8MHz SPI, Actual =   4MHz SPI
+	0,                       // AVRStudio =   4MHz SPI, Actual =   4MHz SPI
+	1,                       // AVRStudio =   2MHz SPI, Actual =   2MHz SPI
+	3,                       // AVRStudio =   1MHz SPI, Actual =   1MHz SPI
+	7,                       // AVRStudio = 500KHz SPI, Actual = 500KHz SPI
+	15,                      // AVRStudio = 250KHz SPI, Actual = 250KHz SPI
+	31,                      // AVRStudio = 125KHz SPI, Actual = 125KHz SPI
+#elif (F_CPU == 16000000)
+	0,                       // AVRStudio =   8MHz SPI, Actual =   8MHz SPI
+	1,                       // AVRStudio =   4MHz SPI, Actual =   4MHz SPI
+	3,                       // AVRStudio =   2MHz SPI, Actual =   2MHz SPI
+	7,                       // AVRStudio =   1MHz SPI, Actual =   1MHz SPI
+	15,                      // AVRStudio = 500KHz SPI, Actual = 500KHz SPI
+	31,                      // AVRStudio = 250KHz SPI, Actual = 250KHz SPI
+	63                       // AVRStudio = 125KHz SPI, Actual = 125KHz SPI
+#endif
+};
+#endif
+
+/** Lookup table to convert the slower ISP speeds into a delay loop count for the software SPI driver.
+ *
+ *  \hideinitializer
+ */
+static const uint16_t DelayLoopsFromSCKDuration[] PROGMEM =
+{
+	DELAY_LOOPS(96386), DELAY_LOOPS(89888), DELAY_LOOPS(84211), DELAY_LOOPS(79208), DELAY_LOOPS(74767),
+	DELAY_LOOPS(70797), DELAY_LOOPS(67227), DELAY_LOOPS(64000), DELAY_LOOPS(61069), DELAY_LOOPS(58395),
+	DELAY_LOOPS(55945), DELAY_LOOPS(51613), DELAY_LOOPS(49690), DELAY_LOOPS(47905), DELAY_LOOPS(46243),
+	DELAY_LOOPS(43244), DELAY_LOOPS(41885), DELAY_LOOPS(39409), DELAY_LOOPS(38278), DELAY_LOOPS(36200),
+	DELAY_LOOPS(34335), DELAY_LOOPS(32654), DELAY_LOOPS(31129), DELAY_LOOPS(29740), DELAY_LOOPS(28470),
+	DELAY_LOOPS(27304), DELAY_LOOPS(25724), DELAY_LOOPS(24768), DELAY_LOOPS(23461), DELAY_LOOPS(22285),
+	DELAY_LOOPS(21221), DELAY_LOOPS(20254), DELAY_LOOPS(19371), DELAY_LOOPS(18562), DELAY_LOOPS(17583),
+	DELAY_LOOPS(16914), DELAY_LOOPS(16097), DELAY_LOOPS(15356), DELAY_LOOPS(14520), DELAY_LOOPS(13914),
+	DELAY_LOOPS(13224), DELAY_LOOPS(12599), DELAY_LOOPS(12031), DELAY_LOOPS(11511), DELAY_LOOPS(10944),
+	DELAY_LOOPS(10431), DELAY_LOOPS(9963),  DELAY_LOOPS(9468),  DELAY_LOOPS(9081),  DELAY_LOOPS(8612),
+	DELAY_LOOPS(8239),  DELAY_LOOPS(7851),  DELAY_LOOPS(7498),  DELAY_LOOPS(7137),  DELAY_LOOPS(6809),
+	DELAY_LOOPS(6478),  DELAY_LOOPS(6178),  DELAY_LOOPS(5879),  DELAY_LOOPS(5607),  DELAY_LOOPS(5359),
+	DELAY_LOOPS(5093),  DELAY_LOOPS(4870),  DELAY_LOOPS(4633),  DELAY_LOOPS(4418),  DELAY_LOOPS(4209),
+	DELAY_LOOPS(4019),  DELAY_LOOPS(3823),  DELAY_LOOPS(3645),  DELAY_LOOPS(3474),  DELAY_LOOPS(3310),
+	DELAY_LOOPS(3161),  DELAY_LOOPS(3011),  DELAY_LOOPS(2869),  DELAY_LOOPS(2734),  DELAY_LOOPS(2611),
+	DELAY_LOOPS(2484),  DELAY_LOOPS(2369),  DELAY_LOOPS(2257),  DELAY_LOOPS(2152),  DELAY_LOOPS(2052),
+	DELAY_LOOPS(1956),  DELAY_LOOPS(1866),  DELAY_LOOPS(1779),  DELAY_LOOPS(1695),  DELAY_LOOPS(1615),
+	DELAY_LOOPS(1539),  DELAY_LOOPS(1468),  DELAY_LOOPS(1398),  DELAY_LOOPS(1333),  DELAY_LOOPS(1271),
+	DELAY_LOOPS(1212),  DELAY_LOOPS(1155),  DELAY_LOOPS(1101),  DELAY_LOOPS(1049),  DELAY_LOOPS(1000),
+	DELAY_LOOPS(953),   DELAY_LOOPS(909),   DELAY_LOOPS(866),   DELAY_LOOPS(826),   DELAY_LOOPS(787),
+	DELAY_LOOPS(750),   DELAY_LOOPS(715),   DELAY_LOOPS(682),   DELAY_LOOPS(650),   DELAY_LOOPS(619),
+	DELAY_LOOPS(590),   DELAY_LOOPS(563),   DELAY_LOOPS(536),   DELAY_LOOPS(511),   DELAY_LOOPS(487),
+	DELAY_LOOPS(465),   DELAY_LOOPS(443),   DELAY_LOOPS(422),   DELAY_LOOPS(402),   DELAY_LOOPS(384),
+	DELAY_LOOPS(366),   DELAY_LOOPS(349),   DELAY_LOOPS(332),   DELAY_LOOPS(317),   DELAY_LOOPS(302),
+	DELAY_LOOPS(288),   DELAY_LOOPS(274),   DELAY_LOOPS(261),   DELAY_LOOPS(249),   DELAY_LOOPS(238),
+	DELAY_LOOPS(226),   DELAY_LOOPS(216),   DELAY_LOOPS(206),   DELAY_LOOPS(196),   DELAY_LOOPS(187),
+	DELAY_LOOPS(178),   DELAY_LOOPS(170),   DELAY_LOOPS(162),   DELAY_LOOPS(154),   DELAY_LOOPS(147),
+	DELAY_LOOPS(140),   DELAY_LOOPS(134),   DELAY_LOOPS(128),   DELAY_LOOPS(122),   DELAY_LOOPS(116),
+	DELAY_LOOPS(111),   DELAY_LOOPS(105),   DELAY_LOOPS(100),   DELAY_LOOPS(95.4),  DELAY_LOOPS(90.9),
+	DELAY_LOOPS(86.6),  DELAY_LOOPS(82.6),  DELAY_LOOPS(78.7),  DELAY_LOOPS(75.0),  DELAY_LOOPS(71.5),
+	DELAY_LOOPS(68.2),  DELAY_LOOPS(65.0),  DELAY_LOOPS(61.9),  DELAY_LOOPS(59.0),  DELAY_LOOPS(56.3),
+	DELAY_LOOPS(53.6),  DELAY_LOOPS(51.1)
 };
 
 /** Currently selected SPI driver, either hardware (for fast ISP speeds) or software (for slower ISP speeds). */
 bool HardwareSPIMode = true;
 
-/** Software SPI data register for sending and receiving */
-static volatile uint8_t SoftSPI_Data;
-
-/** Number of bits left to transfer in the software SPI driver */
-static volatile uint8_t SoftSPI_BitsRemaining;
-
+#if defined(ISP_USART_SPI)
+/** Number of bytes queued to the USART SPI by \ref ISPTarget_SendByte whose replies have not yet been read. */
+uint8_t USARTSPIBytesPending;
+#else
+/** Indicates that a byte queued to the hardware SPI by \ref ISPTarget_SendByte may still be shifting out. */
+bool HardwareSPIBusy;
+#endif
 
-/** ISR to handle software SPI transmission and reception */
-ISR(TIMER1_COMPA_vect, ISR_BLOCK)
-{
-	/* Check if rising edge (output next bit) or falling edge (read in next bit) */
-	if (!(PINB & (1 << 1)))
-	{
-		if (SoftSPI_Data & (1 << 7))
-		  PORTB |=  (1 << 2);
-		else
-		  PORTB &= ~(1 << 2);
-	}
-	else
-	{
-		SoftSPI_Data <<= 1;
+/** Byte received from the target during the last software SPI transfer. */
+uint8_t SoftSPIReceivedByte;
 
-		if (!(--SoftSPI_BitsRemaining))
-		{
-			TCCR1B = 0;
-			TIFR1  = (1 << OCF1A);
-		}
+#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+/** Indicates that the last programming completion check found the target still busy at least once, so that it ended
+ *  within one poll of the operation actually completing.
+ */
+bool TargetBusyOnPoll;
+#endif
 
-		if (PINB & (1 << 3))
-		  SoftSPI_Data |= (1 << 0);
-	}
+/** Number of delay loop iterations per half SCK period in the software SPI driver */
+static uint16_t SoftSPI_DelayLoops;
 
-	/* Fast toggle of PORTB.1 via the PIN register (see datasheet) */
-	PINB |= (1 << 1);
-}
 
 /** Initializes the appropriate SPI driver (hardware or software, depending on the selected ISP speed) ready for
  *  communication with the attached target.
  */
 void ISPTarget_EnableTargetISP(void)
 {
-	uint8_t SCKDuration = V2Params_GetParameterValue(PARAM_SCK_DURATION);
+	#if defined(ISP_USART_SPI)
+	USARTSPIBytesPending = 0;
+	#else
+	HardwareSPIBusy = false;
+	#endif
+
+	ISPTarget_SetSCKDuration(V2Params_GetParameterValue(PARAM_SCK_DURATION));
+}
+
+/** Switches the SPI driver (hardware or software, depending on the given ISP speed) to a new ISP speed. This may be
+ *  called while the target is in programming mode, as the SPI pins are kept driven across the change.
+ *
+ *  \param[in] SCKDuration  Duration of the desired ISP SCK clock, as an AVRStudio SCK duration parameter value
+ */
+void ISPTarget_SetSCKDuration(const uint8_t SCKDuration)
+{
+	ISPTarget_FlushSPI();
 
 	if (SCKDuration < sizeof(SPIMaskFromSCKDuration))
 	{
 		HardwareSPIMode = true;
 
+		#if defined(ISP_USART_SPI)
+		/* Configure XCK (SCK) and TXD (MOSI) as outputs, RXD (MISO) is taken over by the receiver */
+		DDRD  |= ((1 << 5) | (1 << 3));
+
+		/* Start the USART in master SPI mode 0, MSB first; the baud rate register must be zero while the
+		 * transmitter is enabled, and only then set to the desired SCK rate */
+		UBRR1  = 0;
+		UCSR1C = ((1 << UMSEL11) | (1 << UMSEL10));
+		UCSR1B = ((1 << RXEN1) | (1 << TXEN1));
+		UBRR1  = pgm_read_byte(&USARTBaudFromSCKDuration[SCKDuration]);
+		#else
 		SPI_Init(pgm_read_byte(&SPIMaskFromSCKDuration[SCKDuration]) | SPI_ORDER_MSB_FIRST |
 		                       SPI_SCK_LEAD_RISING | SPI_SAMPLE_LEADING | SPI_MODE_MASTER);
+		#endif
 	}
 	else
 	{
+		/* Hand the pins back from the SPI hardware, leaving them driven at their idle levels */
+		if (HardwareSPIMode)
+		{
+			#if defined(ISP_USART_SPI)
+			UCSR1B = 0;
+			UCSR1C = 0;
+			#else
+			SPCR   = 0;
+			#endif
+		}
+
 		HardwareSPIMode = false;
 
-		DDRB  |= ((1 << 1) | (1 << 2));
-		PORTB |= ((1 << 0) | (1 << 3));
+		SOFT_SPI_DDR  |= (SOFT_SPI_SCK_MASK | SOFT_SPI_MOSI_MASK);
+		SOFT_SPI_PORT |= SOFT_SPI_MISO_MASK;
+		PORTB         |= (1 << 0);
 
 		ISPTarget_ConfigureSoftwareSPI(SCKDuration);
 	}
@@ -175,16 +230,21 @@ void ISPTarget_DisableTargetISP(void)
 {
 	if (HardwareSPIMode)
 	{
+		ISPTarget_FlushSPI();
+
+		#if defined(ISP_USART_SPI)
+		UCSR1B = 0;
+		UCSR1C = 0;
+		DDRD  &= ~((1 << 5) | (1 << 3));
+		#else
 		SPI_Disable();
+		#endif
 	}
 	else
 	{
-		DDRB  &= ~((1 << 1) | (1 << 2));
-		PORTB &= ~((1 << 0) | (1 << 3));
-
-		/* Must re-enable rescue clock once software ISP has exited, as the timer for the rescue clock is
-		 * re-purposed for software SPI */
-		ISPTarget_ConfigureRescueClock();
+		SOFT_SPI_DDR  &= ~(SOFT_SPI_SCK_MASK | SOFT_SPI_MOSI_MASK);
+		SOFT_SPI_PORT &= ~(SOFT_SPI_MOSI_MASK | SOFT_SPI_MISO_MASK);
+		PORTB         &= ~(1 << 0);
 	}
 }
 
@@ -220,19 +280,18 @@ void ISPTarget_ConfigureRescueClock(void)
 	#endif
 }
 
-/** Configures the AVR's timer ready to produce software SPI for the slower ISP speeds that
- *  cannot be obtained when using the AVR's hardware SPI module.
+/** Configures the software SPI driver for the slower ISP speeds that cannot be obtained when using the AVR's
+ *  hardware SPI module. The driver times each half SCK period with a cycle counted delay loop, so the rescue clock
+ *  timer is left running.
  *
  *  \param[in] SCKDuration  Duration of the desired software ISP SCK clock
  */
 void ISPTarget_ConfigureSoftwareSPI(const uint8_t SCKDuration)
 {
-	/* Configure Timer 1 for software SPI using the specified SCK duration */
-	TIMSK1 = (1 << OCIE1A);
-	TCNT1  = 0;
-	OCR1A  = (pgm_read_word(&TimerCompareFromSCKDuration[SCKDuration - sizeof(SPIMaskFromSCKDuration)]));
-	TCCR1A = 0;
-	TCCR1B = 0;
+	uint16_t DelayLoops = pgm_read_word(&DelayLoopsFromSCKDuration[SCKDuration - sizeof(SPIMaskFromSCKDuration)]);
+
+	/* A zero count would run the delay loop for its full 65536 iterations */
+	SoftSPI_DelayLoops = (DelayLoops ? DelayLoops : 1);
 }
 
 /** Sends and receives a single byte of data to and from the attached target via software SPI.
@@ -243,23 +302,36 @@ void ISPTarget_ConfigureSoftwareSPI(const uint8_t SCKDuration)
  */
 uint8_t ISPTarget_TransferSoftSPIByte(const uint8_t Byte)
 {
-	SoftSPI_Data          = Byte;
-	SoftSPI_BitsRemaining = 8;
+	uint16_t DelayLoops = SoftSPI_DelayLoops;
+	uint8_t  Data       = Byte;
 
-	/* Set initial MOSI pin state according to the byte to be transferred */
-	if (SoftSPI_Data & (1 << 7))
-	  PORTB |=  (1 << 2);
-	else
-	  PORTB &= ~(1 << 2);
+	for (uint8_t BitsRemaining = 8; BitsRemaining && TimeoutRemaining; BitsRemaining--)
+	{
+		/* Present the next bit on MOSI while SCK is low */
+		if (Data & (1 << 7))
+		  SOFT_SPI_PORT |=  SOFT_SPI_MOSI_MASK;
+		else
+		  SOFT_SPI_PORT &= ~SOFT_SPI_MOSI_MASK;
+
+		_delay_loop_2(DelayLoops);
+
+		/* Fast toggle of SCK via the PIN register (see datasheet), the target samples MOSI on the rising edge */
+		SOFT_SPI_PIN |= SOFT_SPI_SCK_MASK;
+
+		_delay_loop_2(DelayLoops);
 
-	TCNT1  = 0;
-	TCCR1B = ((1 << WGM12) | (1 << CS11));
-	while (SoftSPI_BitsRemaining && TimeoutTicksRemaining);
-	PORTB |= (1 << 2);
-	TCCR1B = 0;
-	
+		/* Sample MISO at the end of the high half of the clock, before the target shifts out its next bit */
+		Data <<= 1;
 
-	return SoftSPI_Data;
+		if (SOFT_SPI_PIN & SOFT_SPI_MISO_MASK)
+		  Data |= (1 << 0);
+
+		SOFT_SPI_PIN |= SOFT_SPI_SCK_MASK;
+	}
+
+	SOFT_SPI_PORT |= SOFT_SPI_MOSI_MASK;
+
+	return Data;
 }
 
 /** Asserts or deasserts the target's reset line, using the correct polarity as set by the host using a SET PARAM command.
@@ -269,6 +341,8 @@ uint8_t ISPTarget_TransferSoftSPIByte(const uint8_t Byte)
  */
 void ISPTarget_ChangeTargetResetLine(const bool ResetTarget)
 {
+	ISPTarget_FlushSPI();
+
 	if (ResetTarget)
 	{
 		AUX_LINE_DDR |= AUX_LINE_MASK;
@@ -292,15 +366,31 @@ void ISPTarget_ChangeTargetResetLine(const bool ResetTarget)
  */
 uint8_t ISPTarget_WaitWhileTargetBusy(void)
 {
-	do
+	while ((ISPTarget_TransferInstruction(0xF0, 0x00, 0x00, 0x00) & 0x01) && TimeoutRemaining)
 	{
-		ISPTarget_SendByte(0xF0);
-		ISPTarget_SendByte(0x00);
-		ISPTarget_SendByte(0x00);
+		CommandTrace_CountPoll();
+
+		#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+		TargetBusyOnPoll = true;
+		#endif
 	}
-	while ((ISPTarget_ReceiveByte() & 0x01) && TimeoutTicksRemaining);
 
-	return (TimeoutTicksRemaining > 0) ? STATUS_CMD_OK : STATUS_RDY_BSY_TOUT;
+	return (TimeoutRemaining > 0) ? STATUS_CMD_OK : STATUS_RDY_BSY_TOUT;
+}
+
+/** Waits out the fixed delay the host gave for a programming operation to complete, timed from the end of the
+ *  instruction that started it. The delay is always waited out in full, even past the command timeout period.
+ *
+ *  \param[in] DelayMS  Time in milliseconds the operation can take, as given by the host
+ */
+static void ISPTarget_WaitForTimedProgComplete(const uint8_t DelayMS)
+{
+	ISPTarget_FlushSPI();
+
+	uint32_t DeadlineUS = (Timebase_GetTimeUS() + ((uint32_t)DelayMS * 1000) + TIMEBASE_US_PER_COUNT);
+
+	while (!(Timebase_HasElapsed(DeadlineUS)))
+	  CommandTrace_CountPoll();
 }
 
 /** Sends a low-level LOAD EXTENDED ADDRESS command to the target, for addressing of memory beyond the
@@ -309,10 +399,7 @@ uint8_t ISPTarget_WaitWhileTargetBusy(void)
  */
 void ISPTarget_LoadExtendedAddress(void)
 {
-	ISPTarget_SendByte(LOAD_EXTENDED_ADDRESS_CMD);
-	ISPTarget_SendByte(0x00);
-	ISPTarget_SendByte(CurrentAddress >> 16);
-	ISPTarget_SendByte(0x00);
+	ISPTarget_SendInstruction(LOAD_EXTENDED_ADDRESS_CMD, 0x00, (CurrentAddress >> 16), 0x00);
 }
 
 /** Waits until the last issued target memory programming command has completed, via the check mode given and using
@@ -335,24 +422,30 @@ uint8_t ISPTarget_WaitForProgComplete(const uint8_t ProgrammingMode,
 {
 	uint8_t ProgrammingStatus = STATUS_CMD_OK;
 
+	#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+	TargetBusyOnPoll = false;
+	#endif
+
 	/* Determine method of Programming Complete check */
 	switch (ProgrammingMode & ~(PROG_MODE_PAGED_WRITES_MASK | PROG_MODE_COMMIT_PAGE_MASK))
 	{
 		case PROG_MODE_WORD_TIMEDELAY_MASK:
 		case PROG_MODE_PAGED_TIMEDELAY_MASK:
-			ISPProtocol_DelayMS(DelayMS);
+			ISPTarget_WaitForTimedProgComplete(DelayMS);
 			break;
 		case PROG_MODE_WORD_VALUE_MASK:
 		case PROG_MODE_PAGED_VALUE_MASK:
-			do
+			while ((ISPTarget_TransferInstruction(ReadMemCommand, (PollAddress >> 8), (PollAddress & 0xFF), 0x00) == PollValue) &&
+			       TimeoutRemaining)
 			{
-				ISPTarget_SendByte(ReadMemCommand);
-				ISPTarget_SendByte(PollAddress >> 8);
-				ISPTarget_SendByte(PollAddress & 0xFF);
+				CommandTrace_CountPoll();
+
+				#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+				TargetBusyOnPoll = true;
+				#endif
 			}
-			while ((ISPTarget_TransferByte(0x00) == PollValue) && TimeoutTicksRemaining);
 
-			if (!(TimeoutTicksRemaining))
+			if (!(TimeoutRemaining))
 			  ProgrammingStatus = STATUS_CMD_TOUT;
 
 			break;
@@ -363,7 +456,7 @@ uint8_t ISPTarget_WaitForProgComplete(const uint8_t ProgrammingMode,
 	}
 
 	/* Program complete - reset timeout */
-	TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
+	Timebase_StartTimeout(COMMAND_TIMEOUT_US);
 
 	return ProgrammingStatus;
 }
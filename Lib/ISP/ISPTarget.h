@@ -40,6 +40,7 @@
 		#include <avr/io.h>
 		#include <avr/pgmspace.h>
 		#include <util/delay.h>
+		#include <util/delay_basic.h>
 
 		#include <LUFA/Drivers/USB/USB.h>
 		#include <LUFA/Drivers/Peripheral/SPI.h>
@@ -57,22 +58,73 @@
 			#endif
 		#endif
 
+		#if defined(ISP_USART_SPI) && defined(XCK_RESCUE_CLOCK_ENABLE)
+			#error ISP_USART_SPI and XCK_RESCUE_CLOCK_ENABLE both require the USART XCK pin.
+		#endif
+
 	/* Macros: */
 		/** Low level device command to issue an extended FLASH address, for devices with over 128KB of FLASH. */
 		#define LOAD_EXTENDED_ADDRESS_CMD     0x4D
 
-		/** Macro to convert an ISP frequency to a number of timer clock cycles for the software SPI driver. */
-		#define TIMER_COMP(freq)              (((F_CPU / 8) / 2 / freq) - 1)
+		/** Estimated number of CPU cycles spent in the low half of each SCK period of the software SPI driver outside
+		 *  of its delay loop, covering the loop control, timeout check and MOSI update in
+		 *  \ref ISPTarget_TransferSoftSPIByte. Counted by hand from the C source rather than measured, and does not
+		 *  include the longer gap between bytes.
+		 */
+		#define SOFT_SPI_LOW_HALF_CYCLES      13
+
+		/** Estimated number of CPU cycles spent in the high half of each SCK period of the software SPI driver outside
+		 *  of its delay loop, covering the MISO sample. Counted by hand from the C source rather than measured.
+		 */
+		#define SOFT_SPI_HIGH_HALF_CYCLES     6
+
+		/** Macro to convert an ISP frequency to the nearest number of four cycle delay loop iterations per half SCK
+		 *  period for the software SPI driver. Both halves share the same count, so it is taken from the whole period;
+		 *  the low half runs longer than the high half by the difference in their overheads.
+		 */
+		#define DELAY_LOOPS(freq)             (uint16_t)((((F_CPU / (double)(freq)) - SOFT_SPI_LOW_HALF_CYCLES - \
+		                                                   SOFT_SPI_HIGH_HALF_CYCLES) / 8) + 0.5)
+
+		#if defined(ISP_USART_SPI)
+			#define SOFT_SPI_PORT             PORTD
+			#define SOFT_SPI_PIN              PIND
+			#define SOFT_SPI_DDR              DDRD
+			#define SOFT_SPI_SCK_MASK         (1 << 5)
+			#define SOFT_SPI_MOSI_MASK        (1 << 3)
+			#define SOFT_SPI_MISO_MASK        (1 << 2)
+		#else
+			#define SOFT_SPI_PORT             PORTB
+			#define SOFT_SPI_PIN              PINB
+			#define SOFT_SPI_DDR              DDRB
+			#define SOFT_SPI_SCK_MASK         (1 << 1)
+			#define SOFT_SPI_MOSI_MASK        (1 << 2)
+			#define SOFT_SPI_MISO_MASK        (1 << 3)
+		#endif
+
+		/** Number of the fastest ISP speeds, starting from an SCK duration of zero, that are generated by the SPI
+		 *  hardware rather than by the software SPI driver.
+		 */
+		#define ISP_HARDWARE_SCK_DURATIONS    7
 
 		/** ISP rescue clock speed in Hz, for clocking targets with incorrectly set fuses. */
 		#define ISP_RESCUE_CLOCK_SPEED        4000000
 
 	/* External Variables: */
-		extern bool HardwareSPIMode;
+		extern bool    HardwareSPIMode;
+		#if defined(ISP_USART_SPI)
+		extern uint8_t USARTSPIBytesPending;
+		#else
+		extern bool    HardwareSPIBusy;
+		#endif
+		extern uint8_t SoftSPIReceivedByte;
+		#if defined(ISP_ADAPTIVE_WRITE_DELAY)
+		extern bool    TargetBusyOnPoll;
+		#endif
 
 	/* Function Prototypes: */
 		void    ISPTarget_EnableTargetISP(void);
 		void    ISPTarget_DisableTargetISP(void);
+		void    ISPTarget_SetSCKDuration(const uint8_t SCKDuration);
 		void    ISPTarget_ConfigureRescueClock(void);
 		void    ISPTarget_ConfigureSoftwareSPI(const uint8_t SCKDuration);
 		uint8_t ISPTarget_TransferSoftSPIByte(const uint8_t Byte);
@@ -85,33 +137,102 @@
 		                                      const uint8_t DelayMS,
 		                                      const uint8_t ReadMemCommand);
 
+		#if (defined(INCLUDE_FROM_ISPTARGET_C) && defined(ENABLE_ISP_PROTOCOL))
+			static void ISPTarget_WaitForTimedProgComplete(const uint8_t DelayMS);
+		#endif
+
 	/* Inline Functions: */
+		/** Waits until any byte queued by \ref ISPTarget_SendByte has finished shifting out to the target over the
+		 *  hardware SPI. This must be called before any action whose timing relative to the SPI traffic matters, such
+		 *  as a delay or a change of the target's reset line.
+		 */
+		static inline void ISPTarget_FlushSPI(void)
+		{
+			#if defined(ISP_USART_SPI)
+			while (USARTSPIBytesPending)
+			{
+				while (!(UCSR1A & (1 << RXC1)));
+				(void)UDR1;
+				USARTSPIBytesPending--;
+			}
+			#else
+			if (HardwareSPIBusy)
+			{
+				while (!(SPSR & (1 << SPIF)));
+				HardwareSPIBusy = false;
+			}
+			#endif
+		}
+
 		/** Sends a byte of ISP data to the attached target, using the appropriate SPI hardware or
 		 *  software routines depending on the selected ISP speed.
 		 *
+		 *  In hardware SPI mode the byte is only queued; this waits for the previous byte to finish shifting before
+		 *  loading the new one, and returns while the new byte is still shifting. The caller can therefore work out
+		 *  the next byte while the current one is transferred, keeping SCK running with minimal gaps between bytes.
+		 *  When the USART SPI backend is used its transmit buffer is double buffered, so the new byte is loaded as soon
+		 *  as the previous one has started shifting and SCK can run without any gap between bytes.
+		 *
 		 *  \param[in] Byte  Byte of data to send to the attached target
 		 */
 		static inline void ISPTarget_SendByte(const uint8_t Byte)
 		{
 			if (HardwareSPIMode)
-			  SPI_SendByte(Byte);
+			{
+				#if defined(ISP_USART_SPI)
+				while (!(UCSR1A & (1 << UDRE1)));
+
+				/* Discard the replies to all but the most recent byte still in flight, so that the two level receive
+				 * buffer can never overflow and lose the reply to the byte about to be sent */
+				while ((USARTSPIBytesPending > 1) && (UCSR1A & (1 << RXC1)))
+				{
+					(void)UDR1;
+					USARTSPIBytesPending--;
+				}
+
+				UDR1 = Byte;
+				USARTSPIBytesPending++;
+				#else
+				ISPTarget_FlushSPI();
+				SPDR = Byte;
+				HardwareSPIBusy = true;
+				#endif
+			}
 			else
-			  ISPTarget_TransferSoftSPIByte(Byte);
+			{
+				SoftSPIReceivedByte = ISPTarget_TransferSoftSPIByte(Byte);
+			}
 		}
 
-		/** Receives a byte of ISP data from the attached target, using the appropriate
-		 *  SPI hardware or software routines depending on the selected ISP speed.
+		/** Waits for the last byte sent by \ref ISPTarget_SendByte to finish its transfer, and returns the byte
+		 *  received from the target as it was shifted out.
 		 *
 		 *  \return Received byte of data from the attached target
 		 */
-		static inline uint8_t ISPTarget_ReceiveByte(void)
+		static inline uint8_t ISPTarget_ReadQueuedByte(void)
 		{
 			uint8_t ReceivedByte;
 
 			if (HardwareSPIMode)
-			  ReceivedByte = SPI_ReceiveByte();
+			{
+				#if defined(ISP_USART_SPI)
+				ReceivedByte = 0x00;
+
+				while (USARTSPIBytesPending)
+				{
+					while (!(UCSR1A & (1 << RXC1)));
+					ReceivedByte = UDR1;
+					USARTSPIBytesPending--;
+				}
+				#else
+				ISPTarget_FlushSPI();
+				ReceivedByte = SPDR;
+				#endif
+			}
 			else
-			  ReceivedByte = ISPTarget_TransferSoftSPIByte(0x00);
+			{
+				ReceivedByte = SoftSPIReceivedByte;
+			}
 
 			#if defined(INVERTED_ISP_MISO)
 			return ~ReceivedByte;
@@ -129,18 +250,57 @@
 		 */
 		static inline uint8_t ISPTarget_TransferByte(const uint8_t Byte)
 		{
-			uint8_t ReceivedByte;
+			ISPTarget_SendByte(Byte);
+			return ISPTarget_ReadQueuedByte();
+		}
 
-			if (HardwareSPIMode)
-			  ReceivedByte = SPI_TransferByte(Byte);
-			else
-			  ReceivedByte = ISPTarget_TransferSoftSPIByte(Byte);
+		/** Receives a byte of ISP data from the attached target, using the appropriate
+		 *  SPI hardware or software routines depending on the selected ISP speed.
+		 *
+		 *  \return Received byte of data from the attached target
+		 */
+		static inline uint8_t ISPTarget_ReceiveByte(void)
+		{
+			return ISPTarget_TransferByte(0x00);
+		}
 
-			#if defined(INVERTED_ISP_MISO)
-			return ~ReceivedByte;
-			#else
-			return  ReceivedByte;
-			#endif
+		/** Sends a complete four byte low-level ISP instruction to the attached target, back to back. As with
+		 *  \ref ISPTarget_SendByte the last byte may still be shifting out when this returns, and the byte received
+		 *  during it can be retrieved with \ref ISPTarget_ReadQueuedByte.
+		 *
+		 *  \param[in] Byte1  First byte of the instruction, the command
+		 *  \param[in] Byte2  Second byte of the instruction
+		 *  \param[in] Byte3  Third byte of the instruction
+		 *  \param[in] Byte4  Fourth byte of the instruction
+		 */
+		static inline void ISPTarget_SendInstruction(const uint8_t Byte1,
+		                                             const uint8_t Byte2,
+		                                             const uint8_t Byte3,
+		                                             const uint8_t Byte4)
+		{
+			ISPTarget_SendByte(Byte1);
+			ISPTarget_SendByte(Byte2);
+			ISPTarget_SendByte(Byte3);
+			ISPTarget_SendByte(Byte4);
+		}
+
+		/** Sends a complete four byte low-level ISP instruction to the attached target, back to back, and returns the
+		 *  byte received from the target during the last byte of the instruction.
+		 *
+		 *  \param[in] Byte1  First byte of the instruction, the command
+		 *  \param[in] Byte2  Second byte of the instruction
+		 *  \param[in] Byte3  Third byte of the instruction
+		 *  \param[in] Byte4  Fourth byte of the instruction
+		 *
+		 *  \return Received byte of data from the attached target during the last byte of the instruction
+		 */
+		static inline uint8_t ISPTarget_TransferInstruction(const uint8_t Byte1,
+		                                                    const uint8_t Byte2,
+		                                                    const uint8_t Byte3,
+		                                                    const uint8_t Byte4)
+		{
+			ISPTarget_SendInstruction(Byte1, Byte2, Byte3, Byte4);
+			return ISPTarget_ReadQueuedByte();
 		}
 
 #endif
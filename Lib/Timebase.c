@@ -0,0 +1,96 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Free-running microsecond timebase, providing the deadline based timeouts and delays of the V2 protocol handlers.
+ */
+
+#define  INCLUDE_FROM_TIMEBASE_C
+#include "Timebase.h"
+
+/** Time in microseconds at the last overflow of the timebase timer. */
+volatile uint32_t TimebaseOverflowUS;
+
+/** Time in microseconds at which the current timeout period expires. */
+static uint32_t TimeoutDeadlineUS;
+
+
+/** ISR to extend the timebase timer count on each of its overflows, and to flag the expiry of the current timeout
+ *  period once its deadline has passed. The timeout flag is therefore cleared within one overflow period of the
+ *  deadline; code needing an exact deadline checks it with \ref Timebase_HasElapsed instead.
+ */
+ISR(TIMER0_OVF_vect, ISR_NOBLOCK)
+{
+	TimebaseOverflowUS += TIMEBASE_OVERFLOW_US;
+
+	if (TimeoutRemaining && ((int32_t)(TimebaseOverflowUS - TimeoutDeadlineUS) >= 0))
+	  TimeoutRemaining = 0;
+}
+
+/** Starts the timebase, running Timer 0 freely from the system clock divided by 64. */
+void Timebase_Init(void)
+{
+	TimeoutRemaining = 0;
+
+	TCCR0B = 0;
+	TCCR0A = 0;
+	TCNT0  = 0;
+	TIFR0  = (1 << TOV0);
+	TIMSK0 = (1 << TOIE0);
+	TCCR0B = ((1 << CS01) | (1 << CS00));
+}
+
+/** Starts a new timeout period, replacing any current one. \ref TimeoutRemaining is non-zero until it expires.
+ *
+ *  \param[in] TimeoutUS  Length of the timeout period in microseconds
+ */
+void Timebase_StartTimeout(const uint32_t TimeoutUS)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		TimeoutDeadlineUS = (Timebase_GetTimeUS() + TimeoutUS);
+		TimeoutRemaining  = 1;
+	}
+}
+
+/** Blocking delay for a given number of microseconds, timed by the timebase. The delay is never shorter than asked,
+ *  and no more than two timer counts longer bar interrupts. It ends early if the current timeout period expires
+ *  first.
+ *
+ *  \param[in] DelayUS  Number of microseconds to delay for
+ */
+void Timebase_DelayUS(const uint32_t DelayUS)
+{
+	/* The current time may be up to a count ahead of the one read, so an extra count ensures the full delay */
+	uint32_t DeadlineUS = (Timebase_GetTimeUS() + DelayUS + TIMEBASE_US_PER_COUNT);
+
+	while (!(Timebase_HasElapsed(DeadlineUS)) && TimeoutRemaining);
+}
@@ -0,0 +1,108 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2015.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2015  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Header file for Timebase.c.
+ */
+
+#ifndef _TIMEBASE_
+#define _TIMEBASE_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <avr/interrupt.h>
+		#include <util/atomic.h>
+
+		#include <LUFA/Common/Common.h>
+
+	/* Preprocessor Checks: */
+		#if ((64000000UL % F_CPU) != 0)
+			#error The timebase requires F_CPU to divide 64MHz, so that each timer count is a whole number of microseconds.
+		#endif
+
+	/* Macros: */
+		/** Number of microseconds per count of the timebase timer, which runs from the system clock divided by 64. */
+		#define TIMEBASE_US_PER_COUNT      (64000000UL / F_CPU)
+
+		/** Number of microseconds between overflows of the timebase timer. */
+		#define TIMEBASE_OVERFLOW_US       (256 * TIMEBASE_US_PER_COUNT)
+
+		/** Non-zero while the timeout period started by \ref Timebase_StartTimeout has not yet expired, GPIOR for speed. */
+		#define TimeoutRemaining           GPIOR1
+
+	/* External Variables: */
+		extern volatile uint32_t TimebaseOverflowUS;
+
+	/* Function Prototypes: */
+		void Timebase_Init(void);
+		void Timebase_StartTimeout(const uint32_t TimeoutUS);
+		void Timebase_DelayUS(const uint32_t DelayUS);
+
+	/* Inline Functions: */
+		/** Retrieves the current time from the free-running timebase. The time wraps around roughly every 71 minutes,
+		 *  so times must only be compared by their difference, as done by \ref Timebase_HasElapsed.
+		 *
+		 *  \return Current time in microseconds, to a resolution of \ref TIMEBASE_US_PER_COUNT microseconds
+		 */
+		static inline uint32_t Timebase_GetTimeUS(void)
+		{
+			uint32_t TimeUS;
+
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				uint8_t TimerCount = TCNT0;
+
+				TimeUS = TimebaseOverflowUS;
+
+				/* Account for an overflow whose interrupt is still pending, if the count was read after it */
+				if ((TIFR0 & (1 << TOV0)) && !(TimerCount & 0x80))
+				  TimeUS += TIMEBASE_OVERFLOW_US;
+
+				TimeUS += ((uint32_t)TimerCount * TIMEBASE_US_PER_COUNT);
+			}
+
+			return TimeUS;
+		}
+
+		/** Determines if the given deadline has been reached by the timebase.
+		 *
+		 *  \param[in] DeadlineUS  Deadline to check, as a time returned by \ref Timebase_GetTimeUS plus a period
+		 *
+		 *  \return Boolean \c true if the deadline has been reached, \c false otherwise
+		 */
+		static inline bool Timebase_HasElapsed(const uint32_t DeadlineUS)
+		{
+			return ((int32_t)(Timebase_GetTimeUS() - DeadlineUS) >= 0);
+		}
+
+#endif
+
@@ -43,15 +43,6 @@ uint32_t CurrentAddress;
 bool MustLoadExtendedAddress;
 
 
-/** ISR to manage timeouts whilst processing a V2Protocol command */
-ISR(TIMER0_COMPA_vect, ISR_NOBLOCK)
-{
-	if (TimeoutTicksRemaining)
-	  TimeoutTicksRemaining--;
-	else
-	  TCCR0B = 0;
-}
-
 /** Initializes the hardware and software associated with the V2 protocol command handling. */
 void V2Protocol_Init(void)
 {
@@ -62,10 +53,8 @@ void V2Protocol_Init(void)
 	ADC_StartReading(VTARGET_REF_MASK | ADC_RIGHT_ADJUSTED | VTARGET_ADC_CHANNEL_MASK);
 	#endif
 
-	/* Timeout timer initialization (~10ms period) */
-	OCR0A  = (((F_CPU / 1024) / 100) - 1);
-	TCCR0A = (1 << WGM01);
-	TIMSK0 = (1 << OCIE0A);
+	/* Timebase initialization, for command timeouts and delays */
+	Timebase_Init();
 
 	V2Params_LoadNonVolatileParamValues();
 
@@ -82,9 +71,12 @@ void V2Protocol_ProcessCommand(void)
 {
 	uint8_t V2Command = Endpoint_Read_8();
 
-	/* Reset timeout counter duration and start the timer */
-	TimeoutTicksRemaining = COMMAND_TIMEOUT_TICKS;
-	TCCR0B = ((1 << CS02) | (1 << CS00));
+	#if defined(ENABLE_COMMAND_TRACE)
+	CommandTrace_Begin(V2Command);
+	#endif
+
+	/* Start the command's timeout period */
+	Timebase_StartTimeout(COMMAND_TIMEOUT_US);
 
 	switch (V2Command)
 	{
@@ -114,6 +106,8 @@ void V2Protocol_ProcessCommand(void)
 			break;
 		case CMD_READ_FLASH_ISP:
 		case CMD_READ_EEPROM_ISP:
+		case CMD_READ_FLASH_RLE_ISP:
+		case CMD_READ_EEPROM_RLE_ISP:
 			ISPProtocol_ReadMemory(V2Command);
 			break;
 		case CMD_CHIP_ERASE_ISP:
@@ -132,6 +126,16 @@ void V2Protocol_ProcessCommand(void)
 		case CMD_SPI_MULTI:
 			ISPProtocol_SPIMulti();
 			break;
+		case CMD_VERIFY_FLASH_CRC_ISP:
+		case CMD_VERIFY_EEPROM_CRC_ISP:
+			ISPProtocol_VerifyMemoryCRC(V2Command);
+			break;
+	#if defined(ISP_STREAM_PROGRAM_DATA)
+		case CMD_BURST_FLASH_ISP:
+		case CMD_BURST_EEPROM_ISP:
+			ISPProtocol_ProgramMemoryBurst(V2Command);
+			break;
+	#endif
 #endif
 #if defined(ENABLE_XPROG_PROTOCOL)
 		case CMD_XPROG_SETMODE:
@@ -140,18 +144,33 @@ void V2Protocol_ProcessCommand(void)
 		case CMD_XPROG:
 			XPROGProtocol_Command();
 			break;
+#endif
+#if defined(ENABLE_COMMAND_TRACE)
+		case CMD_READ_COMMAND_TRACE:
+			CommandTrace_ReadTrace();
+			break;
 #endif
 		default:
 			V2Protocol_UnknownCommand(V2Command);
 			break;
 	}
 
-	/* Disable the timeout management timer */
-	TCCR0B = 0;
+	/* Wait until the host has read every bank of the response, as a shared endpoint cannot change direction while
+	 * an IN bank is still waiting to be sent - the host is given a fresh timeout period to do so */
+	Timebase_StartTimeout(COMMAND_TIMEOUT_US);
+
+	while (Endpoint_GetBusyBanks())
+	{
+		if ((USB_DeviceState != DEVICE_STATE_Configured) || !(TimeoutRemaining))
+		  break;
+	}
 
-	Endpoint_WaitUntilReady();
 	Endpoint_SelectEndpoint(AVRISP_DATA_OUT_EPADDR);
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_OUT);
+
+	#if defined(ENABLE_COMMAND_TRACE)
+	CommandTrace_End();
+	#endif
 }
 
 /** Handler for unknown V2 protocol commands. This discards all sent data and returns a
@@ -173,7 +192,7 @@ static void V2Protocol_UnknownCommand(const uint8_t V2Command)
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
 	Endpoint_Write_8(V2Command);
-	Endpoint_Write_8(STATUS_CMD_UNKNOWN);
+	V2Protocol_WriteStatus(STATUS_CMD_UNKNOWN);
 	Endpoint_ClearIN();
 }
 
@@ -185,7 +204,7 @@ static void V2Protocol_SignOn(void)
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
 	Endpoint_Write_8(CMD_SIGN_ON);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(STATUS_CMD_OK);
 	Endpoint_Write_8(sizeof(PROGRAMMER_ID) - 1);
 	Endpoint_Write_Stream_LE(PROGRAMMER_ID, (sizeof(PROGRAMMER_ID) - 1), NULL);
 	Endpoint_ClearIN();
@@ -201,7 +220,7 @@ static void V2Protocol_ResetProtection(void)
 	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
 
 	Endpoint_Write_8(CMD_RESET_PROTECTION);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(STATUS_CMD_OK);
 	Endpoint_ClearIN();
 }
 
@@ -229,17 +248,17 @@ static void V2Protocol_GetSetParam(const uint8_t V2Command)
 
 	if ((V2Command == CMD_SET_PARAMETER) && (ParamPrivs & PARAM_PRIV_WRITE))
 	{
-		Endpoint_Write_8(STATUS_CMD_OK);
+		V2Protocol_WriteStatus(STATUS_CMD_OK);
 		V2Params_SetParameterValue(ParamID, ParamValue);
 	}
 	else if ((V2Command == CMD_GET_PARAMETER) && (ParamPrivs & PARAM_PRIV_READ))
 	{
-		Endpoint_Write_8(STATUS_CMD_OK);
+		V2Protocol_WriteStatus(STATUS_CMD_OK);
 		Endpoint_Write_8(V2Params_GetParameterValue(ParamID));
 	}
 	else
 	{
-		Endpoint_Write_8(STATUS_CMD_FAILED);
+		V2Protocol_WriteStatus(STATUS_CMD_FAILED);
 	}
 
 	Endpoint_ClearIN();
@@ -261,7 +280,7 @@ static void V2Protocol_LoadAddress(void)
 	  MustLoadExtendedAddress = true;
 
 	Endpoint_Write_8(CMD_LOAD_ADDRESS);
-	Endpoint_Write_8(STATUS_CMD_OK);
+	V2Protocol_WriteStatus(STATUS_CMD_OK);
 	Endpoint_ClearIN();
 }
 
@@ -46,6 +46,8 @@
 		#include "../Descriptors.h"
 		#include "V2ProtocolConstants.h"
 		#include "V2ProtocolParams.h"
+		#include "Timebase.h"
+		#include "CommandTrace.h"
 		#include "ISP/ISPProtocol.h"
 		#include "XPROG/XPROGProtocol.h"
 		#include "Config/AppConfig.h"
@@ -76,11 +78,8 @@
 		/** Programmer ID string, returned to the host during the CMD_SIGN_ON command processing. */
 		#define PROGRAMMER_ID              "AVRISP_MK2"
 
-		/** Timeout period for each issued command from the host before it is aborted (in 10ms ticks). */
-		#define COMMAND_TIMEOUT_TICKS      100
-
-		/** Command timeout ticks remaining counter, GPIOR for speed. */
-		#define TimeoutTicksRemaining      GPIOR1
+		/** Timeout period for each issued command from the host before it is aborted (in microseconds). */
+		#define COMMAND_TIMEOUT_US         1000000UL
 
 		/** MUX mask for the VTARGET ADC channel number. */
 		#define VTARGET_ADC_CHANNEL_MASK   ADC_GET_CHANNEL_MASK(VTARGET_ADC_CHANNEL)
@@ -101,5 +100,17 @@
 			static void V2Protocol_LoadAddress(void);
 		#endif
 
+	/* Inline Functions: */
+		/** Writes the leading status byte to the response of the current command, recording it in the command trace.
+		 *  Trailing status bytes, sent after the response data, are written directly so as not to replace it.
+		 *
+		 *  \param[in] Status  V2 protocol status byte to write
+		 */
+		static inline void V2Protocol_WriteStatus(const uint8_t Status)
+		{
+			CommandTrace_SetStatus(Status);
+			Endpoint_Write_8(Status);
+		}
+
 #endif
 
@@ -61,6 +61,15 @@
 		#define CMD_XPROG                   0x50
 		#define CMD_XPROG_SETMODE           0x51
 
+		/* Vendor specific commands, not part of the Atmel V2 protocol */
+		#define CMD_VERIFY_FLASH_CRC_ISP    0x60
+		#define CMD_VERIFY_EEPROM_CRC_ISP   0x61
+		#define CMD_BURST_FLASH_ISP         0x62
+		#define CMD_BURST_EEPROM_ISP        0x63
+		#define CMD_READ_FLASH_RLE_ISP      0x64
+		#define CMD_READ_EEPROM_RLE_ISP     0x65
+		#define CMD_READ_COMMAND_TRACE      0x66
+
 		#define STATUS_CMD_OK               0x00
 		#define STATUS_CMD_TOUT             0x80
 		#define STATUS_RDY_BSY_TOUT         0x81
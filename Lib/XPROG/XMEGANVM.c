@@ -80,7 +80,7 @@ bool XMEGANVM_WaitWhileNVMBusBusy(void)
 		uint8_t StatusRegister = XPROGTarget_ReceiveByte();
 
 		/* We might have timed out waiting for the status register read response, check here */
-		if (!(TimeoutTicksRemaining))
+		if (!(TimeoutRemaining))
 		  return false;
 
 		/* Check the status register read response to see if the NVM bus is enabled */
@@ -109,12 +109,14 @@ bool XMEGANVM_WaitWhileNVMControllerBusy(void)
 		uint8_t StatusRegister = XPROGTarget_ReceiveByte();
 
 		/* We might have timed out waiting for the status register read response, check here */
-		if (!(TimeoutTicksRemaining))
+		if (!(TimeoutRemaining))
 		  return false;
 
 		/* Check to see if the BUSY flag is still set */
 		if (!(StatusRegister & (1 << 7)))
 		  return true;
+
+		CommandTrace_CountPoll();
 	}
 }
 
@@ -212,7 +214,7 @@ bool XMEGANVM_GetMemoryCRC(const uint8_t CRCCommand,
 	for (uint8_t i = 0; i < XMEGA_CRC_LENGTH_BYTES; i++)
 	  ((uint8_t*)CRCDest)[i] = XPROGTarget_ReceiveByte();
 
-	return (TimeoutTicksRemaining > 0);
+	return (TimeoutRemaining > 0);
 }
 
 /** Reads memory from the target's memory spaces.
@@ -248,7 +250,7 @@ bool XMEGANVM_ReadMemory(const uint32_t ReadAddress,
 
 		/* Send a LD command with indirect access and post-increment to read out the bytes */
 		XPROGTarget_SendByte(PDI_CMD_LD(PDI_POINTER_INDIRECT_PI, PDI_DATASIZE_1BYTE));
-		while (ReadSize-- && TimeoutTicksRemaining)
+		while (ReadSize-- && TimeoutRemaining)
 		  *(ReadBuffer++) = XPROGTarget_ReceiveByte();
 	}
 	else
@@ -259,7 +261,50 @@ bool XMEGANVM_ReadMemory(const uint32_t ReadAddress,
 		*(ReadBuffer++) = XPROGTarget_ReceiveByte();
 	}
 
-	return (TimeoutTicksRemaining > 0);
+	return (TimeoutRemaining > 0);
+}
+
+/** Compares the target's memory against the contents of a buffer, reading the memory through the NVM controller.
+ *
+ *  \param[in] VerifyAddress  Start address to compare from within the target's address space
+ *  \param[in] VerifyBuffer   Buffer holding the data to compare against, of between 1 and 256 bytes
+ *  \param[in] VerifySize     Number of bytes to compare
+ *
+ *  \return Boolean \c true if the command sequence complete successfully and the memory matched the buffer
+ */
+bool XMEGANVM_VerifyMemory(const uint32_t VerifyAddress,
+                           const uint8_t* VerifyBuffer,
+                           uint16_t VerifySize)
+{
+	bool MemoryMatches = true;
+
+	/* Wait until the NVM controller is no longer busy */
+	if (!(XMEGANVM_WaitWhileNVMControllerBusy()))
+	  return false;
+
+	/* Send the READNVM command to the NVM controller for reading of an arbitrary location */
+	XPROGTarget_SendByte(PDI_CMD_STS(PDI_DATASIZE_4BYTES, PDI_DATASIZE_1BYTE));
+	XMEGANVM_SendNVMRegAddress(XMEGA_NVM_REG_CMD);
+	XPROGTarget_SendByte(XMEGA_NVM_CMD_READNVM);
+
+	/* Load the PDI pointer register with the start address we want to compare from */
+	XPROGTarget_SendByte(PDI_CMD_ST(PDI_POINTER_DIRECT, PDI_DATASIZE_4BYTES));
+	XMEGANVM_SendAddress(VerifyAddress);
+
+	/* Send the REPEAT command with the specified number of bytes to read */
+	XPROGTarget_SendByte(PDI_CMD_REPEAT(PDI_DATASIZE_1BYTE));
+	XPROGTarget_SendByte(VerifySize - 1);
+
+	/* Send a LD command with indirect access and post-increment to read out the bytes - every byte must be received
+	 * even after a mismatch, as the target sends all of them before it accepts a new command */
+	XPROGTarget_SendByte(PDI_CMD_LD(PDI_POINTER_INDIRECT_PI, PDI_DATASIZE_1BYTE));
+	while (VerifySize-- && TimeoutRemaining)
+	{
+		if (XPROGTarget_ReceiveByte() != *(VerifyBuffer++))
+		  MemoryMatches = false;
+	}
+
+	return (MemoryMatches && (TimeoutRemaining > 0));
 }
 
 /** Writes byte addressed memory to the target's memory spaces.
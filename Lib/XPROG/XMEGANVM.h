@@ -118,6 +118,9 @@
 		bool XMEGANVM_ReadMemory(const uint32_t ReadAddress,
 		                         uint8_t* ReadBuffer,
 		                         uint16_t ReadSize);
+		bool XMEGANVM_VerifyMemory(const uint32_t VerifyAddress,
+		                           const uint8_t* VerifyBuffer,
+		                           uint16_t VerifySize);
 		bool XMEGANVM_WriteByteMemory(const uint8_t WriteCommand,
 		                              const uint32_t WriteAddress,
 		                              const uint8_t Byte);
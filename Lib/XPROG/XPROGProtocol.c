@@ -52,6 +52,13 @@ uint8_t  XPROG_Param_NVMCSRRegAddr = 0x32;
 /** Currently selected XPROG programming protocol */
 uint8_t  XPROG_SelectedProtocol    = XPROG_PROTOCOL_PDI;
 
+#if defined(ENABLE_WRITE_SKIP)
+/** Indicates that the PDI target's FLASH has been erased since programming mode was entered, so that any page with
+ *  data other than 0xFF must differ from the target and is written without first being compared against it.
+ */
+static bool FlashErased;
+#endif
+
 /** Handler for the CMD_XPROG_SETMODE command, which sets the programmer-to-target protocol used for PDI/TPI
  *  programming.
  */
@@ -72,7 +79,7 @@ void XPROGProtocol_SetMode(void)
 	XPROG_SelectedProtocol = SetMode_XPROG_Params.Protocol;
 
 	Endpoint_Write_8(CMD_XPROG_SETMODE);
-	Endpoint_Write_8((SetMode_XPROG_Params.Protocol != XPROG_PROTOCOL_JTAG) ? STATUS_CMD_OK : STATUS_CMD_FAILED);
+	V2Protocol_WriteStatus((SetMode_XPROG_Params.Protocol != XPROG_PROTOCOL_JTAG) ? STATUS_CMD_OK : STATUS_CMD_FAILED);
 	Endpoint_ClearIN();
 }
 
@@ -83,6 +90,8 @@ void XPROGProtocol_Command(void)
 {
 	uint8_t XPROGCommand = Endpoint_Read_8();
 
+	CommandTrace_SetSubCommand(XPROGCommand);
+
 	switch (XPROGCommand)
 	{
 		case XPROG_CMD_ENTER_PROGMODE:
@@ -97,6 +106,9 @@ void XPROGProtocol_Command(void)
 		case XPROG_CMD_WRITE_MEM:
 			XPROGProtocol_WriteMemory();
 			break;
+		case XPROG_CMD_WRITE_MEM_BURST:
+			XPROGProtocol_WriteMemoryBurst();
+			break;
 		case XPROG_CMD_READ_MEM:
 			XPROGProtocol_ReadMemory();
 			break;
@@ -118,6 +130,10 @@ static void XPROGProtocol_EnterXPROGMode(void)
 
 	bool NVMBusEnabled = false;
 
+	#if defined(ENABLE_WRITE_SKIP)
+	FlashErased = false;
+	#endif
+
 	if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
 	  NVMBusEnabled = XMEGANVM_EnablePDI();
 	else if (XPROG_SelectedProtocol == XPROG_PROTOCOL_TPI)
@@ -125,7 +141,7 @@ static void XPROGProtocol_EnterXPROGMode(void)
 
 	Endpoint_Write_8(CMD_XPROG);
 	Endpoint_Write_8(XPROG_CMD_ENTER_PROGMODE);
-	Endpoint_Write_8(NVMBusEnabled ? XPROG_ERR_OK : XPROG_ERR_FAILED);
+	V2Protocol_WriteStatus(NVMBusEnabled ? XPROG_ERR_OK : XPROG_ERR_FAILED);
 	Endpoint_ClearIN();
 }
 
@@ -151,7 +167,7 @@ static void XPROGProtocol_LeaveXPROGMode(void)
 
 	Endpoint_Write_8(CMD_XPROG);
 	Endpoint_Write_8(XPROG_CMD_LEAVE_PROGMODE);
-	Endpoint_Write_8(XPROG_ERR_OK);
+	V2Protocol_WriteStatus(XPROG_ERR_OK);
 	Endpoint_ClearIN();
 }
 
@@ -212,6 +228,11 @@ static void XPROGProtocol_Erase(void)
 		/* Erase the target memory, indicate timeout if occurred */
 		if (!(XMEGANVM_EraseMemory(EraseCommand, Erase_XPROG_Params.Address)))
 		  ReturnStatus = XPROG_ERR_TIMEOUT;
+
+		#if defined(ENABLE_WRITE_SKIP)
+		if ((Erase_XPROG_Params.MemoryType == XPROG_ERASE_CHIP) && (ReturnStatus == XPROG_ERR_OK))
+		  FlashErased = true;
+		#endif
 	}
 	else
 	{
@@ -227,10 +248,56 @@ static void XPROGProtocol_Erase(void)
 
 	Endpoint_Write_8(CMD_XPROG);
 	Endpoint_Write_8(XPROG_CMD_ERASE);
-	Endpoint_Write_8(ReturnStatus);
+	V2Protocol_WriteStatus(ReturnStatus);
 	Endpoint_ClearIN();
 }
 
+/** Determines the NVM commands used to write to a specific memory space of a PDI target.
+ *
+ *  \param[in]  MemoryType        XPROG memory type to write to
+ *  \param[out] WriteCommand      NVM command to write a page or byte of the memory space
+ *  \param[out] WriteBuffCommand  NVM command to load the page buffer, for paged memory spaces
+ *  \param[out] EraseBuffCommand  NVM command to erase the page buffer, for paged memory spaces
+ *
+ *  \return Boolean \c true if the memory space is written a page at a time, \c false if it is written by byte
+ */
+static bool XPROGProtocol_GetPDIWriteCommands(const uint8_t MemoryType,
+                                              uint8_t* const WriteCommand,
+                                              uint8_t* const WriteBuffCommand,
+                                              uint8_t* const EraseBuffCommand)
+{
+	/* Assume FLASH page programming by default, as it is the common case */
+	*WriteCommand     = XMEGA_NVM_CMD_WRITEFLASHPAGE;
+	*WriteBuffCommand = XMEGA_NVM_CMD_LOADFLASHPAGEBUFF;
+	*EraseBuffCommand = XMEGA_NVM_CMD_ERASEFLASHPAGEBUFF;
+
+	switch (MemoryType)
+	{
+		case XPROG_MEM_TYPE_APPL:
+			*WriteCommand     = XMEGA_NVM_CMD_WRITEAPPSECPAGE;
+			break;
+		case XPROG_MEM_TYPE_BOOT:
+			*WriteCommand     = XMEGA_NVM_CMD_WRITEBOOTSECPAGE;
+			break;
+		case XPROG_MEM_TYPE_EEPROM:
+			*WriteCommand     = XMEGA_NVM_CMD_ERASEWRITEEEPROMPAGE;
+			*WriteBuffCommand = XMEGA_NVM_CMD_LOADEEPROMPAGEBUFF;
+			*EraseBuffCommand = XMEGA_NVM_CMD_ERASEEEPROMPAGEBUFF;
+			break;
+		case XPROG_MEM_TYPE_USERSIG:
+			*WriteCommand     = XMEGA_NVM_CMD_WRITEUSERSIG;
+			break;
+		case XPROG_MEM_TYPE_FUSE:
+			*WriteCommand     = XMEGA_NVM_CMD_WRITEFUSE;
+			return false;
+		case XPROG_MEM_TYPE_LOCKBITS:
+			*WriteCommand     = XMEGA_NVM_CMD_WRITELOCK;
+			return false;
+	}
+
+	return true;
+}
+
 /** Handler for the XPROG WRITE_MEMORY command to write to a specific memory space within the attached device. */
 static void XPROGProtocol_WriteMemory(void)
 {
@@ -253,8 +320,8 @@ static void XPROGProtocol_WriteMemory(void)
 
 	// The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
 	// to catch this and discard it before continuing on with packet processing to prevent communication issues
-	if (((sizeof(uint8_t) + sizeof(WriteMemory_XPROG_Params) - sizeof(WriteMemory_XPROG_Params.ProgData)) +
-	    WriteMemory_XPROG_Params.Length) % AVRISP_DATA_EPSIZE == 0)
+	if (((sizeof(uint8_t) + sizeof(uint8_t) + sizeof(WriteMemory_XPROG_Params) -
+	      sizeof(WriteMemory_XPROG_Params.ProgData)) + WriteMemory_XPROG_Params.Length) % AVRISP_DATA_EPSIZE == 0)
 	{
 		Endpoint_ClearOUT();
 		Endpoint_WaitUntilReady();
@@ -266,44 +333,49 @@ static void XPROGProtocol_WriteMemory(void)
 
 	if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
 	{
-		/* Assume FLASH page programming by default, as it is the common case */
-		uint8_t WriteCommand     = XMEGA_NVM_CMD_WRITEFLASHPAGE;
-		uint8_t WriteBuffCommand = XMEGA_NVM_CMD_LOADFLASHPAGEBUFF;
-		uint8_t EraseBuffCommand = XMEGA_NVM_CMD_ERASEFLASHPAGEBUFF;
-		bool    PagedMemory      = true;
+		uint8_t WriteCommand;
+		uint8_t WriteBuffCommand;
+		uint8_t EraseBuffCommand;
+		bool    PagedMemory = XPROGProtocol_GetPDIWriteCommands(WriteMemory_XPROG_Params.MemoryType, &WriteCommand,
+		                                                        &WriteBuffCommand, &EraseBuffCommand);
+
+		bool PageUnchanged = false;
+
+		#if defined(ENABLE_WRITE_SKIP)
+		/* A page held entirely in this command can be skipped if writing it would not change the target's memory */
+		uint8_t WholePageMode = (XPROG_PAGEMODE_ERASE | XPROG_PAGEMODE_WRITE);
 
-		switch (WriteMemory_XPROG_Params.MemoryType)
+		if (PagedMemory && ((WriteMemory_XPROG_Params.PageMode & WholePageMode) == WholePageMode) &&
+		    WriteMemory_XPROG_Params.Length)
 		{
-			case XPROG_MEM_TYPE_APPL:
-				WriteCommand     = XMEGA_NVM_CMD_WRITEAPPSECPAGE;
-				break;
-			case XPROG_MEM_TYPE_BOOT:
-				WriteCommand     = XMEGA_NVM_CMD_WRITEBOOTSECPAGE;
-				break;
-			case XPROG_MEM_TYPE_EEPROM:
-				WriteCommand     = XMEGA_NVM_CMD_ERASEWRITEEEPROMPAGE;
-				WriteBuffCommand = XMEGA_NVM_CMD_LOADEEPROMPAGEBUFF;
-				EraseBuffCommand = XMEGA_NVM_CMD_ERASEEEPROMPAGEBUFF;
-				break;
-			case XPROG_MEM_TYPE_USERSIG:
-				WriteCommand     = XMEGA_NVM_CMD_WRITEUSERSIG;
-				break;
-			case XPROG_MEM_TYPE_FUSE:
-				WriteCommand     = XMEGA_NVM_CMD_WRITEFUSE;
-				PagedMemory      = false;
-				break;
-			case XPROG_MEM_TYPE_LOCKBITS:
-				WriteCommand     = XMEGA_NVM_CMD_WRITELOCK;
-				PagedMemory      = false;
-				break;
+			bool FlashMemory = ((WriteMemory_XPROG_Params.MemoryType == XPROG_MEM_TYPE_APPL) ||
+			                    (WriteMemory_XPROG_Params.MemoryType == XPROG_MEM_TYPE_BOOT));
+
+			PageUnchanged = FlashMemory;
+
+			/* The FLASH page write commands can only clear bits, so a page of all 0xFF never changes it */
+			for (uint16_t CurrentByte = 0; PageUnchanged && (CurrentByte < WriteMemory_XPROG_Params.Length); CurrentByte++)
+			{
+				if (WriteMemory_XPROG_Params.ProgData[CurrentByte] != 0xFF)
+				  PageUnchanged = false;
+			}
+
+			if (!(PageUnchanged) && !(FlashMemory && FlashErased))
+			{
+				PageUnchanged = XMEGANVM_VerifyMemory(WriteMemory_XPROG_Params.Address, WriteMemory_XPROG_Params.ProgData,
+				                                      WriteMemory_XPROG_Params.Length);
+			}
 		}
+		#endif
 
-		/* Send the appropriate memory write commands to the device, indicate timeout if occurred */
-		if ((PagedMemory && !(XMEGANVM_WritePageMemory(WriteBuffCommand, EraseBuffCommand, WriteCommand,
+		/* Send the appropriate memory write commands to the device unless the page is unchanged, indicate timeout if
+		 * occurred */
+		if (!(PageUnchanged) &&
+		    ((PagedMemory && !(XMEGANVM_WritePageMemory(WriteBuffCommand, EraseBuffCommand, WriteCommand,
 													   WriteMemory_XPROG_Params.PageMode, WriteMemory_XPROG_Params.Address,
 													   WriteMemory_XPROG_Params.ProgData, WriteMemory_XPROG_Params.Length))) ||
-		   (!PagedMemory && !(XMEGANVM_WriteByteMemory(WriteCommand, WriteMemory_XPROG_Params.Address,
-													   WriteMemory_XPROG_Params.ProgData[0]))))
+		    (!PagedMemory && !(XMEGANVM_WriteByteMemory(WriteCommand, WriteMemory_XPROG_Params.Address,
+													   WriteMemory_XPROG_Params.ProgData[0])))))
 		{
 			ReturnStatus = XPROG_ERR_TIMEOUT;
 		}
@@ -320,7 +392,171 @@ static void XPROGProtocol_WriteMemory(void)
 
 	Endpoint_Write_8(CMD_XPROG);
 	Endpoint_Write_8(XPROG_CMD_WRITE_MEM);
-	Endpoint_Write_8(ReturnStatus);
+	V2Protocol_WriteStatus(ReturnStatus);
+	Endpoint_ClearIN();
+}
+
+/** Waits until the NVM controller of the attached device, over the currently selected protocol, is no longer busy.
+ *
+ *  \return Boolean \c true if the NVM controller became ready, \c false if the command timeout expired first
+ */
+static bool XPROGProtocol_WaitWhileNVMControllerBusy(void)
+{
+	if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
+	  return XMEGANVM_WaitWhileNVMControllerBusy();
+	else
+	  return TINYNVM_WaitWhileNVMControllerBusy();
+}
+
+/** Handler for the vendor specific XPROG WRITE_MEMORY_BURST command, writing a contiguous image of any length to a
+ *  paged memory space of the attached device page by page. Each page is read from the endpoint and loaded into the
+ *  target's page buffer in pieces no larger than a regular WRITE_MEMORY command, so that a single command and response
+ *  replace one round trip per piece. The command stops at the first page that fails, and reports the number of pages
+ *  the target's NVM controller has finished writing before it.
+ */
+static void XPROGProtocol_WriteMemoryBurst(void)
+{
+	uint8_t ReturnStatus = XPROG_ERR_OK;
+
+	struct
+	{
+		uint8_t  MemoryType;
+		uint32_t Address;
+		uint16_t PageSize;
+		uint32_t Length;
+	} WriteBurst_XPROG_Params;
+
+	Endpoint_Read_Stream_LE(&WriteBurst_XPROG_Params, sizeof(WriteBurst_XPROG_Params), NULL);
+	WriteBurst_XPROG_Params.Address  = SwapEndian_32(WriteBurst_XPROG_Params.Address);
+	WriteBurst_XPROG_Params.PageSize = SwapEndian_16(WriteBurst_XPROG_Params.PageSize);
+	WriteBurst_XPROG_Params.Length   = SwapEndian_32(WriteBurst_XPROG_Params.Length);
+
+	uint8_t  WriteCommand;
+	uint8_t  WriteBuffCommand;
+	uint8_t  EraseBuffCommand;
+	uint32_t BytesRemaining = WriteBurst_XPROG_Params.Length;
+	uint16_t PagesWritten   = 0;
+	bool     PagePending    = false;
+	uint8_t  ProgData[256];
+
+	/* PDI fuses and lockbits are written a byte at a time and cannot be burst written, while TPI targets write all
+	 * of their memory by word */
+	bool PagedMemory = (XPROGProtocol_GetPDIWriteCommands(WriteBurst_XPROG_Params.MemoryType, &WriteCommand,
+	                                                      &WriteBuffCommand, &EraseBuffCommand) ||
+	                    (XPROG_SelectedProtocol != XPROG_PROTOCOL_PDI));
+
+	if (!(PagedMemory) || !(WriteBurst_XPROG_Params.PageSize))
+	  ReturnStatus = XPROG_ERR_FAILED;
+
+	while (BytesRemaining && (ReturnStatus == XPROG_ERR_OK))
+	{
+		uint16_t PageBytes  = MIN(BytesRemaining, WriteBurst_XPROG_Params.PageSize);
+		uint16_t PageOffset = 0;
+
+		/* Each page gets a fresh timeout period, so that the length of the image is not limited by it */
+		Timebase_StartTimeout(COMMAND_TIMEOUT_US);
+
+		while (PageOffset < PageBytes)
+		{
+			uint16_t ChunkBytes   = MIN((uint16_t)(PageBytes - PageOffset), sizeof(ProgData));
+			uint32_t ChunkAddress = (WriteBurst_XPROG_Params.Address + PageOffset);
+			bool     ChunkWritten;
+
+			if (Endpoint_Read_Stream_LE(ProgData, ChunkBytes, NULL) != ENDPOINT_RWSTREAM_NoError)
+			{
+				ReturnStatus = XPROG_ERR_TIMEOUT;
+				break;
+			}
+
+			BytesRemaining -= ChunkBytes;
+
+			/* A page only counts as written once the NVM controller has finished with it, which is checked after the
+			 * first piece of the next page has been read so that the page write still overlaps the transfer */
+			if (PagePending)
+			{
+				if (!(XPROGProtocol_WaitWhileNVMControllerBusy()))
+				{
+					ReturnStatus = XPROG_ERR_TIMEOUT;
+					break;
+				}
+
+				PagesWritten++;
+				PagePending = false;
+			}
+
+			if (XPROG_SelectedProtocol == XPROG_PROTOCOL_PDI)
+			{
+				/* Erase the target's page buffer before the first piece of the page, and write the page after the last */
+				uint8_t PageMode = 0;
+
+				if (!(PageOffset))
+				  PageMode |= XPROG_PAGEMODE_ERASE;
+
+				if ((PageOffset + ChunkBytes) == PageBytes)
+				  PageMode |= XPROG_PAGEMODE_WRITE;
+
+				ChunkWritten = XMEGANVM_WritePageMemory(WriteBuffCommand, EraseBuffCommand, WriteCommand, PageMode,
+				                                        ChunkAddress, ProgData, ChunkBytes);
+			}
+			else
+			{
+				ChunkWritten = TINYNVM_WriteMemory(ChunkAddress, ProgData, ChunkBytes);
+			}
+
+			if (!(ChunkWritten))
+			{
+				ReturnStatus = XPROG_ERR_TIMEOUT;
+				break;
+			}
+
+			PageOffset += ChunkBytes;
+		}
+
+		if (ReturnStatus == XPROG_ERR_OK)
+		{
+			WriteBurst_XPROG_Params.Address += PageBytes;
+			PagePending = true;
+		}
+	}
+
+	/* Wait for the last page written to finish programming, so that it is counted, or its failure reported, by this
+	 * command even if a later page could not be received */
+	if (PagePending)
+	{
+		if (XPROGProtocol_WaitWhileNVMControllerBusy())
+		  PagesWritten++;
+		else
+		  ReturnStatus = XPROG_ERR_TIMEOUT;
+	}
+
+	/* Discard the rest of the image after a failed page, in pieces as it may be too long for a single stream */
+	while (BytesRemaining)
+	{
+		uint16_t DiscardBytes = MIN(BytesRemaining, 0x8000);
+
+		if (Endpoint_Discard_Stream(DiscardBytes, NULL) != ENDPOINT_RWSTREAM_NoError)
+		  break;
+
+		BytesRemaining -= DiscardBytes;
+	}
+
+	// The driver will terminate transfers that are a round multiple of the endpoint bank in size with a ZLP, need
+	// to catch this and discard it before continuing on with packet processing to prevent communication issues
+	if (((sizeof(uint8_t) + sizeof(uint8_t) + sizeof(WriteBurst_XPROG_Params)) + WriteBurst_XPROG_Params.Length) %
+	    AVRISP_DATA_EPSIZE == 0)
+	{
+		Endpoint_ClearOUT();
+		Endpoint_WaitUntilReady();
+	}
+
+	Endpoint_ClearOUT();
+	Endpoint_SelectEndpoint(AVRISP_DATA_IN_EPADDR);
+	Endpoint_SetEndpointDirection(ENDPOINT_DIR_IN);
+
+	Endpoint_Write_8(CMD_XPROG);
+	Endpoint_Write_8(XPROG_CMD_WRITE_MEM_BURST);
+	V2Protocol_WriteStatus(ReturnStatus);
+	Endpoint_Write_16_BE(PagesWritten);
 	Endpoint_ClearIN();
 }
 
@@ -363,7 +599,7 @@ static void XPROGProtocol_ReadMemory(void)
 
 	Endpoint_Write_8(CMD_XPROG);
 	Endpoint_Write_8(XPROG_CMD_READ_MEM);
-	Endpoint_Write_8(ReturnStatus);
+	V2Protocol_WriteStatus(ReturnStatus);
 
 	if (ReturnStatus == XPROG_ERR_OK)
 	  Endpoint_Write_Stream_LE(ReadBuffer, ReadMemory_XPROG_Params.Length, NULL);
@@ -421,7 +657,7 @@ static void XPROGProtocol_ReadCRC(void)
 
 	Endpoint_Write_8(CMD_XPROG);
 	Endpoint_Write_8(XPROG_CMD_CRC);
-	Endpoint_Write_8(ReturnStatus);
+	V2Protocol_WriteStatus(ReturnStatus);
 
 	if (ReturnStatus == XPROG_ERR_OK)
 	{
@@ -473,7 +709,7 @@ static void XPROGProtocol_SetParam(void)
 
 	Endpoint_Write_8(CMD_XPROG);
 	Endpoint_Write_8(XPROG_CMD_SET_PARAM);
-	Endpoint_Write_8(ReturnStatus);
+	V2Protocol_WriteStatus(ReturnStatus);
 	Endpoint_ClearIN();
 }
 
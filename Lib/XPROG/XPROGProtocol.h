@@ -70,6 +70,9 @@
 		#define XPROG_CMD_CRC                        0x06
 		#define XPROG_CMD_SET_PARAM                  0x07
 
+		/* Vendor specific commands, not part of the Atmel XPROG protocol */
+		#define XPROG_CMD_WRITE_MEM_BURST            0x60
+
 		#define XPROG_MEM_TYPE_APPL                  1
 		#define XPROG_MEM_TYPE_BOOT                  2
 		#define XPROG_MEM_TYPE_EEPROM                3
@@ -127,7 +130,13 @@
 			static void XPROGProtocol_LeaveXPROGMode(void);
 			static void XPROGProtocol_SetParam(void);
 			static void XPROGProtocol_Erase(void);
+			static bool XPROGProtocol_GetPDIWriteCommands(const uint8_t MemoryType,
+			                                              uint8_t* const WriteCommand,
+			                                              uint8_t* const WriteBuffCommand,
+			                                              uint8_t* const EraseBuffCommand);
 			static void XPROGProtocol_WriteMemory(void);
+			static bool XPROGProtocol_WaitWhileNVMControllerBusy(void);
+			static void XPROGProtocol_WriteMemoryBurst(void);
 			static void XPROGProtocol_ReadMemory(void);
 			static void XPROGProtocol_ReadCRC(void);
 		#endif
@@ -34,22 +34,66 @@
  *  the project and is responsible for the initial application hardware configuration.
  */
 
+#define  INCLUDE_FROM_USBTOSERIAL_C
 #include "USBtoSerial.h"
 
 /** Current firmware mode, making the device behave as either a programmer or a USART bridge */
 bool CurrentFirmwareMode = MODE_USART_BRIDGE;
 
-/** Circular buffer to hold data from the host before it is sent to the device via the serial port. */
-static RingBuffer_t USBtoUSART_Buffer;
+/** Circular buffer to hold data from the host before it is sent to the device via the serial port. Filled by the
+ *  main loop and drained by the USART transmit interrupt.
+ */
+static BridgeRingBuffer_t USBtoUSART_Buffer;
+
+/** Circular buffer to hold data from the serial port before it is sent to the host. Filled by the USART receive
+ *  interrupt and drained by the main loop.
+ */
+static BridgeRingBuffer_t USARTtoUSB_Buffer;
+
+/** Memory needed by only one of the firmware modes. The mode is selected at startup and never changes, so the
+ *  USART bridge buffers share their memory with the programmer's command trace rather than adding to it.
+ */
+static union
+{
+	struct
+	{
+		uint8_t USBtoUSART_Data[USB_TO_USART_BUFFER_SIZE]; /**< Underlying data buffer for \ref USBtoUSART_Buffer */
+		uint8_t USARTtoUSB_Data[USART_TO_USB_BUFFER_SIZE]; /**< Underlying data buffer for \ref USARTtoUSB_Buffer */
+	} Bridge;
 
-/** Underlying data buffer for \ref USBtoUSART_Buffer, where the stored bytes are located. */
-static uint8_t      USBtoUSART_Buffer_Data[128];
+	#if defined(ENABLE_COMMAND_TRACE)
+	CommandTrace_Storage_t CommandTrace; /**< Records and latency histograms of the programmer's command trace */
+	#endif
+} ModeBuffers;
 
-/** Circular buffer to hold data from the serial port before it is sent to the host. */
-static RingBuffer_t USARTtoUSB_Buffer;
+/** Current USART to USB latency timer period in microseconds, or zero if received data is sent to the host as
+ *  soon as possible. Partial packets are held back until the USART line has been idle for this period.
+ */
+static uint16_t     LatencyTimerUS;
 
-/** Underlying data buffer for \ref USARTtoUSB_Buffer, where the stored bytes are located. */
-static uint8_t      USARTtoUSB_Buffer_Data[128];
+/** Baud rate generator settings currently applied to the USART, along with the resulting actual baud rate and its
+ *  error relative to the rate requested by the host.
+ */
+static UARTBridge_BaudInfo_t CurrentBaudInfo;
+
+/** Running bridge statistics, reported to the host on request. Byte counts and the host to target high water mark
+ *  are maintained by the main loop, the remainder by the USART receive interrupt.
+ */
+static volatile UARTBridge_Statistics_t BridgeStatistics;
+
+/** Mask of \c CDC_CONTROL_LINE_IN_* error flags raised by the USART receive interrupt since the last SerialState
+ *  notification was sent to the host.
+ */
+static volatile uint8_t PendingLineErrors;
+
+/** Pulse periods in milliseconds remaining for the TX and RX activity LEDs. The data paths only reload these, the
+ *  LEDs themselves are driven from the USB Start of Frame tick.
+ */
+static volatile struct
+{
+	uint8_t TxLEDPulse; /**< Milliseconds remaining for data Tx LED pulse */
+	uint8_t RxLEDPulse; /**< Milliseconds remaining for data Rx LED pulse */
+} PulseMSRemaining;
 
 /** LUFA CDC Class driver interface configuration and state information. This structure is
  *  passed to all CDC Class driver functions, so that multiple instances of the same class
@@ -64,13 +108,13 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 					{
 						.Address                = CDC_TX_EPADDR,
 						.Size                   = CDC_TXRX_EPSIZE,
-						.Banks                  = 1,
+						.Banks                  = CDC_TXRX_EPBANKS,
 					},
 				.DataOUTEndpoint                =
 					{
 						.Address                = CDC_RX_EPADDR,
 						.Size                   = CDC_TXRX_EPSIZE,
-						.Banks                  = 1,
+						.Banks                  = CDC_TXRX_EPBANKS,
 					},
 				.NotificationEndpoint           =
 					{
@@ -83,115 +127,288 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 
 
 /** Main program entry point. This routine contains the overall program flow, including initial
- *  setup of all components and the main program loop.
+ *  setup of all components and the main program loop. The loop is event driven; interrupts flag the work
+ *  they leave for the main loop in \ref PendingTasks, and the CPU idles in sleep mode until there is some.
  */
 int main(void)
 {
 	SetupHardware();
-	uint16_t counter = 0;
 
 	if (CurrentFirmwareMode == MODE_USART_BRIDGE)
 	{
-		RingBuffer_InitBuffer(&USBtoUSART_Buffer, USBtoUSART_Buffer_Data, sizeof(USBtoUSART_Buffer_Data));
-		RingBuffer_InitBuffer(&USARTtoUSB_Buffer, USARTtoUSB_Buffer_Data, sizeof(USARTtoUSB_Buffer_Data));
+		BridgeRingBuffer_InitBuffer(&USBtoUSART_Buffer, ModeBuffers.Bridge.USBtoUSART_Data,
+		                            sizeof(ModeBuffers.Bridge.USBtoUSART_Data));
+		BridgeRingBuffer_InitBuffer(&USARTtoUSB_Buffer, ModeBuffers.Bridge.USARTtoUSB_Data,
+		                            sizeof(ModeBuffers.Bridge.USARTtoUSB_Data));
+
+		#if defined(ENABLE_BRIDGE_FLOW_CONTROL)
+		/* Hold the target off with RTS until the device is configured, and watch CTS for changes */
+		BRIDGE_RTS_PORT |=  BRIDGE_RTS_MASK;
+		BRIDGE_RTS_DDR  |=  BRIDGE_RTS_MASK;
+		BRIDGE_CTS_DDR  &= ~BRIDGE_CTS_MASK;
+		BRIDGE_CTS_PORT |=  BRIDGE_CTS_MASK;
+		PCMSK0          |=  BRIDGE_CTS_MASK;
+		PCICR           |=  (1 << PCIE0);
+		#endif
 	}
 	else
 	{
+		#if defined(ENABLE_COMMAND_TRACE)
+		CommandTrace_Init(&ModeBuffers.CommandTrace);
+		#endif
+
 		V2Protocol_Init();
 	}
-	
+
+	PendingTasks = 0;
+	set_sleep_mode(SLEEP_MODE_IDLE);
 	GlobalInterruptEnable();
 
 	for (;;)
 	{
+		/* Sleep until an interrupt flags some work - interrupts are only re-enabled by the instruction before the
+		 * sleep instruction, so that a task flagged after the check still wakes the CPU immediately */
+		GlobalInterruptDisable();
+
+		if (!(PendingTasks))
+		{
+			sleep_enable();
+			GlobalInterruptEnable();
+			sleep_cpu();
+			sleep_disable();
+		}
+
+		GlobalInterruptEnable();
+
+		uint8_t Tasks;
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			Tasks        = PendingTasks;
+			PendingTasks = 0;
+		}
+
+		if (Tasks & TASK_USB)
+		{
+			USB_USBTask();
+
+			/* Wake again on the next control request from the host */
+			Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+			UEIENX |= (1 << RXSTPE);
+		}
+
 		if (CurrentFirmwareMode == MODE_USART_BRIDGE)
+		  UARTBridge_Task(Tasks);
+		else if (Tasks & TASK_USB)
+		  AVRISP_Task();
+	}
+}
+
+/** Moves data between the USART buffers and the CDC endpoints, for the work flagged by the interrupts. Endpoint
+ *  interrupts are armed before returning for any work left waiting on the host, so that the main loop can sleep
+ *  in the meantime.
+ *
+ *  \param[in] Tasks  Mask of \c TASK_* flags for the work to perform
+ */
+void UARTBridge_Task(const uint8_t Tasks)
+{
+	static bool TransferNeedsTermination = false;
+	static bool HostDataPaused = false;
+
+	/* Device must be connected and configured for the task to run */
+	if (USB_DeviceState != DEVICE_STATE_Configured)
+	  return;
+
+	if (Tasks & (TASK_USB | TASK_BRIDGE_USB_TO_USART))
+	{
+		/* Move any data received from the host into the USART transmit buffer, a contiguous block at a time */
+		Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.DataOUTEndpoint.Address);
+
+		#if defined(ENABLE_BRIDGE_FLOW_CONTROL)
+		/* Stop accepting host data at the buffer's high watermark, and only resume once it has drained to the low
+		 * watermark so that whole banks are accepted rather than a few bytes at a time */
+		uint8_t TransmitCount = BridgeRingBuffer_GetCount(&USBtoUSART_Buffer);
+
+		if (TransmitCount >= USB_TO_USART_HIGH_WATERMARK)
+		  HostDataPaused = true;
+		else if (TransmitCount <= USB_TO_USART_LOW_WATERMARK)
+		  HostDataPaused = false;
+		#endif
+
+		/* Drain each bank the host has filled in turn, so the host can refill one while the next is processed */
+		while (!(HostDataPaused) && Endpoint_IsOUTReceived())
 		{
-			/* Only try to read in bytes from the CDC interface if the transmit buffer is not full */
-			if (!(RingBuffer_IsFull(&USBtoUSART_Buffer)))
+			uint16_t BytesReceived = UARTBridge_ReceiveBlock(&USBtoUSART_Buffer);
+
+			if (BytesReceived)
 			{
-				int16_t ReceivedByte = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
+				uint8_t TransmitLevel = BridgeRingBuffer_GetCount(&USBtoUSART_Buffer);
 
-				/* Store received byte into the USART transmit buffer */
-				if (!(ReceivedByte < 0))
-				{
-					#if (BOARD == BOARD_GSCHEIDUINO)
-						LEDS_PORT &= ~(LEDMASK_RX);
-					#else
-						LEDS_PORT |= (LEDMASK_RX);
-					#endif
-					counter = 0;
-					RingBuffer_Insert(&USBtoUSART_Buffer, ReceivedByte);
-				}
+				BridgeStatistics.USBtoUSARTBytes += BytesReceived;
+				if (TransmitLevel > BridgeStatistics.USBtoUSARTHighWater)
+				  BridgeStatistics.USBtoUSARTHighWater = TransmitLevel;
+
+				/* Start the interrupt driven transmitter, if it has run out of data and stopped */
+				UCSR1B |= (1 << UDRIE1);
+
+				PulseMSRemaining.RxLEDPulse = LED_ACTIVITY_PULSE_MS;
+			}
+
+			/* Leave a partially consumed bank in place until there is room in the transmit buffer */
+			if (Endpoint_BytesInEndpoint())
+			  break;
+
+			/* Release the bank back to the host once it has been fully consumed (including zero length packets) */
+			Endpoint_ClearOUT();
+		}
+
+		/* Wake on the next packet from the host once all banks are consumed; a bank left waiting for buffer space
+		 * is instead resumed by the transmit interrupt as the buffer drains */
+		if (!(HostDataPaused) && !(Endpoint_IsOUTReceived()))
+		  UEIENX |= (1 << RXOUTE);
+	}
+
+	if (Tasks & (TASK_USB | TASK_BRIDGE_USART_TO_USB))
+	{
+		Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.DataINEndpoint.Address);
+
+		/* Fill each free bank in turn, so the next packet is already queued while the host reads the current one;
+		 * if no bank is free a packet is already enqueued to the host, and we shouldn't wait for it to complete
+		 * as there is a chance nothing is listening and a lengthy timeout could occur */
+		for (;;)
+		{
+			/* Wake once the host frees a bank, as there is more data or a ZLP still to send */
+			if (!(Endpoint_IsINReady()))
+			{
+				UEIENX |= (1 << TXINE);
+				break;
 			}
 
-			uint16_t BufferCount = RingBuffer_GetCount(&USARTtoUSB_Buffer);
-			if (BufferCount)
+			uint8_t BufferCount = BridgeRingBuffer_GetCount(&USARTtoUSB_Buffer);
+
+			if (!(BufferCount))
 			{
-				#if (BOARD == BOARD_GSCHEIDUINO)
-				LEDS_PORT &= ~(LEDMASK_TX);
-				#else
-				LEDS_PORT |= (LEDMASK_TX);
-				#endif
-				counter = 0;
-				Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.DataINEndpoint.Address);
-
-				/* Check if a packet is already enqueued to the host - if so, we shouldn't try to send more data
-				 * until it completes as there is a chance nothing is listening and a lengthy timeout could occur */
-				if (Endpoint_IsINReady())
+				/* No more data is waiting - send a Zero Length Packet (ZLP) if needed so the host completes the
+				 * transfer, without blocking on the bank in case the host isn't listening */
+				if (TransferNeedsTermination)
 				{
-					/* Never send more than one bank size less one byte to the host at a time, so that we don't block
-					 * while a Zero Length Packet (ZLP) to terminate the transfer is sent if the host isn't listening */
-					uint8_t BytesToSend = MIN(BufferCount, (CDC_TXRX_EPSIZE - 1));
-
-					/* Read bytes from the USART receive buffer into the USB IN endpoint */
-					while (BytesToSend--)
-					{
-						
-						/* Try to send the next byte of data to the host, abort if there is an error without dequeuing */
-						if (CDC_Device_SendByte(&VirtualSerial_CDC_Interface,
-												RingBuffer_Peek(&USARTtoUSB_Buffer)) != ENDPOINT_READYWAIT_NoError)
-						{
-							break;
-						}
-
-						/* Dequeue the already sent byte from the buffer now we have confirmed that no transmission error occurred */
-						RingBuffer_Remove(&USARTtoUSB_Buffer);
-					}
+					Endpoint_ClearIN();
+					TransferNeedsTermination = false;
 				}
+
+				break;
 			}
 
-			/* Load the next byte from the USART transmit buffer into the USART if transmit buffer space is available */
-			if (Serial_IsSendReady() && !(RingBuffer_IsEmpty(&USBtoUSART_Buffer)))
-			  Serial_SendByte(RingBuffer_Remove(&USBtoUSART_Buffer));
+			/* Coalesce short bursts into fewer packets - partial packets wait for the latency timer to expire, and
+			 * a transfer ended by a full packet is left open for them rather than terminated with a ZLP */
+			if ((BufferCount < CDC_TXRX_EPSIZE) && LatencyTimerUS && !(TIFR0 & (1 << OCF0A)))
+			  break;
 
-			CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
-		}
-		else
-		{
-			AVRISP_Task();
+			PulseMSRemaining.TxLEDPulse = LED_ACTIVITY_PULSE_MS;
+
+			/* Copy up to a full bank out of the USART receive buffer in one go, and send it to the host */
+			uint8_t BytesToSend = MIN(BufferCount, CDC_TXRX_EPSIZE);
+			UARTBridge_SendBlock(&USARTtoUSB_Buffer, BytesToSend);
+			Endpoint_ClearIN();
+
+			BridgeStatistics.USARTtoUSBBytes += BytesToSend;
+
+			/* A full packet does not end the transfer on the host side, so remember to terminate it later */
+			TransferNeedsTermination = (BytesToSend == CDC_TXRX_EPSIZE);
 		}
-		
-		// Check SCK Pin and activate PRG-LED (to handle as L-LED from original Arduino)
-		#if (BOARD == BOARD_GSCHEIDUINO)
-		if(PINB & (1<<PINB1))
-			LEDS_PORT &= ~(LEDS_LED1);
-		else
-			LEDS_PORT |= (LEDS_LED1);
+
+		#if defined(ENABLE_BRIDGE_FLOW_CONTROL)
+		/* Let the target resume sending once the buffer has drained to its low watermark */
+		if (BridgeRingBuffer_GetCount(&USARTtoUSB_Buffer) <= USART_TO_USB_LOW_WATERMARK)
+		  BRIDGE_RTS_PORT &= ~BRIDGE_RTS_MASK;
 		#endif
-		
-		USB_USBTask();
-		
-		counter++;
-		if(counter == 1000)
-		{
-			#if (BOARD == BOARD_GSCHEIDUINO)
-				LEDS_PORT |= (LEDMASK_TX | LEDMASK_RX);
-			#else
-				LEDS_PORT &= ~(LEDMASK_TX | LEDMASK_RX);
-			#endif
-			counter = 0;
-		}
 	}
+
+	if (PendingLineErrors)
+	  UARTBridge_SendLineErrors();
+
+	if (Tasks & TASK_USB)
+	  CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
+}
+
+/** Copies as much of the packet in the currently selected CDC OUT endpoint bank as will fit into the given ring
+ *  buffer, moving each contiguous region of the ring's storage in a single stream operation rather than a byte at a
+ *  time. Any bytes that do not fit are left in the bank for a later call.
+ *
+ *  \param[in,out] Buffer  Ring buffer to store the received data into, as its producer
+ *
+ *  \return Number of bytes moved out of the endpoint bank into the ring buffer
+ */
+static uint16_t UARTBridge_ReceiveBlock(BridgeRingBuffer_t* const Buffer)
+{
+	uint16_t BytesMoved = 0;
+
+	for (;;)
+	{
+		/* Limit each block to the data in the bank, and the free space in the ring before its storage wraps */
+		uint8_t BytesToMove = MIN(Endpoint_BytesInEndpoint(), BridgeRingBuffer_GetFreeSpan(Buffer));
+
+		if (!(BytesToMove))
+		  break;
+
+		Endpoint_Read_Stream_LE(BridgeRingBuffer_GetHeadPtr(Buffer), BytesToMove, NULL);
+		BridgeRingBuffer_CommitInsert(Buffer, BytesToMove);
+
+		BytesMoved += BytesToMove;
+	}
+
+	return BytesMoved;
+}
+
+/** Writes the given number of bytes from the tail of a ring buffer into the currently selected CDC IN endpoint bank,
+ *  moving each contiguous region of the ring's storage in a single stream operation rather than a byte at a time. The
+ *  caller is responsible for ensuring the ring holds at least the requested number of bytes, that they fit into the
+ *  bank, and for sending the bank to the host afterwards.
+ *
+ *  \param[in,out] Buffer       Ring buffer to remove the data from, as its consumer
+ *  \param[in]     BytesToSend  Number of bytes to move into the endpoint bank
+ */
+static void UARTBridge_SendBlock(BridgeRingBuffer_t* const Buffer,
+                                 uint8_t BytesToSend)
+{
+	while (BytesToSend)
+	{
+		uint8_t BytesInBlock = MIN(BytesToSend, BridgeRingBuffer_GetDataSpan(Buffer));
+
+		Endpoint_Write_Stream_LE(BridgeRingBuffer_GetTailPtr(Buffer), BytesInBlock, NULL);
+		BridgeRingBuffer_CommitRemove(Buffer, BytesInBlock);
+
+		BytesToSend -= BytesInBlock;
+	}
+}
+
+/** Reports any USART errors flagged by the receive interrupt to the host, as a CDC SerialState notification with the
+ *  matching error bits set. The error bits are irregular signals in the CDC specification, so they are cleared again
+ *  once sent. Nothing is sent while the previous notification is still waiting for the host, so that the main loop
+ *  never blocks on the notification endpoint; the errors remain pending until the next call.
+ */
+static void UARTBridge_SendLineErrors(void)
+{
+	Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.NotificationEndpoint.Address);
+
+	/* Wake once the host has read the previous notification, to send the next */
+	if (!(Endpoint_IsINReady()))
+	{
+		UEIENX |= (1 << TXINE);
+		return;
+	}
+
+	uint8_t LineErrors;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		LineErrors        = PendingLineErrors;
+		PendingLineErrors = 0;
+	}
+
+	VirtualSerial_CDC_Interface.State.ControlLineStates.DeviceToHost |=  LineErrors;
+	CDC_Device_SendControlLineStateChange(&VirtualSerial_CDC_Interface);
+	VirtualSerial_CDC_Interface.State.ControlLineStates.DeviceToHost &= ~LineErrors;
 }
 
 /** Processes incoming V2 Protocol commands from the host, returning a response when required. */
@@ -223,6 +440,10 @@ void AVRISP_Task(void)
 			LEDS_PORT &= ~(LEDS_LED1);
 		#endif
 	}
+
+	/* Wake on the next command from the host */
+	Endpoint_SelectEndpoint(AVRISP_DATA_OUT_EPADDR);
+	UEIENX |= (1 << RXOUTE);
 }
 
 /** Configures the board hardware and chip peripherals for the demo's functionality. */
@@ -292,6 +513,14 @@ void EVENT_USB_Device_Disconnect(void)
 	#endif
 }
 
+/** Event handler for the library USB Reset event. */
+void EVENT_USB_Device_Reset(void)
+{
+	/* The control endpoint has been reconfigured, so arm it to wake the main loop on the first control request */
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	UEIENX |= (1 << RXSTPE);
+}
+
 /** Event handler for the library USB Configuration Changed event. */
 void EVENT_USB_Device_ConfigurationChanged(void)
 {
@@ -301,20 +530,33 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 	{
 		ConfigSuccess &= CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
 
-		/* Configure the UART flush timer - run at Fcpu/1024 for maximum interval before overflow */
-		//TCCR0B = ((1 << CS02) | (1 << CS00));
+		/* Configure the UART flush timer for the default latency */
+		UARTBridge_SetLatencyTimer(BRIDGE_LATENCY_TIMER_US);
 
 		/* Initialize ring buffers used to hold serial data between USB and software UART interfaces */
-		RingBuffer_InitBuffer(&USBtoUSART_Buffer, USBtoUSART_Buffer_Data, sizeof(USBtoUSART_Buffer_Data));
-		RingBuffer_InitBuffer(&USARTtoUSB_Buffer, USARTtoUSB_Buffer_Data, sizeof(USARTtoUSB_Buffer_Data));
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			BridgeRingBuffer_InitBuffer(&USBtoUSART_Buffer, ModeBuffers.Bridge.USBtoUSART_Data,
+			                            sizeof(ModeBuffers.Bridge.USBtoUSART_Data));
+			BridgeRingBuffer_InitBuffer(&USARTtoUSB_Buffer, ModeBuffers.Bridge.USARTtoUSB_Data,
+			                            sizeof(ModeBuffers.Bridge.USARTtoUSB_Data));
+		}
+
+		#if defined(ENABLE_BRIDGE_FLOW_CONTROL)
+		/* Buffers are now empty, allow the target to start sending */
+		BRIDGE_RTS_PORT &= ~BRIDGE_RTS_MASK;
+		#endif
 	}
 	else
 	{
-		/* Setup AVRISP Data OUT endpoint */
-		ConfigSuccess &= Endpoint_ConfigureEndpoint(AVRISP_DATA_OUT_EPADDR, EP_TYPE_BULK, AVRISP_DATA_EPSIZE, 1);
+		bool SharedEndpoint = ((AVRISP_DATA_IN_EPADDR & ENDPOINT_EPNUM_MASK) == (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK));
+
+		/* Setup AVRISP Data OUT endpoint, double banked if it is also used for the IN direction */
+		ConfigSuccess &= Endpoint_ConfigureEndpoint(AVRISP_DATA_OUT_EPADDR, EP_TYPE_BULK, AVRISP_DATA_EPSIZE,
+		                                            (SharedEndpoint ? AVRISP_DATA_EPBANKS : 1));
 
 		/* Setup AVRISP Data IN endpoint if it is using a physically different endpoint */
-		if ((AVRISP_DATA_IN_EPADDR & ENDPOINT_EPNUM_MASK) != (AVRISP_DATA_OUT_EPADDR & ENDPOINT_EPNUM_MASK))
+		if (!(SharedEndpoint))
 		  ConfigSuccess &= Endpoint_ConfigureEndpoint(AVRISP_DATA_IN_EPADDR, EP_TYPE_BULK, AVRISP_DATA_EPSIZE, 1);
 	}
 
@@ -334,7 +576,45 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 			LEDS_PORT |= (LEDS_LED1);
 		#endif
 	}
-	
+
+	/* Start the 1ms Start of Frame tick which times the LED indications */
+	USB_Device_EnableSOFEvents();
+}
+
+/** Event handler for the library USB Start of Frame event, raised by the host every millisecond once the device is
+ *  configured. Times the TX and RX activity LED pulses, so that the data paths only need to request a pulse rather
+ *  than drive the LEDs themselves.
+ */
+void EVENT_USB_Device_StartOfFrame(void)
+{
+	uint8_t ActiveLEDs = 0;
+
+	/* Run the USB tasks at least once per frame, as a backstop for any event without its own wake up interrupt */
+	PendingTasks |= TASK_USB;
+
+	if (PulseMSRemaining.TxLEDPulse)
+	{
+		PulseMSRemaining.TxLEDPulse--;
+		ActiveLEDs |= LEDMASK_TX;
+	}
+
+	if (PulseMSRemaining.RxLEDPulse)
+	{
+		PulseMSRemaining.RxLEDPulse--;
+		ActiveLEDs |= LEDMASK_RX;
+	}
+
+	#if (BOARD == BOARD_GSCHEIDUINO)
+		LEDS_PORT = ((LEDS_PORT | (LEDMASK_TX | LEDMASK_RX)) & ~ActiveLEDs);
+
+		// Check SCK Pin and activate PRG-LED (to handle as L-LED from original Arduino)
+		if(PINB & (1<<PINB1))
+			LEDS_PORT &= ~(LEDS_LED1);
+		else
+			LEDS_PORT |= (LEDS_LED1);
+	#else
+		LEDS_PORT = ((LEDS_PORT & ~(LEDMASK_TX | LEDMASK_RX)) | ActiveLEDs);
+	#endif
 }
 
 /** Event handler for the CDC Class driver Host-to-Device Line Encoding Changed event.
@@ -355,7 +635,124 @@ void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const C
 void EVENT_USB_Device_ControlRequest(void)
 {
 	if (CurrentFirmwareMode == MODE_USART_BRIDGE)
+	{
+		UARTBridge_ProcessControlRequest();
 		CDC_Device_ProcessControlRequest(&VirtualSerial_CDC_Interface);
+	}
+}
+
+/** Processes the vendor specific control requests used to tune the USART bridge at runtime. Standard and CDC
+ *  class requests are left for the library and CDC class driver to handle.
+ */
+static void UARTBridge_ProcessControlRequest(void)
+{
+	switch (USB_ControlRequest.bRequest)
+	{
+		case BRIDGE_REQ_SetLatencyTimer:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				UARTBridge_SetLatencyTimer(USB_ControlRequest.wValue);
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		case BRIDGE_REQ_GetLatencyTimer:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&LatencyTimerUS, MIN(USB_ControlRequest.wLength, sizeof(LatencyTimerUS)));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case BRIDGE_REQ_GetBaudInfo:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&CurrentBaudInfo, MIN(USB_ControlRequest.wLength, sizeof(CurrentBaudInfo)));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case BRIDGE_REQ_GetStatistics:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				UARTBridge_Statistics_t Statistics;
+
+				/* Take a consistent snapshot, clearing the counters in the same step if requested so none are lost */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					Statistics = BridgeStatistics;
+
+					if (USB_ControlRequest.wValue)
+					  BridgeStatistics = (UARTBridge_Statistics_t){0};
+				}
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&Statistics, MIN(USB_ControlRequest.wLength, sizeof(Statistics)));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+	}
+}
+
+/** Configures Timer 0 as the USART to USB latency timer, which is restarted by each received byte and flags
+ *  (via its compare match flag) that the line has been idle for the given period. The period is rounded up to
+ *  the resolution of the slowest timer prescaler that can represent it, and limited to the longest period the
+ *  timer can represent at the maximum prescaler (16ms at 16MHz).
+ *
+ *  \param[in] LatencyUS  New latency timer period in microseconds, or zero to send data as soon as possible
+ */
+static void UARTBridge_SetLatencyTimer(const uint16_t LatencyUS)
+{
+	uint32_t CPUTicks = ((uint32_t)LatencyUS * (F_CPU / 1000000));
+	uint8_t  ClockSelect;
+	uint8_t  PrescalerShift;
+
+	TCCR0B = 0;
+
+	if (!(LatencyUS))
+	{
+		LatencyTimerUS = 0;
+		return;
+	}
+
+	if (CPUTicks <= (256UL << 3))
+	{
+		ClockSelect    = (1 << CS01);
+		PrescalerShift = 3;
+	}
+	else if (CPUTicks <= (256UL << 6))
+	{
+		ClockSelect    = ((1 << CS01) | (1 << CS00));
+		PrescalerShift = 6;
+	}
+	else if (CPUTicks <= (256UL << 8))
+	{
+		ClockSelect    = (1 << CS02);
+		PrescalerShift = 8;
+	}
+	else
+	{
+		ClockSelect    = ((1 << CS02) | (1 << CS00));
+		PrescalerShift = 10;
+		CPUTicks       = MIN(CPUTicks, (256UL << 10));
+	}
+
+	uint16_t TimerTicks = ((CPUTicks + ((1UL << PrescalerShift) - 1)) >> PrescalerShift);
+
+	LatencyTimerUS = ((((uint32_t)TimerTicks << PrescalerShift) + ((F_CPU / 1000000) - 1)) / (F_CPU / 1000000));
+
+	/* Run the timer in CTC mode so that the compare flag is set once per period, restarting from an expired state;
+	 * compare channel B matches at the same count, and is used as the interrupt to wake the main loop */
+	TCCR0A = (1 << WGM01);
+	OCR0A  = (TimerTicks - 1);
+	OCR0B  = (TimerTicks - 1);
+	TCNT0  = 0;
+	TIFR0  = (1 << OCF0A);
+	TCCR0B = ClockSelect;
 }
 
 /** ISR to manage the reception of data from the serial port, placing received bytes into a circular buffer
@@ -363,12 +760,149 @@ void EVENT_USB_Device_ControlRequest(void)
  */
 ISR(USART1_RX_vect, ISR_BLOCK)
 {
+	/* Error flags apply to the byte at the head of the receive FIFO, so must be read before the data register */
+	uint8_t LineStatus   = UCSR1A;
 	uint8_t ReceivedByte = UDR1;
 
-	if ((USB_DeviceState == DEVICE_STATE_Configured) && !(RingBuffer_IsFull(&USARTtoUSB_Buffer)))
-	  RingBuffer_Insert(&USARTtoUSB_Buffer, ReceivedByte);
+	/* Restart the latency timer, so that it only expires once the line goes idle, and wake on its expiry */
+	TCNT0  = 0;
+	TIFR0  = ((1 << OCF0B) | (1 << OCF0A));
+	TIMSK0 = (1 << OCIE0B);
+
+	if (LineStatus & ((1 << FE1) | (1 << DOR1) | (1 << UPE1)))
+	  UARTBridge_RecordLineErrors(LineStatus);
+
+	if (USB_DeviceState == DEVICE_STATE_Configured)
+	{
+		if (BridgeRingBuffer_IsFull(&USARTtoUSB_Buffer))
+		{
+			BridgeStatistics.DroppedBytes++;
+			PendingLineErrors |= CDC_CONTROL_LINE_IN_OVERRUNERROR;
+		}
+		else
+		{
+			BridgeRingBuffer_Insert(&USARTtoUSB_Buffer, ReceivedByte);
+
+			uint8_t ReceiveLevel = BridgeRingBuffer_GetCount(&USARTtoUSB_Buffer);
+			if (ReceiveLevel > BridgeStatistics.USARTtoUSBHighWater)
+			  BridgeStatistics.USARTtoUSBHighWater = ReceiveLevel;
+
+			/* Only wake the main loop once there is a full packet, unless partial packets are sent immediately */
+			if (!(LatencyTimerUS) || (ReceiveLevel >= CDC_TXRX_EPSIZE))
+			  PendingTasks |= TASK_BRIDGE_USART_TO_USB;
+		}
+	}
+
+	/* Errors are reported by the main loop, which needs waking to send them */
+	if (PendingLineErrors)
+	  PendingTasks |= TASK_BRIDGE_USART_TO_USB;
+
+	#if defined(ENABLE_BRIDGE_FLOW_CONTROL)
+	/* Ask the target to pause at the high watermark, leaving room for any bytes it already has in flight */
+	if (BridgeRingBuffer_GetCount(&USARTtoUSB_Buffer) >= USART_TO_USB_HIGH_WATERMARK)
+	  BRIDGE_RTS_PORT |= BRIDGE_RTS_MASK;
+	#endif
 }
 
+/** Counts the USART receive errors flagged in the given USART status register value, and queues them for reporting
+ *  to the host in the next SerialState notification. Called from the USART receive interrupt only when an error is
+ *  present, to keep the common error free path short.
+ *
+ *  \param[in] LineStatus  Value of the USART's UCSR1A register for the received byte
+ */
+static void UARTBridge_RecordLineErrors(const uint8_t LineStatus)
+{
+	if (LineStatus & (1 << FE1))
+	{
+		BridgeStatistics.FrameErrors++;
+		PendingLineErrors |= CDC_CONTROL_LINE_IN_FRAMEERROR;
+	}
+
+	if (LineStatus & (1 << UPE1))
+	{
+		BridgeStatistics.ParityErrors++;
+		PendingLineErrors |= CDC_CONTROL_LINE_IN_PARITYERROR;
+	}
+
+	if (LineStatus & (1 << DOR1))
+	{
+		BridgeStatistics.OverrunErrors++;
+		PendingLineErrors |= CDC_CONTROL_LINE_IN_OVERRUNERROR;
+	}
+}
+
+/** ISR to manage the transmission of data to the serial port, loading the next byte from the circular buffer
+ *  of host data each time the USART's transmit data register empties. The interrupt is disabled again once the
+ *  buffer runs dry, and re-enabled by the main loop when new data from the host is buffered.
+ */
+ISR(USART1_UDRE_vect, ISR_BLOCK)
+{
+	#if defined(ENABLE_BRIDGE_FLOW_CONTROL)
+	/* Hold off while the target has CTS deasserted - the CTS pin change interrupt restarts transmission */
+	if (BRIDGE_CTS_PIN & BRIDGE_CTS_MASK)
+	{
+		UCSR1B &= ~(1 << UDRIE1);
+		return;
+	}
+	#endif
+
+	if (!(BridgeRingBuffer_IsEmpty(&USBtoUSART_Buffer)))
+	  UDR1 = BridgeRingBuffer_Remove(&USBtoUSART_Buffer);
+
+	uint8_t TransmitLevel = BridgeRingBuffer_GetCount(&USBtoUSART_Buffer);
+
+	/* Wake the main loop to accept more host data once the buffer has drained to its low watermark */
+	if (TransmitLevel == USB_TO_USART_LOW_WATERMARK)
+	  PendingTasks |= TASK_BRIDGE_USB_TO_USART;
+
+	if (!(TransmitLevel))
+	  UCSR1B &= ~(1 << UDRIE1);
+}
+
+/** ISR for the latency timer's expiry after the USART line has gone idle, waking the main loop to send any partial
+ *  packet of received data to the host. The interrupt is one-shot, and re-armed by the next received byte.
+ */
+ISR(TIMER0_COMPB_vect, ISR_BLOCK)
+{
+	TIMSK0 &= ~(1 << OCIE0B);
+	PendingTasks |= TASK_BRIDGE_USART_TO_USB;
+}
+
+/** ISR for the USB endpoint interrupts armed by the main loop before it sleeps, on an endpoint becoming ready for
+ *  the work it left waiting. Each endpoint that fired is disarmed, as its condition persists until the main loop
+ *  services it, and the main loop is flagged to run the USB tasks. LUFA only defines this vector itself when the
+ *  control endpoint is interrupt driven, which this project does not use.
+ */
+ISR(USB_COM_vect, ISR_BLOCK)
+{
+	uint8_t PrevSelectedEndpoint = Endpoint_GetCurrentEndpoint();
+	uint8_t EndpointInterrupts   = UEINT;
+
+	for (uint8_t EPNum = 0; EndpointInterrupts; EPNum++, EndpointInterrupts >>= 1)
+	{
+		if (EndpointInterrupts & 0x01)
+		{
+			Endpoint_SelectEndpoint(EPNum);
+			UEIENX = 0;
+		}
+	}
+
+	Endpoint_SelectEndpoint(PrevSelectedEndpoint);
+
+	PendingTasks |= TASK_USB;
+}
+
+#if defined(ENABLE_BRIDGE_FLOW_CONTROL)
+/** ISR to restart transmission to the target once it reasserts its CTS line, after the transmit interrupt was
+ *  disabled because the target was not ready to receive.
+ */
+ISR(PCINT0_vect, ISR_BLOCK)
+{
+	if (!(BRIDGE_CTS_PIN & BRIDGE_CTS_MASK))
+	  UCSR1B |= (1 << UDRIE1);
+}
+#endif
+
 /** Event handler for the CDC Class driver Line Encoding Changed event.
  *
  *  \param[in] CDCInterfaceInfo  Pointer to the CDC class interface configuration structure being referenced
@@ -412,17 +946,85 @@ void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCI
 	UCSR1C = 0;
 
 	/* Set the new baud rate before configuring the USART */
-	UBRR1  = SERIAL_2X_UBBRVAL(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS);
+	UARTBridge_SelectBaudDivider(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS);
+	UBRR1  = CurrentBaudInfo.DividerValue;
 
-	/* Reconfigure the USART in double speed mode for a wider baud rate range at the expense of accuracy */
+	/* Reconfigure the USART, in double speed mode if that gives the more accurate baud rate */
 	UCSR1C = ConfigMask;
-	UCSR1A = (1 << U2X1);
-	UCSR1B = ((1 << RXCIE1) | (1 << TXEN1) | (1 << RXEN1));
+	UCSR1A = (CurrentBaudInfo.DoubleSpeed ? (1 << U2X1) : 0);
+
+	/* Re-arm the transmit interrupt too, so that any data still buffered from the host resumes sending */
+	UCSR1B = ((1 << RXCIE1) | (1 << UDRIE1) | (1 << TXEN1) | (1 << RXEN1));
 
 	/* Release the TX line after the USART has been reconfigured */
 	PORTD &= ~(1 << 3);
 }
 
+/** Calculates the baud rate generator divider in both normal and double speed USART modes for the given baud rate,
+ *  and selects the combination giving the lowest error into \ref CurrentBaudInfo. Normal speed mode is preferred when
+ *  both are equally accurate, as the receiver then takes more samples per bit and so tolerates more noise. Rates that
+ *  cannot be reached are clamped to the nearest achievable rate, leaving the host to judge the reported error.
+ *
+ *  \param[in] BaudRateBPS  Baud rate requested by the host, in bits per second
+ */
+static void UARTBridge_SelectBaudDivider(uint32_t BaudRateBPS)
+{
+	BaudRateBPS = MAX(BaudRateBPS, 1);
+
+	uint32_t NormalDivider = MIN(((F_CPU / 16) + (BaudRateBPS / 2)) / BaudRateBPS, 4096);
+	uint32_t DoubleDivider = MIN(((F_CPU / 8)  + (BaudRateBPS / 2)) / BaudRateBPS, 4096);
+
+	NormalDivider = MAX(NormalDivider, 1);
+	DoubleDivider = MAX(DoubleDivider, 1);
+
+	uint32_t NormalBaudBPS = ((F_CPU / 16) / NormalDivider);
+	uint32_t DoubleBaudBPS = ((F_CPU / 8)  / DoubleDivider);
+
+	int16_t  NormalError   = UARTBridge_GetBaudError(BaudRateBPS, NormalBaudBPS);
+	int16_t  DoubleError   = UARTBridge_GetBaudError(BaudRateBPS, DoubleBaudBPS);
+
+	if (abs(DoubleError) < abs(NormalError))
+	{
+		CurrentBaudInfo.ActualBaudBPS = DoubleBaudBPS;
+		CurrentBaudInfo.Error         = DoubleError;
+		CurrentBaudInfo.DividerValue  = (DoubleDivider - 1);
+		CurrentBaudInfo.DoubleSpeed   = true;
+	}
+	else
+	{
+		CurrentBaudInfo.ActualBaudBPS = NormalBaudBPS;
+		CurrentBaudInfo.Error         = NormalError;
+		CurrentBaudInfo.DividerValue  = (NormalDivider - 1);
+		CurrentBaudInfo.DoubleSpeed   = false;
+	}
+}
+
+/** Calculates the relative error of an achieved baud rate against the requested rate.
+ *
+ *  \param[in] RequestedBPS  Baud rate requested by the host, in bits per second
+ *  \param[in] ActualBPS     Baud rate achieved by the USART, in bits per second
+ *
+ *  \return Signed error of the actual rate in hundredths of a percent, saturated to the range of a 16-bit integer
+ */
+static int16_t UARTBridge_GetBaudError(const uint32_t RequestedBPS,
+                                       const uint32_t ActualBPS)
+{
+	uint32_t Difference = (ActualBPS > RequestedBPS) ? (ActualBPS - RequestedBPS) : (RequestedBPS - ActualBPS);
+	uint32_t Error;
+
+	/* Scale before dividing where possible to keep the precision, otherwise divide first to avoid an overflow */
+	if (Difference <= (UINT32_MAX / 10000))
+	  Error = ((Difference * 10000) / RequestedBPS);
+	else if (RequestedBPS >= 10000)
+	  Error = (Difference / (RequestedBPS / 10000));
+	else
+	  Error = INT16_MAX;
+
+	Error = MIN(Error, INT16_MAX);
+
+	return (ActualBPS > RequestedBPS) ? (int16_t)Error : -(int16_t)Error;
+}
+
 /** This function is called by the library when in device mode, and must be overridden (see library "USB Descriptors"
  *  documentation) by the application code so that the address and size of a requested descriptor can be given
  *  to the USB library. When the device receives a Get Descriptor request on the control endpoint, this function
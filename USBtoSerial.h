@@ -41,15 +41,17 @@
 		#include <avr/wdt.h>
 		#include <avr/interrupt.h>
 		#include <avr/power.h>
+		#include <avr/sleep.h>
+		#include <util/atomic.h>
+		#include <stdlib.h>
 
 		#include "Descriptors.h"
 		//#include "AVRISPDescriptors.h"
 		#include "Lib/V2Protocol.h"
+		#include "Lib/BridgeRingBuffer.h"
 		#include "Config/AppConfig.h"
 
 		//#include <LUFA/Drivers/Board/LEDs.h>
-		#include <LUFA/Drivers/Peripheral/Serial.h>
-		#include <LUFA/Drivers/Misc/RingBuffer.h>
 		#include <LUFA/Drivers/USB/USB.h>
 		#include <LUFA/Platform/Platform.h>
 
@@ -94,27 +96,161 @@
 		#define LEDMASK_TX					LEDS_LED2
 		#define LEDMASK_RX					LEDS_LED3
 		
+		#if (!defined(USART_TO_USB_BUFFER_SIZE) || defined(__DOXYGEN__))
+			/** Size in bytes of the buffer holding data received from the target before it is sent to the host. Must be
+			 *  a power of two no larger than 256; one byte of the buffer is always kept free.
+			 */
+			#define USART_TO_USB_BUFFER_SIZE  256
+		#endif
+
+		#if (!defined(USB_TO_USART_BUFFER_SIZE) || defined(__DOXYGEN__))
+			/** Size in bytes of the buffer holding data received from the host before it is sent to the target. Must be
+			 *  a power of two no larger than 256; one byte of the buffer is always kept free.
+			 */
+			#define USB_TO_USART_BUFFER_SIZE  128
+		#endif
+
+		#if ((USART_TO_USB_BUFFER_SIZE & (USART_TO_USB_BUFFER_SIZE - 1)) || (USART_TO_USB_BUFFER_SIZE > 256))
+			#error USART_TO_USB_BUFFER_SIZE must be a power of two no larger than 256.
+		#endif
+
+		#if ((USB_TO_USART_BUFFER_SIZE & (USB_TO_USART_BUFFER_SIZE - 1)) || (USB_TO_USART_BUFFER_SIZE > 256))
+			#error USB_TO_USART_BUFFER_SIZE must be a power of two no larger than 256.
+		#endif
+
+		#if (!defined(USART_TO_USB_HIGH_WATERMARK) || defined(__DOXYGEN__))
+			/** Fill level of the target to host buffer at which RTS is deasserted when flow control is enabled, leaving
+			 *  headroom for bytes the target sends before it reacts.
+			 */
+			#define USART_TO_USB_HIGH_WATERMARK  (USART_TO_USB_BUFFER_SIZE - (USART_TO_USB_BUFFER_SIZE / 4))
+		#endif
+
+		#if (!defined(USART_TO_USB_LOW_WATERMARK) || defined(__DOXYGEN__))
+			/** Fill level of the target to host buffer at or below which RTS is reasserted when flow control is enabled. */
+			#define USART_TO_USB_LOW_WATERMARK   (USART_TO_USB_BUFFER_SIZE / 4)
+		#endif
+
+		#if (!defined(USB_TO_USART_HIGH_WATERMARK) || defined(__DOXYGEN__))
+			/** Fill level of the host to target buffer at which the host's data is left waiting in the OUT endpoint when
+			 *  flow control is enabled.
+			 */
+			#define USB_TO_USART_HIGH_WATERMARK  (USB_TO_USART_BUFFER_SIZE - (USB_TO_USART_BUFFER_SIZE / 4))
+		#endif
+
+		#if (!defined(USB_TO_USART_LOW_WATERMARK) || defined(__DOXYGEN__))
+			/** Fill level of the host to target buffer at or below which host data is accepted again when flow control
+			 *  is enabled.
+			 */
+			#define USB_TO_USART_LOW_WATERMARK   (USB_TO_USART_BUFFER_SIZE / 4)
+		#endif
+
+		#if (!defined(BRIDGE_LATENCY_TIMER_US) || defined(__DOXYGEN__))
+			/** Default USART to USB latency timer period in microseconds, applied each time the device is configured.
+			 *  A value of zero sends received data to the host as soon as possible.
+			 */
+			#define BRIDGE_LATENCY_TIMER_US  0
+		#endif
+
+		#if (!defined(LED_ACTIVITY_PULSE_MS) || defined(__DOXYGEN__))
+			/** Period in milliseconds that the TX and RX LEDs remain lit after each burst of data, timed from the USB
+			 *  Start of Frame tick. Must be no larger than 255.
+			 */
+			#define LED_ACTIVITY_PULSE_MS    30
+		#endif
+
+		/** Vendor control request to set the USART to USB latency timer period, given in microseconds in wValue. */
+		#define BRIDGE_REQ_SetLatencyTimer   0x09
+
+		/** Vendor control request to read back the effective USART to USB latency timer period, as a 16-bit
+		 *  little-endian value in microseconds.
+		 */
+		#define BRIDGE_REQ_GetLatencyTimer   0x0A
+
+		/** Vendor control request to read back the USART baud rate generator settings chosen for the last line encoding
+		 *  set by the host, as a \ref UARTBridge_BaudInfo_t structure.
+		 */
+		#define BRIDGE_REQ_GetBaudInfo       0x0B
+
+		/** Vendor control request to read the bridge statistics as a \ref UARTBridge_Statistics_t structure. A non-zero
+		 *  wValue clears the statistics in the same operation, so that no counts are lost between reading and clearing.
+		 */
+		#define BRIDGE_REQ_GetStatistics     0x0C
+
+		/** General purpose I/O register holding the \c TASK_* flags for work left by interrupts for the main loop. */
+		#define PendingTasks                 GPIOR2
+
+		/** Pending task flag for USB control, endpoint and Start of Frame events, which run the USB tasks. */
+		#define TASK_USB                     (1 << 0)
+
+		/** Pending task flag for USART bridge data from the target that is ready to send to the host. */
+		#define TASK_BRIDGE_USART_TO_USB     (1 << 1)
+
+		/** Pending task flag for space in the USART bridge transmit buffer, for host data waiting in the OUT endpoint. */
+		#define TASK_BRIDGE_USB_TO_USART     (1 << 2)
+
 		/** Firmware mode define for the USART Bridge mode. */
 		#define MODE_USART_BRIDGE        false
 
 		/** Firmware mode define for the AVRISP Programmer mode. */
 		#define MODE_PDI_PROGRAMMER      true	
 		
-		/* External Variables: */
+	/* Type Defines: */
+		/** Type define for the USART baud rate generator settings reported to the host by the \ref BRIDGE_REQ_GetBaudInfo
+		 *  vendor request. All multi-byte values are little-endian.
+		 */
+		typedef struct
+		{
+			uint32_t ActualBaudBPS; /**< Baud rate actually generated by the USART, in bits per second */
+			int16_t  Error; /**< Signed error of the actual baud rate relative to the requested rate, in hundredths of a percent */
+			uint16_t DividerValue; /**< Value loaded into the USART baud rate register */
+			uint8_t  DoubleSpeed; /**< Non-zero if the USART is running in double speed (U2X) mode */
+		} ATTR_PACKED UARTBridge_BaudInfo_t;
+
+		/** Type define for the USART bridge statistics reported to the host by the \ref BRIDGE_REQ_GetStatistics vendor
+		 *  request. All multi-byte values are little-endian, and all counters wrap on overflow.
+		 */
+		typedef struct
+		{
+			uint32_t USBtoUSARTBytes; /**< Number of bytes received from the host for the target */
+			uint32_t USARTtoUSBBytes; /**< Number of bytes sent to the host from the target */
+			uint8_t  USBtoUSARTHighWater; /**< Highest fill level seen in the host to target buffer */
+			uint8_t  USARTtoUSBHighWater; /**< Highest fill level seen in the target to host buffer */
+			uint16_t DroppedBytes; /**< Number of bytes from the target discarded because the target to host buffer was full */
+			uint16_t FrameErrors; /**< Number of bytes received from the target with a framing error */
+			uint16_t ParityErrors; /**< Number of bytes received from the target with a parity error */
+			uint16_t OverrunErrors; /**< Number of USART hardware receive overruns, each losing one or more bytes */
+		} ATTR_PACKED UARTBridge_Statistics_t;
+
+	/* External Variables: */
 		extern bool         CurrentFirmwareMode;
 
 	/* Function Prototypes: */
 		void SetupHardware(void);
 		void AVRISP_Task(void);
-		void UARTBridge_Task(void);
+		void UARTBridge_Task(const uint8_t Tasks);
 
 		void EVENT_USB_Device_Connect(void);
 		void EVENT_USB_Device_Disconnect(void);
+		void EVENT_USB_Device_Reset(void);
 		void EVENT_USB_Device_ConfigurationChanged(void);
 		void EVENT_USB_Device_ControlRequest(void);
+		void EVENT_USB_Device_StartOfFrame(void);
 
 		void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
 		void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+
+		#if defined(INCLUDE_FROM_USBTOSERIAL_C)
+			static uint16_t UARTBridge_ReceiveBlock(BridgeRingBuffer_t* const Buffer);
+			static void UARTBridge_SendBlock(BridgeRingBuffer_t* const Buffer,
+			                                 uint8_t BytesToSend);
+			static void UARTBridge_SendLineErrors(void);
+			static void UARTBridge_RecordLineErrors(const uint8_t LineStatus);
+			static void UARTBridge_ProcessControlRequest(void);
+			static void UARTBridge_SetLatencyTimer(const uint16_t LatencyUS);
+			static void UARTBridge_SelectBaudDivider(uint32_t BaudRateBPS);
+			static int16_t UARTBridge_GetBaudError(const uint32_t RequestedBPS,
+			                                       const uint32_t ActualBPS);
+		#endif
 		
 		uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 									const uint8_t wIndex,